@@ -144,21 +144,23 @@ void LeapMotionClient::onFrame(const Leap::Controller& controller) {
 
 			if (!readyFlag) {
 				virtualId = inputEmulator->addVirtualDevice(vrinputemulator::VirtualDeviceType::TrackedController, serial.c_str(), true);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_DeviceClass_Int32, (int32_t)vr::TrackedDeviceClass_Controller);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_SupportedButtons_Uint64, (uint64_t)
+				vrinputemulator::DevicePropertyList properties;
+				properties.set(vr::Prop_DeviceClass_Int32, (int32_t)vr::TrackedDeviceClass_Controller);
+				properties.set(vr::Prop_SupportedButtons_Uint64, (uint64_t)
 					vr::ButtonMaskFromId(vr::k_EButton_System) |
 					vr::ButtonMaskFromId(vr::k_EButton_ApplicationMenu) |
 					vr::ButtonMaskFromId(vr::k_EButton_Grip) |
 					vr::ButtonMaskFromId(vr::k_EButton_Axis0) |
 					vr::ButtonMaskFromId(vr::k_EButton_Axis1)
 					);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_Axis0Type_Int32, (int32_t)vr::k_eControllerAxis_Joystick);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_Axis1Type_Int32, (int32_t)vr::k_eControllerAxis_Trigger);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_HardwareRevision_Uint64, (uint64_t)666);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_FirmwareVersion_Uint64, (uint64_t)666);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_RenderModelName_String, std::string("vr_controller_vive_1_5"));
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_ManufacturerName_String, std::string("Leap Motion"));
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_ModelNumber_String, std::string("Leap Motion Controller"));
+				properties.set(vr::Prop_Axis0Type_Int32, (int32_t)vr::k_eControllerAxis_Joystick);
+				properties.set(vr::Prop_Axis1Type_Int32, (int32_t)vr::k_eControllerAxis_Trigger);
+				properties.set(vr::Prop_HardwareRevision_Uint64, (uint64_t)666);
+				properties.set(vr::Prop_FirmwareVersion_Uint64, (uint64_t)666);
+				properties.set(vr::Prop_RenderModelName_String, std::string("vr_controller_vive_1_5"));
+				properties.set(vr::Prop_ManufacturerName_String, std::string("Leap Motion"));
+				properties.set(vr::Prop_ModelNumber_String, std::string("Leap Motion Controller"));
+				inputEmulator->setVirtualDeviceProperties(virtualId, properties);
 				inputEmulator->publishVirtualDevice(virtualId);
 
 				readyFlag = true;
@@ -179,7 +181,7 @@ void LeapMotionClient::onFrame(const Leap::Controller& controller) {
 			}
 
 			inputEmulator->setVirtualDevicePose(virtualId, pose);
-			inputEmulator->setVirtualControllerState(virtualId, state);
+			inputEmulator->setVirtualControllerState(virtualId, state, false);
 		};
 
 		auto handleHand2 = [this](const Leap::Hand& h, vr::DriverPose_t& pose, vr::VRControllerState_t& state, bool& handPresent, bool& readyFlag, const std::string& serial, uint32_t& virtualId) {
@@ -208,28 +210,30 @@ void LeapMotionClient::onFrame(const Leap::Controller& controller) {
 
 			if (!readyFlag) {
 				virtualId = inputEmulator->addVirtualDevice(vrinputemulator::VirtualDeviceType::TrackedController, serial.c_str(), true);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_DeviceClass_Int32, (int32_t)vr::TrackedDeviceClass_Controller);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_SupportedButtons_Uint64, (uint64_t)
+				vrinputemulator::DevicePropertyList properties;
+				properties.set(vr::Prop_DeviceClass_Int32, (int32_t)vr::TrackedDeviceClass_Controller);
+				properties.set(vr::Prop_SupportedButtons_Uint64, (uint64_t)
 					vr::ButtonMaskFromId(vr::k_EButton_System) |
 					vr::ButtonMaskFromId(vr::k_EButton_ApplicationMenu) |
 					vr::ButtonMaskFromId(vr::k_EButton_Grip) |
 					vr::ButtonMaskFromId(vr::k_EButton_Axis0) |
 					vr::ButtonMaskFromId(vr::k_EButton_Axis1)
 				);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_Axis0Type_Int32, (int32_t)vr::k_eControllerAxis_Joystick);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_Axis1Type_Int32, (int32_t)vr::k_eControllerAxis_Trigger);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_HardwareRevision_Uint64, (uint64_t)666);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_FirmwareVersion_Uint64, (uint64_t)666);
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_RenderModelName_String, std::string("vr_controller_vive_1_5"));
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_ManufacturerName_String, std::string("Leap Motion"));
-				inputEmulator->setVirtualDeviceProperty(virtualId, vr::Prop_ModelNumber_String, std::string("Leap Motion Controller"));
+				properties.set(vr::Prop_Axis0Type_Int32, (int32_t)vr::k_eControllerAxis_Joystick);
+				properties.set(vr::Prop_Axis1Type_Int32, (int32_t)vr::k_eControllerAxis_Trigger);
+				properties.set(vr::Prop_HardwareRevision_Uint64, (uint64_t)666);
+				properties.set(vr::Prop_FirmwareVersion_Uint64, (uint64_t)666);
+				properties.set(vr::Prop_RenderModelName_String, std::string("vr_controller_vive_1_5"));
+				properties.set(vr::Prop_ManufacturerName_String, std::string("Leap Motion"));
+				properties.set(vr::Prop_ModelNumber_String, std::string("Leap Motion Controller"));
+				inputEmulator->setVirtualDeviceProperties(virtualId, properties);
 				inputEmulator->publishVirtualDevice(virtualId);
 
 				readyFlag = true;
 			}
 
 			inputEmulator->setVirtualDevicePose(virtualId, pose);
-			inputEmulator->setVirtualControllerState(virtualId, state);
+			inputEmulator->setVirtualControllerState(virtualId, state, false);
 		};
 
 		for (auto& h : frame0.hands()) {
@@ -27,6 +27,14 @@ void DeviceManipulationTabController::initStage2(OverlayController * parent, QQu
 	this->widget = widget;
 	try {
 		vrInputEmulator.connect();
+		try {
+			vrInputEmulator.subscribe((uint32_t)vrinputemulator::DeviceNotificationClass::DeviceInfo, [this](const vrinputemulator::DeviceNotification&) {
+				deviceInfoNotified = true;
+			});
+			deviceNotificationsEnabled = true;
+		} catch (std::exception& e) {
+			LOG(ERROR) << "Could not subscribe to device notifications, falling back to polling: " << e.what();
+		}
 		for (uint32_t id = 0; id < vr::k_unMaxTrackedDeviceCount; ++id) {
 			auto deviceClass = vr::VRSystem()->GetTrackedDeviceClass(id);
 			if (deviceClass != vr::TrackedDeviceClass_Invalid) {
@@ -70,12 +78,32 @@ void DeviceManipulationTabController::initStage2(OverlayController * parent, QQu
 
 
 void DeviceManipulationTabController::eventLoopTick(vr::TrackedDevicePose_t* devicePoses) {
-	if (settingsUpdateCounter >= 50) {
+	// Driver side changes are pushed, so they are picked up with the next tick
+	if (settingsUpdateCounter >= 50 || (deviceNotificationsEnabled && deviceInfoNotified)) {
 		settingsUpdateCounter = 0;
 		if (parent->isDashboardVisible() || parent->isDesktopMode()) {
+			// One request for all devices, which is answered with an empty reply when nothing changed
+			std::vector<vrinputemulator::DeviceInfo> driverInfos;
+			bool driverInfosChanged = false;
+			if (!deviceNotificationsEnabled || deviceInfoNotified.exchange(false)) {
+				try {
+					driverInfosChanged = vrInputEmulator.getAllDeviceInfo(driverInfos, deviceInfoSequence);
+				} catch (std::exception& e) {
+					LOG(ERROR) << "Exception caught while getting device infos: " << e.what();
+				}
+			}
+			const vrinputemulator::DeviceInfo* driverInfoMap[vr::k_unMaxTrackedDeviceCount] = {};
+			for (auto& d : driverInfos) {
+				if (d.deviceId < vr::k_unMaxTrackedDeviceCount) {
+					driverInfoMap[d.deviceId] = &d;
+				}
+			}
 			unsigned i = 0;
 			for (auto info : deviceInfos) {
-				bool hasDeviceInfoChanged = updateDeviceInfo(i);
+				bool hasDeviceInfoChanged = false;
+				if (driverInfoMap[info->openvrId]) {
+					hasDeviceInfoChanged = applyDeviceInfo(*info, *driverInfoMap[info->openvrId]);
+				}
 				unsigned status = devicePoses[info->openvrId].bDeviceIsConnected ? 0 : 1;
 				if (info->deviceMode == 0 && info->deviceStatus != status) {
 					info->deviceStatus = status;
@@ -88,40 +116,35 @@ void DeviceManipulationTabController::eventLoopTick(vr::TrackedDevicePose_t* dev
 			}
 			bool newDeviceAdded = false;
 			for (uint32_t id = maxValidDeviceId + 1; id < vr::k_unMaxTrackedDeviceCount; ++id) {
+				if (!driverInfoMap[id]) {
+					continue;
+				}
 				auto deviceClass = vr::VRSystem()->GetTrackedDeviceClass(id);
-				if (deviceClass != vr::TrackedDeviceClass_Invalid) {
-					if (deviceClass == vr::TrackedDeviceClass_Controller || deviceClass == vr::TrackedDeviceClass_GenericTracker) {
-						auto info = std::make_shared<DeviceInfo>();
-						info->openvrId = id;
-						info->deviceClass = deviceClass;
-						char buffer[vr::k_unMaxPropertyStringSize];
-						vr::ETrackedPropertyError pError = vr::TrackedProp_Success;
-						vr::VRSystem()->GetStringTrackedDeviceProperty(id, vr::Prop_SerialNumber_String, buffer, vr::k_unMaxPropertyStringSize, &pError);
-						if (pError == vr::TrackedProp_Success) {
-							info->serial = std::string(buffer);
-						} else {
-							info->serial = std::string("<unknown serial>");
-							LOG(ERROR) << "Could not get serial of device " << id;
-						}
-
-						try {
-							vrinputemulator::DeviceInfo info2;
-							vrInputEmulator.getDeviceInfo(info->openvrId, info2);
-							info->deviceMode = info2.deviceMode;
-							info->deviceOffsetsEnabled = info2.offsetsEnabled;
-							if (info->deviceMode == 2 || info->deviceMode == 3) {
-								info->deviceStatus = info2.redirectSuspended ? 1 : 0;
-							}
-						} catch (std::exception& e) {
-							LOG(ERROR) << "Exception caught while getting device info: " << e.what();
-						}
-
-						deviceInfos.push_back(info);
-						LOG(INFO) << "Found device: id " << info->openvrId << ", class " << info->deviceClass << ", serial " << info->serial;
-						newDeviceAdded = true;
+				if (deviceClass == vr::TrackedDeviceClass_Invalid) {
+					// The driver knows the device before OpenVR publishes it, ask again with the next update
+					deviceInfoSequence = 0;
+					deviceInfoNotified = true;
+					break;
+				}
+				if (deviceClass == vr::TrackedDeviceClass_Controller || deviceClass == vr::TrackedDeviceClass_GenericTracker) {
+					auto info = std::make_shared<DeviceInfo>();
+					info->openvrId = id;
+					info->deviceClass = deviceClass;
+					char buffer[vr::k_unMaxPropertyStringSize];
+					vr::ETrackedPropertyError pError = vr::TrackedProp_Success;
+					vr::VRSystem()->GetStringTrackedDeviceProperty(id, vr::Prop_SerialNumber_String, buffer, vr::k_unMaxPropertyStringSize, &pError);
+					if (pError == vr::TrackedProp_Success) {
+						info->serial = std::string(buffer);
+					} else {
+						info->serial = std::string("<unknown serial>");
+						LOG(ERROR) << "Could not get serial of device " << id;
 					}
-					maxValidDeviceId = id;
+					applyDeviceInfo(*info, *driverInfoMap[id]);
+					deviceInfos.push_back(info);
+					LOG(INFO) << "Found device: id " << info->openvrId << ", class " << info->deviceClass << ", serial " << info->serial;
+					newDeviceAdded = true;
 				}
+				maxValidDeviceId = id;
 			}
 			if (newDeviceAdded) {
 				emit deviceCountChanged((unsigned)deviceInfos.size());
@@ -431,13 +454,34 @@ void DeviceManipulationTabController::applyDeviceManipulationProfile(unsigned in
 		auto device = deviceInfos[deviceIndex];
 		auto& profile = deviceManipulationProfiles[index];
 		if (profile.includesDeviceOffsets) {
-			setWorldFromDriverRotationOffset(deviceIndex, profile.worldFromDriverRotationOffset.v[0], profile.worldFromDriverRotationOffset.v[1], profile.worldFromDriverRotationOffset.v[2], false);
-			setWorldFromDriverTranslationOffset(deviceIndex, profile.worldFromDriverTranslationOffset.v[0], profile.worldFromDriverTranslationOffset.v[1], profile.worldFromDriverTranslationOffset.v[2], false);
-			setDriverFromHeadRotationOffset(deviceIndex, profile.driverFromHeadRotationOffset.v[0], profile.driverFromHeadRotationOffset.v[1], profile.driverFromHeadRotationOffset.v[2], false);
-			setDriverFromHeadTranslationOffset(deviceIndex, profile.driverFromHeadTranslationOffset.v[0], profile.driverFromHeadTranslationOffset.v[1], profile.driverFromHeadTranslationOffset.v[2], false);
-			setDriverRotationOffset(deviceIndex, profile.driverRotationOffset.v[0], profile.driverRotationOffset.v[1], profile.driverRotationOffset.v[2], false);
-			setDriverTranslationOffset(deviceIndex, profile.driverTranslationOffset.v[0], profile.driverTranslationOffset.v[1], profile.driverTranslationOffset.v[2], false);
-			enableDeviceOffsets(deviceIndex, profile.deviceOffsetsEnabled, false);
+			auto toQuaternion = [](const vr::HmdVector3d_t& yawPitchRoll) {
+				return vrmath::quaternionFromYawPitchRoll(yawPitchRoll.v[0] * 0.01745329252, yawPitchRoll.v[1] * 0.01745329252, yawPitchRoll.v[2] * 0.01745329252);
+			};
+			auto toMeters = [](const vr::HmdVector3d_t& cm) {
+				return vr::HmdVector3d_t{ cm.v[0] * 0.01, cm.v[1] * 0.01, cm.v[2] * 0.01 };
+			};
+			// One request, so the device never shows a pose with only some of the profile's offsets applied
+			vrinputemulator::DeviceOffsets offsets;
+			offsets.deviceId = device->openvrId;
+			offsets.offsetsEnabled = profile.deviceOffsetsEnabled;
+			offsets.worldFromDriverRotationOffset = toQuaternion(profile.worldFromDriverRotationOffset);
+			offsets.worldFromDriverTranslationOffset = toMeters(profile.worldFromDriverTranslationOffset);
+			offsets.driverFromHeadRotationOffset = toQuaternion(profile.driverFromHeadRotationOffset);
+			offsets.driverFromHeadTranslationOffset = toMeters(profile.driverFromHeadTranslationOffset);
+			offsets.deviceRotationOffset = toQuaternion(profile.driverRotationOffset);
+			offsets.deviceTranslationOffset = toMeters(profile.driverTranslationOffset);
+			try {
+				vrInputEmulator.setDeviceOffsets(offsets);
+				device->deviceOffsetsEnabled = profile.deviceOffsetsEnabled;
+				device->worldFromDriverRotationOffset = profile.worldFromDriverRotationOffset;
+				device->worldFromDriverTranslationOffset = profile.worldFromDriverTranslationOffset;
+				device->driverFromHeadRotationOffset = profile.driverFromHeadRotationOffset;
+				device->driverFromHeadTranslationOffset = profile.driverFromHeadTranslationOffset;
+				device->deviceRotationOffset = profile.driverRotationOffset;
+				device->deviceTranslationOffset = profile.driverTranslationOffset;
+			} catch (const std::exception& e) {
+				LOG(ERROR) << "Exception caught while applying device offsets: " << e.what();
+			}
 			updateDeviceInfo(deviceIndex);
 			emit deviceInfoChanged(deviceIndex);
 		}
@@ -624,21 +668,7 @@ bool DeviceManipulationTabController::updateDeviceInfo(unsigned index) {
 		try {
 			vrinputemulator::DeviceInfo info;
 			vrInputEmulator.getDeviceInfo(deviceInfos[index]->openvrId, info);
-			if (deviceInfos[index]->deviceMode != info.deviceMode) {
-				deviceInfos[index]->deviceMode = info.deviceMode;
-				retval = true;
-			}
-			if (deviceInfos[index]->deviceOffsetsEnabled != info.offsetsEnabled) {
-				deviceInfos[index]->deviceOffsetsEnabled = info.offsetsEnabled;
-				retval = true;
-			}
-			if (deviceInfos[index]->deviceMode == 2 || deviceInfos[index]->deviceMode == 3) {
-				auto status = info.redirectSuspended ? 1 : 0;
-				if (deviceInfos[index]->deviceStatus != status) {
-					deviceInfos[index]->deviceStatus = status;
-					retval = true;
-				}
-			}
+			retval = applyDeviceInfo(*deviceInfos[index], info);
 		} catch (std::exception& e) {
 			LOG(ERROR) << "Exception caught while getting device info: " << e.what();
 		}
@@ -646,6 +676,26 @@ bool DeviceManipulationTabController::updateDeviceInfo(unsigned index) {
 	return retval;
 }
 
+bool DeviceManipulationTabController::applyDeviceInfo(DeviceInfo& info, const vrinputemulator::DeviceInfo& driverInfo) {
+	bool retval = false;
+	if (info.deviceMode != driverInfo.deviceMode) {
+		info.deviceMode = driverInfo.deviceMode;
+		retval = true;
+	}
+	if (info.deviceOffsetsEnabled != driverInfo.offsetsEnabled) {
+		info.deviceOffsetsEnabled = driverInfo.offsetsEnabled;
+		retval = true;
+	}
+	if (info.deviceMode == 2 || info.deviceMode == 3) {
+		auto status = driverInfo.redirectSuspended ? 1 : 0;
+		if (info.deviceStatus != status) {
+			info.deviceStatus = status;
+			retval = true;
+		}
+	}
+	return retval;
+}
+
 void DeviceManipulationTabController::triggerHapticPulse(unsigned index) {
 	try {
 		// When I use a thread everything works in debug modus, but as soon as I switch to release mode I get a segmentation fault
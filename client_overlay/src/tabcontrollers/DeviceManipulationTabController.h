@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include <memory>
+#include <atomic>
 #include <openvr.h>
 #include <vrinputemulator.h>
 
@@ -58,6 +59,7 @@ class DeviceManipulationTabController : public QObject {
 private:
 	OverlayController* parent;
 	QQuickWindow* widget;
+	std::atomic<bool> deviceInfoNotified{ true }; // set by the notification handler, must outlive vrInputEmulator's ipc thread
 	vrinputemulator::VRInputEmulator vrInputEmulator;
 
 	std::vector<std::shared_ptr<DeviceInfo>> deviceInfos;
@@ -70,9 +72,14 @@ private:
 	vr::HmdVector3d_t motionCompensationTmpCenter = { 0.0, 0.0, 0.0 };
 
 	unsigned settingsUpdateCounter = 0;
+	uint32_t deviceInfoSequence = 0; // of the last device info update from the driver, 0 .. none
+	bool deviceNotificationsEnabled = false; // otherwise the driver is polled
 
 	std::thread identifyThread;
 
+	// Returns true when something visible changed
+	bool applyDeviceInfo(DeviceInfo& info, const vrinputemulator::DeviceInfo& driverInfo);
+
 public:
 	~DeviceManipulationTabController();
 	void initStage1();
@@ -2,7 +2,9 @@
 #include "../../stdafx.h"
 #include "../../driver_vrinputemulator.h"
 #include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <intrin.h>
 #include <ipc_protocol.h>
+#include <ipc_shared_state.h>
 #include <openvr_math.h>
 
 namespace vrinputemulator {
@@ -11,6 +13,7 @@ namespace driver {
 
 void IpcShmCommunicator::init(CServerDriver* driver) {
 	_driver = driver;
+	_createSharedState();
 	_ipcThreadStopFlag = false;
 	_ipcThread = std::thread(_ipcThreadFunc, this, driver);
 }
@@ -20,6 +23,102 @@ void IpcShmCommunicator::shutdown() {
 		_ipcThreadStopFlag = true;
 		_ipcThread.join();
 	}
+	if (_sharedState) {
+		boost::interprocess::shared_memory_object::remove(IPC_SHAREDSTATE_NAME);
+	}
+}
+
+void IpcShmCommunicator::_createSharedState() {
+	try {
+		boost::interprocess::shared_memory_object::remove(IPC_SHAREDSTATE_NAME);
+		_sharedStateMemory = std::make_shared<boost::interprocess::shared_memory_object>(
+			boost::interprocess::create_only, IPC_SHAREDSTATE_NAME, boost::interprocess::read_write);
+		_sharedStateMemory->truncate(sizeof(ipc::SharedState));
+		_sharedStateRegion = std::make_shared<boost::interprocess::mapped_region>(*_sharedStateMemory, boost::interprocess::read_write);
+		auto state = new (_sharedStateRegion->get_address()) ipc::SharedState();
+		state->protocolVersion = IPC_PROTOCOL_VERSION;
+		_sharedState = state;
+	} catch (std::exception& e) {
+		LOG(ERROR) << "Could not create shared state segment, clients have to use ipc requests: " << e.what();
+		_sharedStateRegion.reset();
+		_sharedStateMemory.reset();
+	}
+}
+
+void IpcShmCommunicator::notify(DeviceNotificationClass notificationClass, const DeviceNotification& notification) {
+	std::lock_guard<std::mutex> lock(_subscribersMutex);
+	if (_subscribers.empty()) {
+		return;
+	}
+	ipc::Reply reply(ipc::ReplyType::Notification);
+	reply.messageId = 0;
+	reply.status = ipc::ReplyStatus::Ok;
+	reply.msg.notification = notification;
+	for (auto& s : _subscribers) {
+		if (s.notificationClasses & (uint32_t)notificationClass) {
+			try {
+				if (!s.queue->try_send(&reply, sizeof(ipc::Reply), 0)) {
+					LOG(DEBUG) << "Dropped notification for client " << s.clientId << ": queue is full";
+				}
+			} catch (std::exception& e) {
+				LOG(ERROR) << "Error while sending notification to client " << s.clientId << ": " << e.what();
+			}
+		}
+	}
+}
+
+void IpcShmCommunicator::_setSubscription(uint32_t clientId, uint32_t notificationClasses, const std::shared_ptr<boost::interprocess::message_queue>& queue) {
+	std::lock_guard<std::mutex> lock(_subscribersMutex);
+	for (auto i = _subscribers.begin(); i != _subscribers.end(); ++i) {
+		if (i->clientId == clientId) {
+			if (notificationClasses) {
+				i->notificationClasses = notificationClasses;
+			} else {
+				_subscribers.erase(i);
+			}
+			return;
+		}
+	}
+	if (notificationClasses) {
+		_subscribers.push_back({ clientId, notificationClasses, queue });
+	}
+}
+
+void IpcShmCommunicator::_addRequestQueue(uint32_t clientId, char* nameBuffer, size_t nameBufferSize) {
+	nameBuffer[0] = '\0';
+	auto name = _ipcQueueName + ".client" + std::to_string(clientId);
+	try {
+		if (_ipcRequestQueues->add(clientId, name)) {
+			strncpy_s(nameBuffer, nameBufferSize, name.c_str(), nameBufferSize - 1);
+		}
+	} catch (std::exception& e) {
+		LOG(ERROR) << "Could not create request queue for client " << clientId << ", it has to use the server queue: " << e.what();
+	}
+}
+
+bool IpcShmCommunicator::_sendReply(uint32_t clientId, const ipc::Reply& reply, size_t replySize) {
+	auto i = _ipcEndpoints.find(clientId);
+	if (i == _ipcEndpoints.end()) {
+		return false;
+	}
+	bool sent = false;
+	try {
+		sent = ipcTimedSend(*i->second, &reply, replySize, _ipcReplyTimeoutMs);
+	} catch (std::exception& e) {
+		LOG(ERROR) << "Error while sending reply to client " << clientId << ": " << e.what();
+	}
+	if (!sent) {
+		LOG(ERROR) << "Dropping client " << clientId << ": it does not read its replies";
+		_dropClient(clientId);
+	}
+	return sent;
+}
+
+void IpcShmCommunicator::_dropClient(uint32_t clientId) {
+	_ipcEndpoints.erase(clientId);
+	_ipcPropertyBatches.erase(clientId);
+	_setSubscription(clientId, 0, nullptr);
+	_ipcRequestQueues->remove(clientId);
 }
 
 void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver * driver) {
@@ -34,16 +133,22 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 			100,					//max message number
 			sizeof(ipc::Request)    //max message size
 			);
+		_this->_ipcRequestQueues = std::make_unique<IpcRequestQueues>(messageQueue, 100, sizeof(ipc::Request));
+		try {
+			_this->_ipcRequestQueues->open(_this->_ipcQueueName + ".doorbell");
+		} catch (std::exception& e) {
+			LOG(ERROR) << "Could not create request doorbell, all clients have to use the server queue: " << e.what();
+		}
 
 		while (!_this->_ipcThreadStopFlag) {
 			try {
 				ipc::Request message;
 				uint64_t recv_size;
-				unsigned priority;
-				boost::posix_time::ptime timeout = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(50);
-				if (messageQueue.timed_receive(&message, sizeof(ipc::Request), recv_size, priority, timeout)) {
+				if (_this->_ipcRequestQueues->receive(&message, sizeof(ipc::Request), recv_size, 50)) {
 					LOG(TRACE) << "CServerDriver::_ipcThreadFunc: IPC request received ( type " << (int)message.type << ")";
-					if (recv_size == sizeof(ipc::Request)) {
+					// Controller state deltas are the only messages that are allowed to be sent truncated
+					if (recv_size == sizeof(ipc::Request) || (recv_size >= ipc::Request::controllerStateDeltaSize(0)
+							&& recv_size < sizeof(ipc::Request) && message.type == ipc::RequestType::VirtualDevices_SetControllerStateDelta)) {
 						switch (message.type) {
 
 						case ipc::RequestType::IPC_ClientConnect:
@@ -57,15 +162,21 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 										auto clientId = _this->_ipcClientIdNext++;
 										_this->_ipcEndpoints.insert({ clientId, queue });
 										reply.msg.ipc_ClientConnect.clientId = clientId;
+										_this->_addRequestQueue(clientId, reply.msg.ipc_ClientConnect.requestQueueName, sizeof(reply.msg.ipc_ClientConnect.requestQueueName));
 										reply.status = ipc::ReplyStatus::Ok;
 										LOG(INFO) << "New client connected: endpoint \"" << message.msg.ipc_ClientConnect.queueName << "\", cliendId " << clientId;
 									} else {
 										reply.msg.ipc_ClientConnect.clientId = 0;
+										reply.msg.ipc_ClientConnect.requestQueueName[0] = '\0';
 										reply.status = ipc::ReplyStatus::InvalidVersion;
 										LOG(INFO) << "Client (endpoint \"" << message.msg.ipc_ClientConnect.queueName << "\") reports incompatible ipc version "
 											<< message.msg.ipc_ClientConnect.ipcProcotolVersion;
 									}
-									queue->send(&reply, sizeof(ipc::Reply), 0);
+									if (reply.msg.ipc_ClientConnect.clientId != 0) {
+										_this->_sendReply(reply.msg.ipc_ClientConnect.clientId, reply);
+									} else if (!ipcTimedSend(*queue, &reply, sizeof(ipc::Reply), _ipcReplyTimeoutMs)) {
+										LOG(ERROR) << "Could not send connect reply to endpoint \"" << message.msg.ipc_ClientConnect.queueName << "\": queue is full";
+									}
 								} catch (std::exception& e) {
 									LOG(ERROR) << "Error during client connect: " << e.what();
 								}
@@ -80,10 +191,10 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (i != _this->_ipcEndpoints.end()) {
 									reply.status = ipc::ReplyStatus::Ok;
 									auto msgQueue = i->second;
-									_this->_ipcEndpoints.erase(i);
+									_this->_dropClient(message.msg.ipc_ClientDisconnect.clientId);
 									LOG(INFO) << "Client disconnected: clientId " << message.msg.ipc_ClientDisconnect.clientId;
 									if (reply.messageId != 0) {
-										msgQueue->send(&reply, sizeof(ipc::Reply), 0);
+										ipcTimedSend(*msgQueue, &reply, sizeof(ipc::Reply), _ipcReplyTimeoutMs);
 									}
 								} else {
 									LOG(ERROR) << "Error during client disconnect: unknown clientID " << message.msg.ipc_ClientDisconnect.clientId;
@@ -93,6 +204,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 
 						case ipc::RequestType::IPC_Ping:
 							{
+								auto receiveTimestamp = ipc::timestampNow();
 								LOG(TRACE) << "Ping received: clientId " << message.msg.ipc_Ping.clientId << ", nonce " << message.msg.ipc_Ping.nonce;
 								auto i = _this->_ipcEndpoints.find(message.msg.ipc_Ping.clientId);
 								if (i != _this->_ipcEndpoints.end()) {
@@ -100,8 +212,9 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 									reply.messageId = message.msg.ipc_Ping.messageId;
 									reply.status = ipc::ReplyStatus::Ok;
 									reply.msg.ipc_Ping.nonce = message.msg.ipc_Ping.nonce;
+									reply.msg.ipc_Ping.receiveTimestamp = receiveTimestamp;
 									if (reply.messageId != 0) {
-										i->second->send(&reply, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, reply);
 									}
 								} else {
 									LOG(ERROR) << "Error during ping: unknown clientID " << message.msg.ipc_ClientDisconnect.clientId;
@@ -109,6 +222,24 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							}
 							break;
 
+						case ipc::RequestType::IPC_Subscribe:
+							{
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.ipc_Subscribe.messageId;
+								auto i = _this->_ipcEndpoints.find(message.msg.ipc_Subscribe.clientId);
+								if (i != _this->_ipcEndpoints.end()) {
+									_this->_setSubscription(message.msg.ipc_Subscribe.clientId, message.msg.ipc_Subscribe.notificationClasses, i->second);
+									LOG(INFO) << "Client " << message.msg.ipc_Subscribe.clientId << " subscribed to notification classes " << message.msg.ipc_Subscribe.notificationClasses;
+									resp.status = ipc::ReplyStatus::Ok;
+									if (resp.messageId != 0) {
+										_this->_sendReply(i->first, resp);
+									}
+								} else {
+									LOG(ERROR) << "Error while subscribing to notifications: Unknown clientId " << message.msg.ipc_Subscribe.clientId;
+								}
+							}
+							break;
+
 						case ipc::RequestType::OpenVR_ButtonEvent:
 							{
 								if (vr::VRServerDriverHost()) {
@@ -128,7 +259,8 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 						case ipc::RequestType::OpenVR_AxisEvent:
 							{
 								if (vr::VRServerDriverHost()) {
-									for (unsigned i = 0; i < message.msg.ipc_AxisEvent.eventCount; ++i) {
+									unsigned iterCount = min(message.msg.ipc_AxisEvent.eventCount, REQUEST_OPENVR_AXISEVENT_MAXCOUNT);
+									for (unsigned i = 0; i < iterCount; ++i) {
 										auto& e = message.msg.ipc_AxisEvent.events[i];
 										driver->openvr_axisEvent(e.deviceId, e.axisId, e.axisState);
 									}
@@ -157,6 +289,23 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							}
 							break;
 
+						case ipc::RequestType::OpenVR_SetAxisEventCoalescing:
+							{
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.ovr_SetAxisEventCoalescing.messageId;
+								driver->openvr_setAxisEventCoalescing(message.msg.ovr_SetAxisEventCoalescing.enable, message.msg.ovr_SetAxisEventCoalescing.flushIntervalMs);
+								resp.status = ipc::ReplyStatus::Ok;
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.ovr_SetAxisEventCoalescing.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp);
+									} else {
+										LOG(ERROR) << "Error while setting axis event coalescing: Unknown clientId " << message.msg.ovr_SetAxisEventCoalescing.clientId;
+									}
+								}
+							}
+							break;
+
 						case ipc::RequestType::VirtualDevices_GetDeviceCount:
 							{
 								auto i = _this->_ipcEndpoints.find(message.msg.vd_GenericClientMessage.clientId);
@@ -165,7 +314,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 									resp.messageId = message.msg.vd_GenericClientMessage.messageId;
 									resp.status = ipc::ReplyStatus::Ok;
 									resp.msg.vd_GetDeviceCount.deviceCount = driver->virtualDevices_getDeviceCount();
-									i->second->send(&resp, sizeof(ipc::Reply), 0);
+									_this->_sendReply(i->first, resp);
 								} else {
 									LOG(ERROR) << "Error while getting virtual device count: Unknown clientId " << message.msg.vd_AddDevice.clientId;
 								}
@@ -194,7 +343,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 											resp.status = ipc::ReplyStatus::Ok;
 										}
 									}
-									i->second->send(&resp, sizeof(ipc::Reply), 0);
+									_this->_sendReply(i->first, resp);
 								} else {
 									LOG(ERROR) << "Error while getting virtual device info: Unknown clientId " << message.msg.vd_AddDevice.clientId;
 								}
@@ -219,7 +368,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 											resp.status = ipc::ReplyStatus::Ok;
 										}
 									}
-									i->second->send(&resp, sizeof(ipc::Reply), 0);
+									_this->_sendReply(i->first, resp);
 								} else {
 									LOG(ERROR) << "Error while getting virtual device pose: Unknown clientId " << message.msg.vd_AddDevice.clientId;
 								}
@@ -248,7 +397,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 											}
 										}
 									}
-									i->second->send(&resp, sizeof(ipc::Reply), 0);
+									_this->_sendReply(i->first, resp);
 								} else {
 									LOG(ERROR) << "Error while getting virtual controller state: Unknown clientId " << message.msg.vd_AddDevice.clientId;
 								}
@@ -281,7 +430,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 										LOG(ERROR) << "Error while adding virtual device: Error code " << (int)resp.status;
 									}
 									if (resp.messageId != 0) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									}
 								} else {
 									LOG(ERROR) << "Error while adding virtual device: Unknown clientId " << message.msg.vd_AddDevice.clientId;
@@ -313,7 +462,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.vd_GenericDeviceIdMessage.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while publishing virtual device: Unknown clientId " << message.msg.vd_GenericDeviceIdMessage.clientId;
 									}
@@ -391,7 +540,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.vd_SetDeviceProperty.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while setting device property: Unknown clientId " << message.msg.vd_SetDeviceProperty.clientId;
 									}
@@ -422,7 +571,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.vd_RemoveDeviceProperty.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while removing device property: Unknown clientId " << message.msg.vd_RemoveDeviceProperty.clientId;
 									}
@@ -441,11 +590,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 									if (!device) {
 										resp.status = ipc::ReplyStatus::NotFound;
 									} else {
-										auto now = std::chrono::duration_cast <std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-										auto diff = 0.0;
-										if (message.timestamp < now) {
-											diff = ((double)now - message.timestamp) / 1000.0;
-										}
+										auto diff = ipc::timestampAge(message.timestamp);
 										device->updatePose(message.msg.vd_SetDevicePose.pose, -diff);
 										resp.status = ipc::ReplyStatus::Ok;
 									}
@@ -456,7 +601,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.vd_SetDevicePose.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while updating device pose: Unknown clientId " << message.msg.vd_SetDevicePose.clientId;
 									}
@@ -464,6 +609,64 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							}
 							break;
 
+						case ipc::RequestType::VirtualDevices_SetPoseExtrapolation:
+							{
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.vd_SetPoseExtrapolation.messageId;
+								if (message.msg.vd_SetPoseExtrapolation.virtualDeviceId >= driver->virtualDevices_getDeviceCount()) {
+									resp.status = ipc::ReplyStatus::InvalidId;
+								} else {
+									auto device = driver->virtualDevices_getDevice(message.msg.vd_SetPoseExtrapolation.virtualDeviceId);
+									if (!device) {
+										resp.status = ipc::ReplyStatus::NotFound;
+									} else {
+										device->setPoseExtrapolationHorizon(message.msg.vd_SetPoseExtrapolation.horizon);
+										resp.status = ipc::ReplyStatus::Ok;
+									}
+								}
+								if (resp.status != ipc::ReplyStatus::Ok) {
+									LOG(ERROR) << "Error while setting pose extrapolation: Error code " << (int)resp.status;
+								}
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.vd_SetPoseExtrapolation.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp);
+									} else {
+										LOG(ERROR) << "Error while setting pose extrapolation: Unknown clientId " << message.msg.vd_SetPoseExtrapolation.clientId;
+									}
+								}
+							}
+							break;
+
+						case ipc::RequestType::VirtualDevices_SetPoseResampling:
+							{
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.vd_SetPoseResampling.messageId;
+								if (message.msg.vd_SetPoseResampling.virtualDeviceId >= driver->virtualDevices_getDeviceCount()) {
+									resp.status = ipc::ReplyStatus::InvalidId;
+								} else {
+									auto device = driver->virtualDevices_getDevice(message.msg.vd_SetPoseResampling.virtualDeviceId);
+									if (!device) {
+										resp.status = ipc::ReplyStatus::NotFound;
+									} else {
+										device->setPoseResampling(message.msg.vd_SetPoseResampling.delay, message.msg.vd_SetPoseResampling.outputRate);
+										resp.status = ipc::ReplyStatus::Ok;
+									}
+								}
+								if (resp.status != ipc::ReplyStatus::Ok) {
+									LOG(ERROR) << "Error while setting pose resampling: Error code " << (int)resp.status;
+								}
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.vd_SetPoseResampling.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp);
+									} else {
+										LOG(ERROR) << "Error while setting pose resampling: Unknown clientId " << message.msg.vd_SetPoseResampling.clientId;
+									}
+								}
+							}
+							break;
+
 						case ipc::RequestType::VirtualDevices_SetControllerState:
 							{
 								ipc::Reply resp(ipc::ReplyType::GenericReply);
@@ -478,11 +681,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 										resp.status = ipc::ReplyStatus::Ok;
 										if (device->deviceType() == VirtualDeviceType::TrackedController) {
 											auto controller = (CTrackedControllerDriver*)device;
-											auto now = std::chrono::duration_cast <std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-											auto diff = 0.0;
-											if (message.timestamp < now) {
-												diff = ((double)now - message.timestamp) / 1000.0;
-											}
+											auto diff = ipc::timestampAge(message.timestamp);
 											controller->updateControllerState(message.msg.vd_SetControllerState.controllerState, -diff);
 										} else {
 											resp.status = ipc::ReplyStatus::InvalidType;
@@ -495,7 +694,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.vd_SetControllerState.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while updating controller state: Unknown clientId " << message.msg.vd_SetControllerState.clientId;
 									}
@@ -503,6 +702,217 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							}
 							break;
 
+						case ipc::RequestType::VirtualDevices_SetDeviceProperties:
+							{
+								auto& batch = _this->_ipcPropertyBatches[message.msg.vd_SetDeviceProperties.clientId];
+								if (batch.virtualDeviceId != message.msg.vd_SetDeviceProperties.virtualDeviceId) {
+									if (!batch.data.empty() || batch.overflow) {
+										LOG(ERROR) << "Discarding incomplete device property batch for virtual device " << batch.virtualDeviceId;
+									}
+									batch.virtualDeviceId = message.msg.vd_SetDeviceProperties.virtualDeviceId;
+									batch.data.clear();
+									batch.entryCount = 0;
+									batch.overflow = false;
+								}
+								auto dataSize = min(message.msg.vd_SetDeviceProperties.dataSize, REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_DATASIZE);
+								if (!batch.overflow) {
+									if (batch.data.size() + dataSize > REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_MAXBATCHSIZE
+											|| batch.entryCount + message.msg.vd_SetDeviceProperties.entryCount > REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_MAXENTRIES) {
+										// Don't let a client that never commits grow the staged data without bound
+										LOG(ERROR) << "Device property batch for virtual device " << batch.virtualDeviceId << " exceeds the batch limits";
+										std::vector<uint8_t>().swap(batch.data);
+										batch.entryCount = 0;
+										batch.overflow = true;
+									} else {
+										batch.data.insert(batch.data.end(), message.msg.vd_SetDeviceProperties.data, message.msg.vd_SetDeviceProperties.data + dataSize);
+										batch.entryCount += message.msg.vd_SetDeviceProperties.entryCount;
+									}
+								}
+								if (!message.msg.vd_SetDeviceProperties.commit) {
+									break; // Staged messages never get a reply
+								}
+								std::vector<uint8_t> data;
+								data.swap(batch.data);
+								auto entryCount = batch.entryCount;
+								auto overflow = batch.overflow;
+								_this->_ipcPropertyBatches.erase(message.msg.vd_SetDeviceProperties.clientId);
+
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.vd_SetDeviceProperties.messageId;
+								if (overflow) {
+									resp.status = ipc::ReplyStatus::InvalidOperation;
+								} else if (message.msg.vd_SetDeviceProperties.virtualDeviceId >= driver->virtualDevices_getDeviceCount()) {
+									resp.status = ipc::ReplyStatus::InvalidId;
+								} else {
+									auto device = driver->virtualDevices_getDevice(message.msg.vd_SetDeviceProperties.virtualDeviceId);
+									if (!device) {
+										resp.status = ipc::ReplyStatus::NotFound;
+									} else {
+										resp.status = ipc::ReplyStatus::Ok;
+										std::vector<CTrackedDeviceDriver::DevicePropertyUpdate> updates;
+										updates.reserve(entryCount);
+										size_t offset = 0;
+										for (uint32_t i = 0; i < entryCount && resp.status == ipc::ReplyStatus::Ok; ++i) {
+											ipc::Request_VirtualDevices_SetDeviceProperties_Entry entry;
+											if (offset + sizeof(entry) > data.size()) {
+												resp.status = ipc::ReplyStatus::InvalidOperation;
+												break;
+											}
+											memcpy(&entry, data.data() + offset, sizeof(entry));
+											offset += sizeof(entry);
+											if (offset + entry.valueSize > data.size()) {
+												resp.status = ipc::ReplyStatus::InvalidOperation;
+												break;
+											}
+											auto value = data.data() + offset;
+											offset += entry.valueSize;
+											CTrackedDeviceDriver::DevicePropertyUpdate update;
+											update.deviceProperty = entry.deviceProperty;
+											update.remove = entry.valueSize == 0;
+											if (!update.remove) {
+												switch (entry.valueType) {
+												case DevicePropertyValueType::BOOL:
+													if (entry.valueSize == sizeof(bool)) {
+														bool v;
+														memcpy(&v, value, sizeof(v));
+														update.value.set(v);
+													} else {
+														resp.status = ipc::ReplyStatus::InvalidType;
+													}
+													break;
+												case DevicePropertyValueType::FLOAT:
+													if (entry.valueSize == sizeof(float)) {
+														float v;
+														memcpy(&v, value, sizeof(v));
+														update.value.set(v);
+													} else {
+														resp.status = ipc::ReplyStatus::InvalidType;
+													}
+													break;
+												case DevicePropertyValueType::INT32:
+													if (entry.valueSize == sizeof(int32_t)) {
+														int32_t v;
+														memcpy(&v, value, sizeof(v));
+														update.value.set(v);
+													} else {
+														resp.status = ipc::ReplyStatus::InvalidType;
+													}
+													break;
+												case DevicePropertyValueType::UINT64:
+													if (entry.valueSize == sizeof(uint64_t)) {
+														uint64_t v;
+														memcpy(&v, value, sizeof(v));
+														update.value.set(v);
+													} else {
+														resp.status = ipc::ReplyStatus::InvalidType;
+													}
+													break;
+												case DevicePropertyValueType::MATRIX34:
+													if (entry.valueSize == sizeof(vr::HmdMatrix34_t)) {
+														vr::HmdMatrix34_t v;
+														memcpy(&v, value, sizeof(v));
+														update.value.set(v);
+													} else {
+														resp.status = ipc::ReplyStatus::InvalidType;
+													}
+													break;
+												case DevicePropertyValueType::MATRIX44:
+													if (entry.valueSize == sizeof(vr::HmdMatrix44_t)) {
+														vr::HmdMatrix44_t v;
+														memcpy(&v, value, sizeof(v));
+														update.value.set(v);
+													} else {
+														resp.status = ipc::ReplyStatus::InvalidType;
+													}
+													break;
+												case DevicePropertyValueType::VECTOR3:
+													if (entry.valueSize == sizeof(vr::HmdVector3_t)) {
+														vr::HmdVector3_t v;
+														memcpy(&v, value, sizeof(v));
+														update.value.set(v);
+													} else {
+														resp.status = ipc::ReplyStatus::InvalidType;
+													}
+													break;
+												case DevicePropertyValueType::VECTOR4:
+													if (entry.valueSize == sizeof(vr::HmdVector4_t)) {
+														vr::HmdVector4_t v;
+														memcpy(&v, value, sizeof(v));
+														update.value.set(v);
+													} else {
+														resp.status = ipc::ReplyStatus::InvalidType;
+													}
+													break;
+												case DevicePropertyValueType::STRING:
+													update.value.set((const char*)value, strnlen((const char*)value, entry.valueSize));
+													break;
+												default:
+													resp.status = ipc::ReplyStatus::InvalidType;
+													break;
+												}
+											}
+											updates.push_back(std::move(update));
+										}
+										// Either the whole batch is applied or nothing
+										if (resp.status == ipc::ReplyStatus::Ok) {
+											device->updateTrackedDeviceProperties(updates);
+										}
+									}
+								}
+								if (resp.status != ipc::ReplyStatus::Ok) {
+									LOG(ERROR) << "Error while setting device properties: Error code " << (int)resp.status;
+								}
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.vd_SetDeviceProperties.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp);
+									} else {
+										LOG(ERROR) << "Error while setting device properties: Unknown clientId " << message.msg.vd_SetDeviceProperties.clientId;
+									}
+								}
+							}
+							break;
+
+						case ipc::RequestType::VirtualDevices_SetControllerStateDelta:
+							{
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.vd_SetControllerStateDelta.messageId;
+								auto dirtyAxes = message.msg.vd_SetControllerStateDelta.dirtyAxes & ((1u << vr::k_unControllerStateAxisCount) - 1);
+								if (recv_size < ipc::Request::controllerStateDeltaSize(__popcnt(dirtyAxes))) {
+									resp.status = ipc::ReplyStatus::InvalidOperation;
+								} else if (message.msg.vd_SetControllerStateDelta.virtualDeviceId >= driver->virtualDevices_getDeviceCount()) {
+									resp.status = ipc::ReplyStatus::InvalidId;
+								} else {
+									auto device = driver->virtualDevices_getDevice(message.msg.vd_SetControllerStateDelta.virtualDeviceId);
+									if (!device) {
+										resp.status = ipc::ReplyStatus::NotFound;
+									} else {
+										resp.status = ipc::ReplyStatus::Ok;
+										if (device->deviceType() == VirtualDeviceType::TrackedController) {
+											auto controller = (CTrackedControllerDriver*)device;
+											auto diff = ipc::timestampAge(message.timestamp);
+											controller->updateControllerStateDelta(message.msg.vd_SetControllerStateDelta.packetNum,
+												message.msg.vd_SetControllerStateDelta.buttonPressed, message.msg.vd_SetControllerStateDelta.buttonTouched,
+												dirtyAxes, message.msg.vd_SetControllerStateDelta.axes, -diff);
+										} else {
+											resp.status = ipc::ReplyStatus::InvalidType;
+										}
+									}
+								}
+								if (resp.status != ipc::ReplyStatus::Ok) {
+									LOG(ERROR) << "Error while updating controller state: Error code " << (int)resp.status;
+								}
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.vd_SetControllerStateDelta.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp);
+									} else {
+										LOG(ERROR) << "Error while updating controller state: Unknown clientId " << message.msg.vd_SetControllerStateDelta.clientId;
+									}
+								}
+							}
+							break;
+
 						case ipc::RequestType::DeviceManipulation_GetDeviceInfo:
 							{
 								ipc::Reply resp(ipc::ReplyType::GenericReply);
@@ -521,6 +931,8 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 										resp.msg.dm_deviceInfo.offsetsEnabled = info->areOffsetsEnabled();
 										resp.msg.dm_deviceInfo.buttonMappingEnabled = info->buttonMappingEnabled();
 										resp.msg.dm_deviceInfo.redirectSuspended = info->redirectSuspended();
+										resp.msg.dm_deviceInfo.motionCompensationGroup = info->motionCompensationGroup();
+										resp.msg.dm_deviceInfo.refDeviceId = info->redirectRef() ? info->redirectRef()->openvrId() : vr::k_unTrackedDeviceIndexInvalid;
 									}
 								}
 								if (resp.status != ipc::ReplyStatus::Ok) {
@@ -529,13 +941,52 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.dm_ButtonMapping.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while updating device button mapping: Unknown clientId " << message.msg.dm_ButtonMapping.clientId;
 									}
 								}
 							}
 							break;
+
+						case ipc::RequestType::DeviceManipulation_GetAllDeviceInfo:
+							{
+								ipc::Reply resp(ipc::ReplyType::DeviceManipulation_GetAllDeviceInfo);
+								resp.messageId = message.msg.dm_GetAllDeviceInfo.messageId;
+								resp.status = ipc::ReplyStatus::Ok;
+								// Read the sequence first, a change while collecting is picked up by the next request
+								auto sequence = driver->deviceManipulation_getInfoSequence();
+								resp.msg.dm_allDeviceInfo.sequence = sequence;
+								resp.msg.dm_allDeviceInfo.deviceCount = 0;
+								resp.msg.dm_allDeviceInfo.unchanged = sequence == message.msg.dm_GetAllDeviceInfo.knownSequence;
+								if (!resp.msg.dm_allDeviceInfo.unchanged) {
+									for (uint32_t id = 0; id < vr::k_unMaxTrackedDeviceCount; ++id) {
+										OpenvrDeviceManipulationInfo* info = driver->deviceManipulation_getInfo(id);
+										if (info) {
+											auto& e = resp.msg.dm_allDeviceInfo.devices[resp.msg.dm_allDeviceInfo.deviceCount++];
+											e.deviceId = (uint8_t)id;
+											e.deviceClass = (uint8_t)info->deviceClass();
+											e.deviceMode = (uint8_t)info->deviceMode();
+											e.flags = (info->areOffsetsEnabled() ? ipc::DeviceInfoEntry_OffsetsEnabled : 0)
+												| (info->buttonMappingEnabled() ? ipc::DeviceInfoEntry_ButtonMappingEnabled : 0)
+												| (info->redirectSuspended() ? ipc::DeviceInfoEntry_RedirectSuspended : 0);
+											e.refDeviceId = info->redirectRef() ? (uint8_t)info->redirectRef()->openvrId() : DEVICEINFOENTRY_NOREFDEVICE;
+											auto group = info->motionCompensationGroup();
+											e.motionCompensationGroup = group != MOTIONCOMPENSATION_NOGROUP ? (uint8_t)group : DEVICEINFOENTRY_NOGROUP;
+											e.reserved[0] = e.reserved[1] = 0;
+										}
+									}
+								}
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.dm_GetAllDeviceInfo.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp, ipc::Reply::allDeviceInfoSize(resp.msg.dm_allDeviceInfo.deviceCount));
+									} else {
+										LOG(ERROR) << "Error while getting all device infos: Unknown clientId " << message.msg.dm_GetAllDeviceInfo.clientId;
+									}
+								}
+							}
+							break;
 							
 						case ipc::RequestType::DeviceManipulation_ButtonMapping:
 							{
@@ -580,7 +1031,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.dm_ButtonMapping.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while updating device button mapping: Unknown clientId " << message.msg.dm_ButtonMapping.clientId;
 									}
@@ -588,6 +1039,38 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							}
 							break;
 
+						case ipc::RequestType::DeviceManipulation_SetAxisTransform:
+							{
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.dm_SetAxisTransform.messageId;
+								auto& transform = message.msg.dm_SetAxisTransform.transform;
+								if (message.msg.dm_SetAxisTransform.deviceId >= vr::k_unMaxTrackedDeviceCount
+										|| transform.axisId >= vr::k_unControllerStateAxisCount
+										|| (transform.enabled && transform.remapAxisId >= vr::k_unControllerStateAxisCount && transform.remapAxisId != AXISTRANSFORM_NOREMAP)) {
+									resp.status = ipc::ReplyStatus::InvalidId;
+								} else {
+									OpenvrDeviceManipulationInfo* info = driver->deviceManipulation_getInfo(message.msg.dm_SetAxisTransform.deviceId);
+									if (!info) {
+										resp.status = ipc::ReplyStatus::NotFound;
+									} else {
+										info->setAxisTransform(transform);
+										resp.status = ipc::ReplyStatus::Ok;
+									}
+								}
+								if (resp.status != ipc::ReplyStatus::Ok) {
+									LOG(ERROR) << "Error while setting axis transform: Error code " << (int)resp.status;
+								}
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.dm_SetAxisTransform.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp);
+									} else {
+										LOG(ERROR) << "Error while setting axis transform: Unknown clientId " << message.msg.dm_SetAxisTransform.clientId;
+									}
+								}
+							}
+							break;
+
 						case ipc::RequestType::DeviceManipulation_GetDeviceOffsets:
 							{
 								ipc::Reply resp(ipc::ReplyType::DeviceManipulation_GetDeviceOffsets);
@@ -600,15 +1083,10 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 										resp.status = ipc::ReplyStatus::NotFound;
 									} else {
 										resp.status = ipc::ReplyStatus::Ok;
-										resp.msg.dm_deviceOffsets.deviceId = message.msg.vd_GenericDeviceIdMessage.deviceId;
-										resp.msg.dm_deviceOffsets.offsetsEnabled = info->areOffsetsEnabled();
-										resp.msg.dm_deviceOffsets.worldFromDriverRotationOffset = info->worldFromDriverRotationOffset();
-										resp.msg.dm_deviceOffsets.worldFromDriverTranslationOffset = info->worldFromDriverTranslationOffset();
-										resp.msg.dm_deviceOffsets.driverFromHeadRotationOffset = info->driverFromHeadRotationOffset();
-										resp.msg.dm_deviceOffsets.driverFromHeadTranslationOffset = info->driverFromHeadTranslationOffset();
-										resp.msg.dm_deviceOffsets.driverFromHeadTranslationOffset = info->driverFromHeadTranslationOffset();
-										resp.msg.dm_deviceOffsets.deviceRotationOffset = info->deviceRotationOffset();
-										resp.msg.dm_deviceOffsets.deviceTranslationOffset = info->deviceTranslationOffset();
+										DeviceOffsets offsets;
+										info->getOffsets(offsets);
+										offsets.deviceId = message.msg.vd_GenericDeviceIdMessage.deviceId;
+										memcpy(&resp.msg.dm_deviceOffsets, &offsets, sizeof(DeviceOffsets));
 									}
 								}
 								if (resp.status != ipc::ReplyStatus::Ok) {
@@ -617,7 +1095,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.dm_ButtonMapping.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while updating device button mapping: Unknown clientId " << message.msg.dm_ButtonMapping.clientId;
 									}
@@ -637,51 +1115,8 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 										resp.status = ipc::ReplyStatus::NotFound;
 									} else {
 										resp.status = ipc::ReplyStatus::Ok;
-										if (message.msg.dm_DeviceOffsets.enableOffsets > 0) {
-											info->enableOffsets(message.msg.dm_DeviceOffsets.enableOffsets == 1 ? true : false);
-										}
-										switch (message.msg.dm_DeviceOffsets.offsetOperation) {
-										case 0:
-											if (message.msg.dm_DeviceOffsets.worldFromDriverRotationOffsetValid) {
-												info->worldFromDriverRotationOffset() = message.msg.dm_DeviceOffsets.worldFromDriverRotationOffset;
-											}
-											if (message.msg.dm_DeviceOffsets.worldFromDriverTranslationOffsetValid) {
-												info->worldFromDriverTranslationOffset() = message.msg.dm_DeviceOffsets.worldFromDriverTranslationOffset;
-											}
-											if (message.msg.dm_DeviceOffsets.driverFromHeadRotationOffsetValid) {
-												info->driverFromHeadRotationOffset() = message.msg.dm_DeviceOffsets.driverFromHeadRotationOffset;
-											}
-											if (message.msg.dm_DeviceOffsets.driverFromHeadTranslationOffsetValid) {
-												info->driverFromHeadTranslationOffset() = message.msg.dm_DeviceOffsets.driverFromHeadTranslationOffset;
-											}
-											if (message.msg.dm_DeviceOffsets.deviceRotationOffsetValid) {
-												info->deviceRotationOffset() = message.msg.dm_DeviceOffsets.deviceRotationOffset;
-											}
-											if (message.msg.dm_DeviceOffsets.deviceTranslationOffsetValid) {
-												info->deviceTranslationOffset() = message.msg.dm_DeviceOffsets.deviceTranslationOffset;
-											}
-											break;
-										case 1:
-											if (message.msg.dm_DeviceOffsets.worldFromDriverRotationOffsetValid) {
-												info->worldFromDriverRotationOffset() =  message.msg.dm_DeviceOffsets.worldFromDriverRotationOffset * info->worldFromDriverRotationOffset();
-											}
-											if (message.msg.dm_DeviceOffsets.worldFromDriverTranslationOffsetValid) {
-												info->worldFromDriverTranslationOffset() = info->worldFromDriverTranslationOffset() + message.msg.dm_DeviceOffsets.worldFromDriverTranslationOffset;
-											}
-											if (message.msg.dm_DeviceOffsets.driverFromHeadRotationOffsetValid) {
-												info->driverFromHeadRotationOffset() = message.msg.dm_DeviceOffsets.driverFromHeadRotationOffset * info->driverFromHeadRotationOffset();
-											}
-											if (message.msg.dm_DeviceOffsets.driverFromHeadTranslationOffsetValid) {
-												info->driverFromHeadTranslationOffset() = info->driverFromHeadTranslationOffset() + message.msg.dm_DeviceOffsets.driverFromHeadTranslationOffset;
-											}
-											if (message.msg.dm_DeviceOffsets.deviceRotationOffsetValid) {
-												info->deviceRotationOffset() = message.msg.dm_DeviceOffsets.deviceRotationOffset * info->deviceRotationOffset();
-											}
-											if (message.msg.dm_DeviceOffsets.deviceTranslationOffsetValid) {
-												info->deviceTranslationOffset() = info->deviceTranslationOffset() + message.msg.dm_DeviceOffsets.deviceTranslationOffset;
-											}
-											break;
-										}
+										info->setOffsets(message.msg.dm_DeviceOffsets.offsets, message.msg.dm_DeviceOffsets.mask, message.msg.dm_DeviceOffsets.offsetOperation == 1);
+										driver->_mirrorDeviceOffsets(info);
 									}
 								}
 								if (resp.status != ipc::ReplyStatus::Ok) {
@@ -690,7 +1125,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.dm_DeviceOffsets.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while updating device pose offset: Unknown clientId " << message.msg.dm_DeviceOffsets.clientId;
 									}
@@ -719,7 +1154,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.vd_GenericDeviceIdMessage.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while updating device pose offset: Unknown clientId " << message.msg.vd_GenericDeviceIdMessage.clientId;
 									}
@@ -741,9 +1176,15 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 										OpenvrDeviceManipulationInfo* infoTarget = driver->deviceManipulation_getInfo(message.msg.dm_RedirectMode.targetId);
 										if (info && (info->deviceMode() == 0 || info->deviceMode() == 1) 
 												&& infoTarget && (infoTarget->deviceMode() == 0 || infoTarget->deviceMode() == 1)) {
-											info->setRedirectMode(false, infoTarget);
-											infoTarget->setRedirectMode(true, info);
-											resp.status = ipc::ReplyStatus::Ok;
+											// Fails when the routes don't compile, e.g. because a device has no valid id yet
+											if (info->setRedirectMode(false, infoTarget) != 0) {
+												resp.status = ipc::ReplyStatus::InvalidId;
+											} else if (infoTarget->setRedirectMode(true, info) != 0) {
+												info->setDefaultMode();
+												resp.status = ipc::ReplyStatus::InvalidId;
+											} else {
+												resp.status = ipc::ReplyStatus::Ok;
+											}
 										} else {
 											resp.status = ipc::ReplyStatus::UnknownError;
 										}
@@ -755,7 +1196,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.dm_RedirectMode.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while updating device pose offset: Unknown clientId " << message.msg.dm_RedirectMode.clientId;
 									}
@@ -777,9 +1218,14 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 									OpenvrDeviceManipulationInfo* infoTarget = driver->deviceManipulation_getInfo(message.msg.dm_SwapMode.targetId);
 									if (info && (info->deviceMode() == 0 || info->deviceMode() == 1)
 										&& infoTarget && (infoTarget->deviceMode() == 0 || infoTarget->deviceMode() == 1)) {
-										info->setSwapMode(infoTarget);
-										infoTarget->setSwapMode(info);
-										resp.status = ipc::ReplyStatus::Ok;
+										if (info->setSwapMode(infoTarget) != 0) {
+											resp.status = ipc::ReplyStatus::InvalidId;
+										} else if (infoTarget->setSwapMode(info) != 0) {
+											info->setDefaultMode();
+											resp.status = ipc::ReplyStatus::InvalidId;
+										} else {
+											resp.status = ipc::ReplyStatus::Ok;
+										}
 									} else {
 										resp.status = ipc::ReplyStatus::UnknownError;
 									}
@@ -791,7 +1237,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							if (resp.messageId != 0) {
 								auto i = _this->_ipcEndpoints.find(message.msg.dm_SwapMode.clientId);
 								if (i != _this->_ipcEndpoints.end()) {
-									i->second->send(&resp, sizeof(ipc::Reply), 0);
+									_this->_sendReply(i->first, resp);
 								} else {
 									LOG(ERROR) << "Error while updating device pose offset: Unknown clientId " << message.msg.dm_SwapMode.clientId;
 								}
@@ -811,15 +1257,19 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 										resp.status = ipc::ReplyStatus::NotFound;
 									} else {
 										auto serverDriver = CServerDriver::getInstance();
-										if (serverDriver) {
+										auto res = info->setMotionCompensationMode();
+										if (res == -2) {
+											resp.status = ipc::ReplyStatus::AlreadyInUse;
+										} else if (res != 0 || !serverDriver) {
+											resp.status = ipc::ReplyStatus::UnknownError;
+										} else {
+											// The center takes effect with the next zero pose, the group is only changed by its reference device
 											serverDriver->motionCompensation_setCenterPos(
+												info->motionCompensationGroup(),
 												message.msg.dm_MotionCompensationMode.centerPos,
 												message.msg.dm_MotionCompensationMode.centerRelativeToDevice
 											);
-										info->setMotionCompensationMode();
-										resp.status = ipc::ReplyStatus::Ok;
-										} else {
-											resp.status = ipc::ReplyStatus::UnknownError;
+											resp.status = ipc::ReplyStatus::Ok;
 										}
 									}
 								}
@@ -829,7 +1279,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (resp.messageId != 0) {
 									auto i = _this->_ipcEndpoints.find(message.msg.dm_MotionCompensationMode.clientId);
 									if (i != _this->_ipcEndpoints.end()) {
-										i->second->send(&resp, sizeof(ipc::Reply), 0);
+										_this->_sendReply(i->first, resp);
 									} else {
 										LOG(ERROR) << "Error while updating device pose offset: Unknown clientId " << message.msg.dm_MotionCompensationMode.clientId;
 									}
@@ -837,6 +1287,68 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							}
 							break;
 
+						case ipc::RequestType::DeviceManipulation_SetMotionCompensationGroup:
+							{
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.dm_SetMotionCompensationGroup.messageId;
+								if (message.msg.dm_SetMotionCompensationGroup.deviceId >= vr::k_unMaxTrackedDeviceCount) {
+									resp.status = ipc::ReplyStatus::InvalidId;
+								} else {
+									OpenvrDeviceManipulationInfo* info = driver->deviceManipulation_getInfo(message.msg.dm_SetMotionCompensationGroup.deviceId);
+									if (!info) {
+										resp.status = ipc::ReplyStatus::NotFound;
+									} else {
+										auto res = info->setMotionCompensationGroup(message.msg.dm_SetMotionCompensationGroup.group);
+										if (res == -1) {
+											resp.status = ipc::ReplyStatus::InvalidId;
+										} else if (res == -2) {
+											resp.status = ipc::ReplyStatus::InvalidOperation;
+										} else if (res == -3) {
+											resp.status = ipc::ReplyStatus::AlreadyInUse;
+										} else {
+											resp.status = ipc::ReplyStatus::Ok;
+										}
+									}
+								}
+								if (resp.status != ipc::ReplyStatus::Ok) {
+									LOG(ERROR) << "Error while setting motion compensation group: Error code " << (int)resp.status;
+								}
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.dm_SetMotionCompensationGroup.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp);
+									} else {
+										LOG(ERROR) << "Error while setting motion compensation group: Unknown clientId " << message.msg.dm_SetMotionCompensationGroup.clientId;
+									}
+								}
+							}
+							break;
+
+						case ipc::RequestType::DeviceManipulation_SetRoutes:
+							{
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.dm_SetRoutes.messageId;
+								if (message.msg.dm_SetRoutes.routeCount > DEVICEROUTING_MAXROUTES) {
+									resp.status = ipc::ReplyStatus::InvalidOperation;
+								} else if (!driver->deviceRouting_setRoutes(message.msg.dm_SetRoutes.routes, message.msg.dm_SetRoutes.routeCount)) {
+									resp.status = ipc::ReplyStatus::InvalidId;
+								} else {
+									resp.status = ipc::ReplyStatus::Ok;
+								}
+								if (resp.status != ipc::ReplyStatus::Ok) {
+									LOG(ERROR) << "Error while setting device routes: Error code " << (int)resp.status;
+								}
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.dm_SetRoutes.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp);
+									} else {
+										LOG(ERROR) << "Error while setting device routes: Unknown clientId " << message.msg.dm_SetRoutes.clientId;
+									}
+								}
+							}
+							break;
+
 						case ipc::RequestType::DeviceManipulation_FakeDisconnectedMode:
 						{
 							ipc::Reply resp(ipc::ReplyType::GenericReply);
@@ -858,7 +1370,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							if (resp.messageId != 0) {
 								auto i = _this->_ipcEndpoints.find(message.msg.vd_GenericDeviceIdMessage.clientId);
 								if (i != _this->_ipcEndpoints.end()) {
-									i->second->send(&resp, sizeof(ipc::Reply), 0);
+									_this->_sendReply(i->first, resp);
 								} else {
 									LOG(ERROR) << "Error while updating device pose offset: Unknown clientId " << message.msg.vd_GenericDeviceIdMessage.clientId;
 								}
@@ -877,8 +1389,11 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 								if (!info) {
 									resp.status = ipc::ReplyStatus::NotFound;
 								} else {
-									info->triggerHapticPulse(message.msg.dm_triggerHapticPulse.axisId, message.msg.dm_triggerHapticPulse.durationMicroseconds, message.msg.dm_triggerHapticPulse.directMode);
-									resp.status = ipc::ReplyStatus::Ok;
+									if (info->triggerHapticPulse(message.msg.dm_triggerHapticPulse.axisId, message.msg.dm_triggerHapticPulse.durationMicroseconds, message.msg.dm_triggerHapticPulse.directMode)) {
+										resp.status = ipc::ReplyStatus::Ok;
+									} else {
+										resp.status = ipc::ReplyStatus::InvalidOperation;
+									}
 								}
 							}
 							if (resp.status != ipc::ReplyStatus::Ok) {
@@ -887,7 +1402,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							if (resp.messageId != 0) {
 								auto i = _this->_ipcEndpoints.find(message.msg.dm_triggerHapticPulse.clientId);
 								if (i != _this->_ipcEndpoints.end()) {
-									i->second->send(&resp, sizeof(ipc::Reply), 0);
+									_this->_sendReply(i->first, resp);
 								} else {
 									LOG(ERROR) << "Error while triggering haptic pulse: Unknown clientId " << message.msg.dm_triggerHapticPulse.clientId;
 								}
@@ -900,8 +1415,11 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							ipc::Reply resp(ipc::ReplyType::GenericReply);
 							resp.messageId = message.msg.dm_SetMotionCompensationProperties.messageId;
 							auto serverDriver = CServerDriver::getInstance();
-							if (serverDriver) {
+							if (message.msg.dm_SetMotionCompensationProperties.group >= MOTIONCOMPENSATION_MAXGROUPS) {
+								resp.status = ipc::ReplyStatus::InvalidId;
+							} else if (serverDriver) {
 								serverDriver->motionCompensation_setCenterPos(
+									message.msg.dm_SetMotionCompensationProperties.group,
 									message.msg.dm_SetMotionCompensationProperties.centerPos, 
 									message.msg.dm_SetMotionCompensationProperties.centerRelativeToDevice
 								);
@@ -915,7 +1433,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 							if (resp.messageId != 0) {
 								auto i = _this->_ipcEndpoints.find(message.msg.dm_SetMotionCompensationProperties.clientId);
 								if (i != _this->_ipcEndpoints.end()) {
-									i->second->send(&resp, sizeof(ipc::Reply), 0);
+									_this->_sendReply(i->first, resp);
 								} else {
 									LOG(ERROR) << "Error while setting motion compensation properties: Unknown clientId " << message.msg.dm_SetMotionCompensationProperties.clientId;
 								}
@@ -923,6 +1441,35 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 						}
 						break;
 
+						case ipc::RequestType::DeviceManipulation_SetPoseFilter:
+							{
+								ipc::Reply resp(ipc::ReplyType::GenericReply);
+								resp.messageId = message.msg.dm_SetPoseFilter.messageId;
+								if (message.msg.dm_SetPoseFilter.deviceId >= vr::k_unMaxTrackedDeviceCount) {
+									resp.status = ipc::ReplyStatus::InvalidId;
+								} else {
+									OpenvrDeviceManipulationInfo* info = driver->deviceManipulation_getInfo(message.msg.dm_SetPoseFilter.deviceId);
+									if (!info) {
+										resp.status = ipc::ReplyStatus::NotFound;
+									} else {
+										info->setPoseFilter(message.msg.dm_SetPoseFilter.stages, min(message.msg.dm_SetPoseFilter.stageCount, POSEFILTER_MAXSTAGES));
+										resp.status = ipc::ReplyStatus::Ok;
+									}
+								}
+								if (resp.status != ipc::ReplyStatus::Ok) {
+									LOG(ERROR) << "Error while setting pose filter: Error code " << (int)resp.status;
+								}
+								if (resp.messageId != 0) {
+									auto i = _this->_ipcEndpoints.find(message.msg.dm_SetPoseFilter.clientId);
+									if (i != _this->_ipcEndpoints.end()) {
+										_this->_sendReply(i->first, resp);
+									} else {
+										LOG(ERROR) << "Error while setting pose filter: Unknown clientId " << message.msg.dm_SetPoseFilter.clientId;
+									}
+								}
+							}
+							break;
+
 						default:
 							LOG(ERROR) << "Error in ipc server receive loop: Unknown message type (" << (int)message.type << ")";
 							break;
@@ -935,6 +1482,7 @@ void IpcShmCommunicator::_ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver
 				LOG(ERROR) << "Exception caught in ipc server receive loop: " << ex.what();
 			}
 		}
+		_this->_ipcRequestQueues.reset();
 		boost::interprocess::message_queue::remove(_this->_ipcQueueName.c_str());
 	} catch (std::exception& ex) {
 		LOG(ERROR) << "Exception caught in ipc server thread: " << ex.what();
@@ -3,12 +3,28 @@
 #include <thread>
 #include <string>
 #include <map>
+#include <vector>
 #include <memory>
+#include <mutex>
+#include <openvr_driver.h>
+#include <vrinputemulator_types.h>
 #include <boost/interprocess/ipc/message_queue.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/named_semaphore.hpp>
+#include "../../utils/IpcRequestQueues.h"
 
 
 // driver namespace
 namespace vrinputemulator {
+
+// forward declarations
+namespace ipc {
+	struct SharedState;
+	struct Request;
+	struct Reply;
+}
+
 namespace driver {
 
 // forward declarations
@@ -20,9 +36,22 @@ public:
 	void init(CServerDriver* driver);
 	void shutdown();
 
+	// Sends the notification to all clients subscribed to its class. Never blocks, a client whose queue is full misses
+	// it (and can resync with the device info sequence). Can be called from any thread.
+	void notify(DeviceNotificationClass notificationClass, const DeviceNotification& notification);
+
+	// Read-only mirror of the device state for clients, nullptr when it could not be created
+	ipc::SharedState* sharedState() { return _sharedState; }
+
 private:
 	static void _ipcThreadFunc(IpcShmCommunicator* _this, CServerDriver* driver);
 
+	// Stays mapped until the driver is unloaded, so writers never see it disappear
+	std::shared_ptr<boost::interprocess::shared_memory_object> _sharedStateMemory;
+	std::shared_ptr<boost::interprocess::mapped_region> _sharedStateRegion;
+	ipc::SharedState* _sharedState = nullptr;
+	void _createSharedState();
+
 	CServerDriver* _driver = nullptr;
 	std::thread _ipcThread;
 	volatile bool _ipcThreadRunning = false;
@@ -30,6 +59,34 @@ private:
 	std::string _ipcQueueName = "driver_vrinputemulator.server_queue";
 	uint32_t _ipcClientIdNext = 1;
 	std::map<uint32_t, std::shared_ptr<boost::interprocess::message_queue>> _ipcEndpoints;
+
+	// Every client gets its own request queue at connect, created by the ipc thread together with the server queue
+	std::unique_ptr<IpcRequestQueues> _ipcRequestQueues;
+	void _addRequestQueue(uint32_t clientId, char* nameBuffer, size_t nameBufferSize);
+
+	// Replies never block the ipc thread for longer than this, a client that doesn't empty its queue gets dropped
+	static const unsigned _ipcReplyTimeoutMs = 50;
+	bool _sendReply(uint32_t clientId, const ipc::Reply& reply, size_t replySize = sizeof(ipc::Reply));
+	void _dropClient(uint32_t clientId);
+
+	// Device property batches that have been received but not yet committed (clientId => batch)
+	struct _PropertyBatch {
+		uint32_t virtualDeviceId = 0xFFFFFFFF;
+		uint32_t entryCount = 0;
+		bool overflow = false; // exceeded the batch limits, data has been dropped
+		std::vector<uint8_t> data;
+	};
+	std::map<uint32_t, _PropertyBatch> _ipcPropertyBatches;
+
+	// Written by the ipc thread, read by whichever thread sends a notification
+	struct _Subscriber {
+		uint32_t clientId;
+		uint32_t notificationClasses;
+		std::shared_ptr<boost::interprocess::message_queue> queue;
+	};
+	std::mutex _subscribersMutex;
+	std::vector<_Subscriber> _subscribers;
+	void _setSubscription(uint32_t clientId, uint32_t notificationClasses, const std::shared_ptr<boost::interprocess::message_queue>& queue);
 };
 
 
@@ -1,6 +1,7 @@
 
 #include "stdafx.h"
 #include "driver_vrinputemulator.h"
+#include <ipc_protocol.h>
 #include <openvr_math.h>
 
 
@@ -16,6 +17,10 @@ namespace driver {
 
 void OpenvrDeviceManipulationInfo::handleNewDevicePose(vr::IVRServerDriverHost* driver, _DetourTrackedDevicePoseUpdated_t origFunc, uint32_t& unWhichDevice, const vr::DriverPose_t& pose) {
 	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	auto serverDriver = CServerDriver::getInstance();
+	if (serverDriver) {
+		serverDriver->_setRoutingSourceActive(m_openvrId, m_deviceMode != 1 && m_deviceMode != 5 && pose.poseIsValid && pose.deviceIsConnected);
+	}
 	if (m_deviceMode == 1) { // fake disconnect mode
 		if (!_disconnectedMsgSend) {
 			vr::DriverPose_t newPose = pose;
@@ -25,16 +30,13 @@ void OpenvrDeviceManipulationInfo::handleNewDevicePose(vr::IVRServerDriverHost*
 			_disconnectedMsgSend = true;
 			origFunc(driver, unWhichDevice, newPose, sizeof(vr::DriverPose_t));
 		}
-	} else if (m_deviceMode == 3 && !m_redirectSuspended) { // redirect target
-		//nop
 	} else if (m_deviceMode == 5) { // motion compensation mode
-		auto serverDriver = CServerDriver::getInstance();
 		if (serverDriver) {
 			if (pose.poseIsValid && pose.result == vr::TrackingResult_Running_OK) {
-				if (!serverDriver->_isMotionCompensationZeroPoseValid()) {
-					serverDriver->_setMotionCompensationZeroPose(pose);
+				if (!serverDriver->_isMotionCompensationZeroPoseValid(m_motionCompensationGroup)) {
+					serverDriver->_setMotionCompensationZeroPose(m_motionCompensationGroup, pose);
 				} else {
-					serverDriver->_updateMotionCompensationRefPose(pose);
+					serverDriver->_updateMotionCompensationRefPose(m_motionCompensationGroup, pose);
 				}
 			}
 		}
@@ -48,6 +50,14 @@ void OpenvrDeviceManipulationInfo::handleNewDevicePose(vr::IVRServerDriverHost*
 		}
 	} else {
 		vr::DriverPose_t newPose = pose;
+		if (!m_poseFilter.empty()) {
+			// Filter the raw pose, offsets and motion compensation must not be smoothed
+			if (newPose.poseIsValid) {
+				m_poseFilter.apply(newPose, ipc::timestampNow() + (int64_t)(newPose.poseTimeOffset * 1.0e9));
+			} else {
+				m_poseFilter.reset();
+			}
+		}
 		if (m_offsetsEnabled) {
 			if (m_worldFromDriverRotationOffset.w != 1.0 || m_worldFromDriverRotationOffset.x != 0.0
 					|| m_worldFromDriverRotationOffset.y != 0.0 || m_worldFromDriverRotationOffset.z != 0.0) {
@@ -71,12 +81,15 @@ void OpenvrDeviceManipulationInfo::handleNewDevicePose(vr::IVRServerDriverHost*
 				VECTOR_ADD(newPose.vecPosition, m_deviceTranslationOffset);
 			}
 		}
-		auto serverDriver = CServerDriver::getInstance();
-		if (serverDriver) {
-			serverDriver->_applyMotionCompensation(newPose);
+		if (m_motionCompensationGroup != MOTIONCOMPENSATION_NOGROUP && serverDriver) {
+			serverDriver->_applyMotionCompensation(m_motionCompensationGroup, newPose);
 		}
-		if (m_deviceMode == 2 && !m_redirectSuspended) { // redirect source
-			if (!_disconnectedMsgSend) {
+		auto routes = _routes(DeviceRouteChannel::Pose);
+		if (!routes) {
+			_disconnectedMsgSend = false;
+			origFunc(driver, unWhichDevice, newPose, sizeof(vr::DriverPose_t));
+		} else {
+			if (routes->disconnectSelf && !_disconnectedMsgSend) { // e.g. redirect source
 				vr::DriverPose_t newPose2 = pose;
 				newPose2.poseIsValid = false;
 				newPose2.deviceIsConnected = false;
@@ -84,11 +97,14 @@ void OpenvrDeviceManipulationInfo::handleNewDevicePose(vr::IVRServerDriverHost*
 				_disconnectedMsgSend = true;
 				origFunc(driver, unWhichDevice, newPose2, sizeof(vr::DriverPose_t));
 			}
-			origFunc(driver, m_redirectRef->openvrId(), newPose, sizeof(vr::DriverPose_t));
-		} else if (m_deviceMode == 4) { // swap mode
-			origFunc(driver, m_redirectRef->openvrId(), newPose, sizeof(vr::DriverPose_t));
-		} else {
-			origFunc(driver, unWhichDevice, newPose, sizeof(vr::DriverPose_t));
+			for (auto& t : routes->targets) {
+				if (!_isPreempted(t)) {
+					if (t.openvrId == unWhichDevice) {
+						_disconnectedMsgSend = false;
+					}
+					origFunc(driver, t.openvrId, newPose, sizeof(vr::DriverPose_t));
+				}
+			}
 		}
 	}
 }
@@ -102,46 +118,138 @@ void OpenvrDeviceManipulationInfo::handleButtonEvent(vr::IVRServerDriverHost* dr
 			_disconnectedMsgSend = false;
 			m_redirectRef->m_redirectSuspended = m_redirectSuspended;
 			m_redirectRef->_disconnectedMsgSend = false;
+			_updateModeRoutes();
+			m_redirectRef->_updateModeRoutes();
+			_infoChanged();
+			m_redirectRef->_infoChanged();
 		}
-	} else if (m_deviceMode == 1 || (m_deviceMode == 3 && !m_redirectSuspended) || m_deviceMode == 5) {
+	} else if (m_deviceMode == 1 || m_deviceMode == 5) {
 		//nop
 	} else {
 		vr::EVRButtonId button = eButtonId;
 		getButtonMapping(eButtonId, button);
-		if (m_deviceMode == 0 || ((m_deviceMode == 3 || m_deviceMode == 2) && m_redirectSuspended)) {
+		auto routes = _routes(DeviceRouteChannel::Buttons);
+		if (!routes) {
 			((_DetourTrackedDeviceButtonPressed_t)origFunc)(driver, unWhichDevice, button, eventTimeOffset);
-		} else if ((m_deviceMode == 2 && !m_redirectSuspended) || m_deviceMode == 4) {
-			((_DetourTrackedDeviceButtonPressed_t)origFunc)(driver, m_redirectRef->openvrId(), button, eventTimeOffset);
+		} else {
+			for (auto& t : routes->targets) {
+				if (!_isPreempted(t)) {
+					((_DetourTrackedDeviceButtonPressed_t)origFunc)(driver, t.openvrId, button, eventTimeOffset);
+				}
+			}
 		}
 	}
 }
 
 void OpenvrDeviceManipulationInfo::handleAxisEvent(vr::IVRServerDriverHost* driver, _DetourTrackedDeviceAxisUpdated_t origFunc, uint32_t& unWhichDevice, uint32_t unWhichAxis, const vr::VRControllerAxis_t& axisState) {
 	std::lock_guard<std::recursive_mutex> lock(_mutex);
-	if (m_deviceMode == 1 || (m_deviceMode == 3 && !m_redirectSuspended) || m_deviceMode == 5) {
+	if (m_deviceMode == 1 || m_deviceMode == 5) {
 		//nop
 	} else {
-		if (m_deviceMode == 0 || ((m_deviceMode == 3 || m_deviceMode == 2) && m_redirectSuspended)) {
-			origFunc(driver, unWhichDevice, unWhichAxis, axisState);
-		} else if ((m_deviceMode == 2 && !m_redirectSuspended) || m_deviceMode == 4) {
-			origFunc(driver, m_redirectRef->openvrId(), unWhichAxis, axisState);
+		vr::VRControllerAxis_t newState = axisState;
+		uint32_t axis = unWhichAxis;
+		if (m_axisTransformsEnabled && unWhichAxis < vr::k_unControllerStateAxisCount && m_axisTransforms[unWhichAxis].enabled()) {
+			auto& transform = m_axisTransforms[unWhichAxis];
+			int buttonEvent;
+			axis = transform.apply(newState, buttonEvent);
+			if (buttonEvent == 1) { // goes through the button detour, so button mapping and routes apply
+				driver->TrackedDeviceButtonPressed(unWhichDevice, (vr::EVRButtonId)transform.config().buttonId, 0.0);
+			} else if (buttonEvent == 2) {
+				driver->TrackedDeviceButtonUnpressed(unWhichDevice, (vr::EVRButtonId)transform.config().buttonId, 0.0);
+			}
+		}
+		auto routes = _routes(DeviceRouteChannel::Axes);
+		if (!routes) {
+			origFunc(driver, unWhichDevice, axis, newState);
+		} else {
+			for (auto& t : routes->targets) {
+				if (!_isPreempted(t)) {
+					origFunc(driver, t.openvrId, axis, newState);
+				}
+			}
+		}
+	}
+}
+
+
+const DeviceRoutingTable::Dispatch* OpenvrDeviceManipulationInfo::_routes(DeviceRouteChannel channel) {
+	auto serverDriver = CServerDriver::getInstance();
+	if (!serverDriver) {
+		return nullptr;
+	}
+	auto version = serverDriver->_getRoutingTableVersion();
+	if (version != m_routingTableVersion) {
+		m_routingTable = serverDriver->_getRoutingTable();
+		m_routingTableVersion = version;
+	}
+	return m_routingTable ? m_routingTable->find(m_openvrId, channel) : nullptr;
+}
+
+bool OpenvrDeviceManipulationInfo::_isPreempted(const DeviceRoutingTable::Target& target) {
+	auto serverDriver = CServerDriver::getInstance();
+	for (auto id : target.preemptedBy) {
+		if (serverDriver->_isRoutingSourceActive(id)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Redirect and swap modes are expressed as routes of the device, suspended redirects have none
+bool OpenvrDeviceManipulationInfo::_updateModeRoutes() {
+	auto serverDriver = CServerDriver::getInstance();
+	if (!serverDriver) {
+		return false;
+	}
+	DeviceRoute route = { m_openvrId, DEVICEROUTING_DROP, (uint32_t)DeviceRouteChannel::All, 0 };
+	if ((m_deviceMode == 2 && !m_redirectSuspended) || m_deviceMode == 4) {
+		route.targetId = m_redirectRef->openvrId();
+		if (route.targetId >= vr::k_unMaxTrackedDeviceCount) {
+			return false; // k_unTrackedDeviceIndexInvalid would turn into a drop route
 		}
+		return serverDriver->_setDeviceModeRoutes(m_openvrId, &route, 1);
+	} else if (m_deviceMode == 3 && !m_redirectSuspended) { // only shows what the source sends
+		return serverDriver->_setDeviceModeRoutes(m_openvrId, &route, 1);
+	} else {
+		return serverDriver->_setDeviceModeRoutes(m_openvrId, nullptr, 0);
 	}
 }
 
 
+// Returns false when the pulse cannot be sent, a queued pulse is reported by the haptic thread
 bool OpenvrDeviceManipulationInfo::triggerHapticPulse(uint32_t unAxisId, uint16_t usPulseDurationMicroseconds, bool directMode) {
-	std::lock_guard<std::recursive_mutex> lock(_mutex);
-	if (m_controllerComponent) {
-		if (directMode) {
-			return m_triggerHapticPulseFunc(m_controllerComponent, unAxisId, usPulseDurationMicroseconds);
+	OpenvrDeviceManipulationInfo* target = nullptr;
+	{
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		if (!m_controllerComponent) {
+			return false;
+		} else if (directMode) {
+			target = this;
 		} else if ((m_deviceMode == 3 && !m_redirectSuspended) || m_deviceMode == 4) {
-			m_redirectRef->triggerHapticPulse(unAxisId, usPulseDurationMicroseconds, true);
+			target = m_redirectRef;
 		} else  if (m_deviceMode == 0 || ((m_deviceMode == 3 || m_deviceMode == 2) && m_redirectSuspended)) {
-			return m_triggerHapticPulseFunc(m_controllerComponent, unAxisId, usPulseDurationMicroseconds);
+			target = this;
 		}
 	}
-	return true;
+	if (!target) {
+		return true; // the current mode swallows pulses
+	} else if (unAxisId >= vr::k_unControllerStateAxisCount || !target->m_controllerComponent || !target->m_triggerHapticPulseFunc) {
+		return false;
+	}
+	auto serverDriver = CServerDriver::getInstance();
+	if (serverDriver) {
+		return serverDriver->_scheduleHapticPulse(target, unAxisId, usPulseDurationMicroseconds);
+	} else {
+		return target->_dispatchHapticPulse(unAxisId, usPulseDurationMicroseconds);
+	}
+}
+
+// Component and function pointer never change after the device has been added, no locking needed
+bool OpenvrDeviceManipulationInfo::_dispatchHapticPulse(uint32_t unAxisId, uint16_t usPulseDurationMicroseconds) {
+	if (m_controllerComponent && m_triggerHapticPulseFunc) {
+		return m_triggerHapticPulseFunc(m_controllerComponent, unAxisId, usPulseDurationMicroseconds);
+	}
+	return false;
 }
 
 bool OpenvrDeviceManipulationInfo::getButtonMapping(vr::EVRButtonId button, vr::EVRButtonId& mappedButton) {
@@ -171,11 +279,91 @@ void OpenvrDeviceManipulationInfo::eraseAllButtonMappings() {
 	m_buttonMapping.clear();
 }
 
+void OpenvrDeviceManipulationInfo::setAxisTransform(const AxisTransform& transform) {
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	auto& old = m_axisTransforms[transform.axisId];
+	if (old.buttonPressed() && m_driverHost) { // don't leave the button stuck
+		m_driverHost->TrackedDeviceButtonUnpressed(m_openvrId, (vr::EVRButtonId)old.config().buttonId, 0.0);
+	}
+	m_axisTransforms[transform.axisId].configure(transform);
+	m_axisTransformsEnabled = false;
+	for (auto& t : m_axisTransforms) {
+		if (t.enabled()) {
+			m_axisTransformsEnabled = true;
+		}
+	}
+}
+
+void OpenvrDeviceManipulationInfo::setPoseFilter(const PoseFilterStage* stages, uint32_t count) {
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	m_poseFilter.configure(stages, count);
+}
+
+void OpenvrDeviceManipulationInfo::_infoChanged() {
+	auto serverDriver = CServerDriver::getInstance();
+	if (serverDriver) {
+		serverDriver->_deviceInfoChanged(m_openvrId);
+	}
+}
+
+void OpenvrDeviceManipulationInfo::enableOffsets(bool enable) {
+	if (m_offsetsEnabled != enable) {
+		m_offsetsEnabled = enable;
+		_infoChanged();
+	}
+}
+
+void OpenvrDeviceManipulationInfo::getOffsets(DeviceOffsets& offsets) {
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	offsets.deviceId = m_openvrId;
+	offsets.offsetsEnabled = m_offsetsEnabled;
+	offsets.worldFromDriverRotationOffset = m_worldFromDriverRotationOffset;
+	offsets.worldFromDriverTranslationOffset = m_worldFromDriverTranslationOffset;
+	offsets.driverFromHeadRotationOffset = m_driverFromHeadRotationOffset;
+	offsets.driverFromHeadTranslationOffset = m_driverFromHeadTranslationOffset;
+	offsets.deviceRotationOffset = m_deviceRotationOffset;
+	offsets.deviceTranslationOffset = m_deviceTranslationOffset;
+}
+
+void OpenvrDeviceManipulationInfo::setOffsets(const DeviceOffsets& offsets, uint32_t mask, bool add) {
+	// handleNewDevicePose holds the same mutex, so it never sees half of an update
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	if (mask & (uint32_t)DeviceOffsetsMask::WorldFromDriverRotation) {
+		m_worldFromDriverRotationOffset = add ? offsets.worldFromDriverRotationOffset * m_worldFromDriverRotationOffset : offsets.worldFromDriverRotationOffset;
+	}
+	if (mask & (uint32_t)DeviceOffsetsMask::WorldFromDriverTranslation) {
+		m_worldFromDriverTranslationOffset = add ? m_worldFromDriverTranslationOffset + offsets.worldFromDriverTranslationOffset : offsets.worldFromDriverTranslationOffset;
+	}
+	if (mask & (uint32_t)DeviceOffsetsMask::DriverFromHeadRotation) {
+		m_driverFromHeadRotationOffset = add ? offsets.driverFromHeadRotationOffset * m_driverFromHeadRotationOffset : offsets.driverFromHeadRotationOffset;
+	}
+	if (mask & (uint32_t)DeviceOffsetsMask::DriverFromHeadTranslation) {
+		m_driverFromHeadTranslationOffset = add ? m_driverFromHeadTranslationOffset + offsets.driverFromHeadTranslationOffset : offsets.driverFromHeadTranslationOffset;
+	}
+	if (mask & (uint32_t)DeviceOffsetsMask::DeviceRotation) {
+		m_deviceRotationOffset = add ? offsets.deviceRotationOffset * m_deviceRotationOffset : offsets.deviceRotationOffset;
+	}
+	if (mask & (uint32_t)DeviceOffsetsMask::DeviceTranslation) {
+		m_deviceTranslationOffset = add ? m_deviceTranslationOffset + offsets.deviceTranslationOffset : offsets.deviceTranslationOffset;
+	}
+	if (mask & (uint32_t)DeviceOffsetsMask::Enabled) {
+		enableOffsets(offsets.offsetsEnabled);
+	}
+}
+
+void OpenvrDeviceManipulationInfo::setButtonMappingEnabled(bool enable) {
+	if (m_enableButtonMapping != enable) {
+		m_enableButtonMapping = enable;
+		_infoChanged();
+	}
+}
+
 int OpenvrDeviceManipulationInfo::setDefaultMode() {
 	std::lock_guard<std::recursive_mutex> lock(_mutex);
 	auto res = _disableOldMode(0);
 	if (res == 0) {
 		m_deviceMode = 0;
+		_infoChanged();
 	}
 	return 0; 
 }
@@ -191,8 +379,13 @@ int OpenvrDeviceManipulationInfo::setRedirectMode(bool target, OpenvrDeviceManip
 		} else {
 			m_deviceMode = 2;
 		}
+		if (!_updateModeRoutes()) {
+			m_deviceMode = 0;
+			res = -1;
+		}
+		_infoChanged();
 	}
-	return 0; 
+	return res;
 }
 
 int OpenvrDeviceManipulationInfo::setSwapMode(OpenvrDeviceManipulationInfo* ref) {
@@ -201,19 +394,62 @@ int OpenvrDeviceManipulationInfo::setSwapMode(OpenvrDeviceManipulationInfo* ref)
 	if (res == 0) {
 		m_redirectRef = ref;
 		m_deviceMode = 4;
+		if (!_updateModeRoutes()) {
+			m_deviceMode = 0;
+			res = -1;
+		}
+		_infoChanged();
 	}
-	return 0;
+	return res;
 }
 
 int OpenvrDeviceManipulationInfo::setMotionCompensationMode() {
 	std::lock_guard<std::recursive_mutex> lock(_mutex);
-	auto res = _disableOldMode(5);
 	auto serverDriver = CServerDriver::getInstance();
-	if (res == 0 && serverDriver) {
+	if (!serverDriver) {
+		return -1;
+	}
+	auto group = m_motionCompensationGroup != MOTIONCOMPENSATION_NOGROUP ? m_motionCompensationGroup : 0;
+	if (m_deviceMode == 5) {
+		// Already the reference, start over with a new zero pose
+		serverDriver->_enableMotionCompensation(group, true);
+		return 0;
+	} else if (!serverDriver->_claimMotionCompensationGroup(group)) {
+		return -2; // the group already has a reference device
+	}
+	auto res = _disableOldMode(5);
+	if (res == 0) {
 		_disconnectedMsgSend = false;
-		serverDriver->_enableMotionCompensation(true);
+		m_motionCompensationGroup = group;
 		m_deviceMode = 5;
+		_infoChanged();
+	} else {
+		serverDriver->_enableMotionCompensation(group, false);
+	}
+	return res;
+}
+
+int OpenvrDeviceManipulationInfo::setMotionCompensationGroup(uint32_t group) {
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	if (group >= MOTIONCOMPENSATION_MAXGROUPS && group != MOTIONCOMPENSATION_NOGROUP) {
+		return -1;
+	} else if (group == m_motionCompensationGroup) {
+		return 0;
+	}
+	if (m_deviceMode == 5) { // the reference device moves its compensation to the new group
+		if (group == MOTIONCOMPENSATION_NOGROUP) {
+			return -2;
+		}
+		auto serverDriver = CServerDriver::getInstance();
+		if (serverDriver) {
+			if (!serverDriver->_claimMotionCompensationGroup(group)) {
+				return -3; // the group already has a reference device
+			}
+			serverDriver->_enableMotionCompensation(m_motionCompensationGroup, false);
+		}
 	}
+	m_motionCompensationGroup = group;
+	_infoChanged();
 	return 0;
 }
 
@@ -223,6 +459,7 @@ int OpenvrDeviceManipulationInfo::setFakeDisconnectedMode() {
 	if (res == 0) {
 		_disconnectedMsgSend = false;
 		m_deviceMode = 1;
+		_infoChanged();
 	}
 	return 0;
 }
@@ -232,10 +469,14 @@ int OpenvrDeviceManipulationInfo::_disableOldMode(int newMode) {
 		if (m_deviceMode == 5) {
 			auto serverDriver = CServerDriver::getInstance();
 			if (serverDriver) {
-				serverDriver->_enableMotionCompensation(false);
+				serverDriver->_enableMotionCompensation(m_motionCompensationGroup, false);
 			}
 		} else if (m_deviceMode == 3 || m_deviceMode == 2 || m_deviceMode == 4) {
 			m_redirectRef->m_deviceMode = 0;
+			m_redirectRef->_updateModeRoutes();
+			m_redirectRef->_infoChanged();
+			m_deviceMode = 0;
+			_updateModeRoutes();
 		}
 	}
 	return 0;
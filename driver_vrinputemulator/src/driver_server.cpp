@@ -3,6 +3,7 @@
 #include "driver_vrinputemulator.h"
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <ipc_protocol.h>
+#include <ipc_shared_state.h>
 #include <openvr_math.h>
 #include <MinHook.h>
 #include <map>
@@ -38,7 +39,8 @@ namespace driver {
 
 CServerDriver* CServerDriver::singleton = nullptr;
 
-std::map<vr::ITrackedDeviceServerDriver*, std::shared_ptr<OpenvrDeviceManipulationInfo>> CServerDriver::_openvrDeviceInfos;
+std::vector<std::shared_ptr<OpenvrDeviceManipulationInfo>> CServerDriver::_openvrDeviceInfos;
+PointerHashMap<vr::ITrackedDeviceServerDriver*, OpenvrDeviceManipulationInfo*, 8> CServerDriver::_driverToDeviceInfoMap;
 OpenvrDeviceManipulationInfo* CServerDriver::_openvrIdToDeviceInfoMap[vr::k_unMaxTrackedDeviceCount]; // index == openvrId
 
 CServerDriver::_DetourFuncInfo<_DetourTrackedDeviceAdded_t> CServerDriver::_deviceAddedDetour;
@@ -48,11 +50,11 @@ CServerDriver::_DetourFuncInfo<_DetourTrackedDeviceButtonUnpressed_t> CServerDri
 CServerDriver::_DetourFuncInfo<_DetourTrackedDeviceButtonTouched_t> CServerDriver::_buttonTouchedDetour;
 CServerDriver::_DetourFuncInfo<_DetourTrackedDeviceButtonUntouched_t> CServerDriver::_buttonUntouchedDetour;
 CServerDriver::_DetourFuncInfo<_DetourTrackedDeviceAxisUpdated_t> CServerDriver::_axisUpdatedDetour;
-std::vector<CServerDriver::_DetourFuncInfo<_DetourTrackedDeviceActivate_t>> CServerDriver::_deviceActivateDetours;
-std::map<vr::ITrackedDeviceServerDriver*, CServerDriver::_DetourFuncInfo<_DetourTrackedDeviceActivate_t>*> CServerDriver::_deviceActivateDetourMap; // _this => DetourInfo
+std::deque<CServerDriver::_DetourFuncInfo<_DetourTrackedDeviceActivate_t>> CServerDriver::_deviceActivateDetours;
+PointerHashMap<vr::ITrackedDeviceServerDriver*, CServerDriver::_DetourFuncInfo<_DetourTrackedDeviceActivate_t>*, 8> CServerDriver::_deviceActivateDetourMap; // _this => DetourInfo
 
-std::vector<CServerDriver::_DetourFuncInfo<_DetourTriggerHapticPulse_t>> CServerDriver::_deviceTriggerHapticPulseDetours;
-std::map<vr::IVRControllerComponent*, std::shared_ptr<OpenvrDeviceManipulationInfo>> CServerDriver::_controllerComponentToDeviceInfos; // ControllerComponent => ManipulationInfo
+std::deque<CServerDriver::_DetourFuncInfo<_DetourTriggerHapticPulse_t>> CServerDriver::_deviceTriggerHapticPulseDetours;
+PointerHashMap<vr::IVRControllerComponent*, OpenvrDeviceManipulationInfo*, 8> CServerDriver::_controllerComponentToDeviceInfos; // ControllerComponent => ManipulationInfo
 
 
 
@@ -60,6 +62,10 @@ CServerDriver::CServerDriver() {
 	singleton = this;
 	memset(m_openvrIdToVirtualDeviceMap, 0, sizeof(CTrackedDeviceDriver*) * vr::k_unMaxTrackedDeviceCount);
 	memset(_openvrIdToDeviceInfoMap, 0, sizeof(OpenvrDeviceManipulationInfo*) * vr::k_unMaxTrackedDeviceCount);
+	memset(_pendingAxisEventIndex, 0, sizeof(_pendingAxisEventIndex));
+	for (auto& a : _routingSourceActive) {
+		a = false;
+	}
 }
 
 
@@ -151,16 +157,17 @@ void CServerDriver::_axisUpdatedDetourFunc(vr::IVRServerDriverHost* _this, uint3
 
 vr::EVRInitError CServerDriver::_deviceActivateDetourFunc(vr::ITrackedDeviceServerDriver* _this, uint32_t unObjectId) {
 	LOG(TRACE) << "Detour::deviceActivateDetourFunc(" << _this << ", " << unObjectId << ")";
-	auto i = _openvrDeviceInfos.find(_this);
-	if (i != _openvrDeviceInfos.end()) {
-		auto info = i->second;
+	auto info = _driverToDeviceInfoMap.find(_this);
+	if (info) {
 		info->setOpenvrId(unObjectId);
-		_openvrIdToDeviceInfoMap[unObjectId] = info.get();
+		_openvrIdToDeviceInfoMap[unObjectId] = info;
+		singleton->_mirrorDeviceOffsets(info);
+		singleton->_deviceInfoChanged(unObjectId, DeviceNotificationType::DeviceAdded);
 		LOG(INFO) << "Detour::deviceActivateDetourFunc: sucessfully added to trackedDeviceInfos";
 	}
-	auto& d = _deviceActivateDetourMap.find(_this);
-	if (d != _deviceActivateDetourMap.end()) {
-		return d->second->origFunc(_this, unObjectId);
+	auto d = _deviceActivateDetourMap.find(_this);
+	if (d) {
+		return d->origFunc(_this, unObjectId);
 	}
 	return vr::VRInitError_Unknown;
 }
@@ -168,9 +175,8 @@ vr::EVRInitError CServerDriver::_deviceActivateDetourFunc(vr::ITrackedDeviceServ
 
 bool CServerDriver::_deviceTriggerHapticPulseDetourFunc(vr::IVRControllerComponent* _this, uint32_t unAxisId, uint16_t usPulseDurationMicroseconds) {
 	LOG(TRACE) << "Detour::deviceTriggerHapticPulseDetourFunc(" << _this << ", " << unAxisId << ", " << usPulseDurationMicroseconds << ")";
-	auto i = _controllerComponentToDeviceInfos.find(_this);
-	if (i != _controllerComponentToDeviceInfos.end()) {
-		auto info = i->second;
+	auto info = _controllerComponentToDeviceInfos.find(_this);
+	if (info) {
 		return info->triggerHapticPulse(unAxisId, usPulseDurationMicroseconds);
 	}
 	return true;
@@ -191,16 +197,29 @@ bool CServerDriver::_deviceAddedDetourFunc(vr::IVRServerDriverHost* _this, const
 	}
 	if (!foundEntry) {
 		_deviceActivateDetours.emplace_back();
-		auto& d = _deviceActivateDetours[_deviceActivateDetours.size() - 1];
+		auto& d = _deviceActivateDetours.back();
 		MH_STATUS mhError;
 		CREATE_MH_HOOK(d, _deviceActivateDetourFunc, "deviceActivateDetour", pDriver, 0);
 		foundEntry = &d;
 	}
-	_deviceActivateDetourMap.insert({pDriver, foundEntry});
+	// A re-added driver object gets the detour of its current vtable, as with the std::map this replaced
+	if (!_deviceActivateDetourMap.assign(pDriver, foundEntry)) {
+		LOG(ERROR) << "Detour::deviceAddedDetourFunc: Too many devices, cannot activate " << pchDeviceSerialNumber;
+	}
 
 	// Create ManipulationInfo entry
-	auto info = std::make_shared<OpenvrDeviceManipulationInfo>(pDriver, eDeviceClass, vr::k_unTrackedDeviceIndexInvalid, _this);
-	_openvrDeviceInfos.emplace(pDriver, info);
+	OpenvrDeviceManipulationInfo* info;
+	auto existingInfo = _driverToDeviceInfoMap.find(pDriver);
+	if (existingInfo) {
+		info = existingInfo;
+	} else {
+		auto newInfo = std::make_shared<OpenvrDeviceManipulationInfo>(pDriver, eDeviceClass, vr::k_unTrackedDeviceIndexInvalid, _this);
+		_openvrDeviceInfos.push_back(newInfo);
+		if (!_driverToDeviceInfoMap.insert(pDriver, newInfo.get())) {
+			LOG(ERROR) << "Detour::deviceAddedDetourFunc: Too many devices, " << pchDeviceSerialNumber << " cannot be manipulated";
+		}
+		info = newInfo.get();
+	}
 	
 	// Redirect TriggerHapticPulse() function
 	vr::IVRControllerComponent* controllerComponent = (vr::IVRControllerComponent*)pDriver->GetComponent(vr::IVRControllerComponent_Version);
@@ -215,13 +234,15 @@ bool CServerDriver::_deviceAddedDetourFunc(vr::IVRServerDriverHost* _this, const
 		}
 		if (!foundEntry2) {
 			_deviceTriggerHapticPulseDetours.emplace_back();
-			auto& d = _deviceTriggerHapticPulseDetours[_deviceTriggerHapticPulseDetours.size() - 1];
+			auto& d = _deviceTriggerHapticPulseDetours.back();
 			MH_STATUS mhError;
 			CREATE_MH_HOOK(d, _deviceTriggerHapticPulseDetourFunc, "deviceTriggerHapticPulseDetour", controllerComponent, 1);
 			foundEntry2 = &d;
 		}
 		info->setControllerComponent(controllerComponent, foundEntry2->origFunc);
-		_controllerComponentToDeviceInfos.insert({controllerComponent, info});
+		if (!_controllerComponentToDeviceInfos.assign(controllerComponent, info)) {
+			LOG(ERROR) << "Detour::deviceAddedDetourFunc: Too many devices, haptic pulses of " << pchDeviceSerialNumber << " cannot be manipulated";
+		}
 	}
 
 	return _deviceAddedDetour.origFunc(_this, pchDeviceSerialNumber, eDeviceClass, pDriver);
@@ -247,12 +268,37 @@ vr::EVRInitError CServerDriver::Init(vr::IVRDriverContext *pDriverContext) {
 
 	// Start IPC thread
 	shmCommunicator.init(this);
+
+	// Start pose resampling thread
+	_poseResamplingThreadStop = false;
+	_poseResamplingThread = std::thread(_poseResamplingThreadFunc, this);
+
+	// Start haptic thread
+	_hapticThreadStop = false;
+	_hapticThread = std::thread(_hapticThreadFunc, this);
 	return vr::VRInitError_None;
 }
 
 void CServerDriver::Cleanup() {
 	LOG(TRACE) << "CServerDriver::Cleanup()";
 
+	if (_poseResamplingThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(_poseResamplingMutex);
+			_poseResamplingThreadStop = true;
+		}
+		_poseResamplingCond.notify_all();
+		_poseResamplingThread.join();
+	}
+	if (_hapticThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(_hapticMutex);
+			_hapticThreadStop = true;
+		}
+		_hapticCond.notify_all();
+		_hapticThread.join();
+	}
+
 	REMOVE_MH_HOOK(_deviceAddedDetour);
 	REMOVE_MH_HOOK(_poseUpatedDetour);
 	REMOVE_MH_HOOK(_buttonPressedDetour);
@@ -283,10 +329,18 @@ void CServerDriver::RunFrame() {
 	}*/
 	for (int i = 0; i < vr::k_unMaxTrackedDeviceCount; ++i) {
 		auto vd = m_virtualDevices[i];
-		if (vd && vd->published() && vd->periodicPoseUpdates()) {
+		if (vd && vd->published() && vd->periodicPoseUpdates() && !vd->poseResampling()) {
 			vd->sendPoseUpdate();
 		}
 	}
+	if (_axisCoalescingEnabled) {
+		std::lock_guard<std::recursive_mutex> lock(_axisCoalescingMutex);
+		auto now = std::chrono::steady_clock::now();
+		if (now >= _axisCoalescingNextFlush) {
+			_flushAxisEvents();
+			_axisCoalescingNextFlush = now + std::chrono::milliseconds(_axisCoalescingIntervalMs);
+		}
+	}
 }
 
 int32_t CServerDriver::virtualDevices_addDevice(VirtualDeviceType type, const std::string& serial) {
@@ -309,9 +363,14 @@ int32_t CServerDriver::virtualDevices_addDevice(VirtualDeviceType type, const st
 	}
 	switch (type) {
 		case VirtualDeviceType::TrackedController: {
-			m_virtualDevices[virtualDeviceId] = std::make_shared<CTrackedControllerDriver>(this, serial);
+			auto device = std::make_shared<CTrackedControllerDriver>(this, serial, virtualDeviceId);
+			m_virtualDevices[virtualDeviceId] = device;
 			LOG(INFO) << "Added new tracked controller:  type " << (int)type << ", serial \"" << serial << "\", emulatedDeviceId " << virtualDeviceId;
 			m_virtualDeviceCount++;
+			_mirrorVirtualDevicePose(virtualDeviceId, device->driverPose());
+			_mirrorVirtualControllerState(virtualDeviceId, device->controllerState());
+			_mirrorVirtualDeviceInfo(device.get());
+			shmCommunicator.notify(DeviceNotificationClass::VirtualDevices, { DeviceNotificationType::VirtualDeviceAdded, virtualDeviceId, deviceManipulation_getInfoSequence() });
 			return virtualDeviceId;
 		}
 		default:
@@ -334,6 +393,7 @@ int32_t CServerDriver::virtualDevices_publishDevice(uint32_t emulatedDeviceId, b
 		try {
 			device->publish();
 			LOG(INFO) << "Published tracked controller: virtualDeviceId " << emulatedDeviceId;
+			shmCommunicator.notify(DeviceNotificationClass::VirtualDevices, { DeviceNotificationType::VirtualDevicePublished, emulatedDeviceId, deviceManipulation_getInfoSequence() });
 		} catch (std::exception& e) {
 			LOG(ERROR) << "Error while publishing controller " << emulatedDeviceId << ": " << e.what();
 			return -4;
@@ -342,6 +402,148 @@ int32_t CServerDriver::virtualDevices_publishDevice(uint32_t emulatedDeviceId, b
 	}
 }
 
+void CServerDriver::_poseResamplingChanged() {
+	{
+		std::lock_guard<std::mutex> lock(_poseResamplingMutex);
+		_poseResamplingDirty = true;
+	}
+	_poseResamplingCond.notify_all();
+}
+
+// Emits resampled poses independent of RunFrame. Sleeps until the earliest deadline of all resampling devices.
+void CServerDriver::_poseResamplingThreadFunc(CServerDriver* _this) {
+	LOG(DEBUG) << "Pose resampling thread started";
+	std::shared_ptr<CTrackedDeviceDriver> devices[vr::k_unMaxTrackedDeviceCount];
+	std::unique_lock<std::mutex> lock(_this->_poseResamplingMutex);
+	while (!_this->_poseResamplingThreadStop) {
+		_this->_poseResamplingDirty = false;
+		lock.unlock();
+		// The ipc thread adds and removes devices concurrently, so work on a snapshot
+		uint32_t deviceCount = 0;
+		{
+			std::lock_guard<std::recursive_mutex> devicesLock(_this->_virtualDevicesMutex);
+			for (uint32_t i = 0; i < vr::k_unMaxTrackedDeviceCount; ++i) {
+				if (_this->m_virtualDevices[i]) {
+					devices[deviceCount++] = _this->m_virtualDevices[i];
+				}
+			}
+		}
+		int64_t next = INT64_MAX;
+		auto now = ipc::timestampNow();
+		for (uint32_t i = 0; i < deviceCount; ++i) {
+			auto& vd = devices[i];
+			if (vd->published() && vd->poseResampling()) {
+				auto deviceNext = vd->resamplePose(now);
+				if (deviceNext < next) {
+					next = deviceNext;
+				}
+			}
+			vd.reset(); // don't keep removed devices alive while sleeping
+		}
+		lock.lock();
+		auto wakeUp = [_this]() { return _this->_poseResamplingThreadStop || _this->_poseResamplingDirty; };
+		if (next == INT64_MAX) {
+			_this->_poseResamplingCond.wait(lock, wakeUp);
+		} else {
+			auto delay = next - ipc::timestampNow();
+			if (delay > 0) {
+				_this->_poseResamplingCond.wait_for(lock, std::chrono::nanoseconds(delay), wakeUp);
+			}
+		}
+	}
+	LOG(DEBUG) << "Pose resampling thread stopped";
+}
+
+bool CServerDriver::_scheduleHapticPulse(OpenvrDeviceManipulationInfo* device, uint32_t axisId, uint16_t durationMicroseconds) {
+	auto openvrId = device->openvrId();
+	if (openvrId >= vr::k_unMaxTrackedDeviceCount || axisId >= vr::k_unControllerStateAxisCount || !_hapticThread.joinable()) {
+		return device->_dispatchHapticPulse(axisId, durationMicroseconds);
+	}
+	bool wakeUp = false;
+	{
+		std::lock_guard<std::mutex> lock(_hapticMutex);
+		auto& lane = _hapticLanes[openvrId][axisId];
+		if (lane.pending) {
+			if (durationMicroseconds > lane.durationMicroseconds) {
+				lane.durationMicroseconds = durationMicroseconds;
+			}
+		} else {
+			auto now = std::chrono::steady_clock::now();
+			auto earliest = lane.lastDispatch + _hapticMinInterval;
+			lane.device = device;
+			lane.pending = true;
+			lane.durationMicroseconds = durationMicroseconds;
+			lane.due = earliest > now ? earliest : now;
+			_hapticPendingCount++;
+			wakeUp = true;
+		}
+	}
+	if (wakeUp) {
+		_hapticCond.notify_one();
+	}
+	return true;
+}
+
+// Sends queued haptic pulses, so neither the game's thread nor the device mutex waits for the hardware
+void CServerDriver::_hapticThreadFunc(CServerDriver* _this) {
+	LOG(DEBUG) << "Haptic thread started";
+	struct _Pulse {
+		OpenvrDeviceManipulationInfo* device;
+		uint32_t openvrId;
+		uint32_t axisId;
+		uint16_t durationMicroseconds;
+		bool sent;
+	};
+	std::vector<_Pulse> duePulses;
+	std::unique_lock<std::mutex> lock(_this->_hapticMutex);
+	while (!_this->_hapticThreadStop) {
+		auto now = std::chrono::steady_clock::now();
+		auto next = std::chrono::steady_clock::time_point::max();
+		duePulses.clear();
+		for (uint32_t i = 0; i < vr::k_unMaxTrackedDeviceCount; ++i) {
+			for (uint32_t a = 0; a < vr::k_unControllerStateAxisCount; ++a) {
+				auto& lane = _this->_hapticLanes[i][a];
+				if (!lane.pending) {
+					continue;
+				} else if (lane.due <= now) {
+					duePulses.push_back({ lane.device, i, a, lane.durationMicroseconds, false });
+					lane.pending = false;
+					lane.lastDispatch = now;
+					_this->_hapticPendingCount--;
+				} else if (lane.due < next) {
+					next = lane.due;
+				}
+			}
+		}
+		if (!duePulses.empty()) {
+			lock.unlock();
+			for (auto& p : duePulses) {
+				p.sent = p.device->_dispatchHapticPulse(p.axisId, p.durationMicroseconds);
+			}
+			lock.lock();
+			for (auto& p : duePulses) {
+				auto& lane = _this->_hapticLanes[p.openvrId][p.axisId];
+				if (lane.failing == p.sent) {
+					lane.failing = !p.sent;
+					if (p.sent) {
+						LOG(INFO) << "Device " << p.openvrId << " accepts haptic pulses on axis " << p.axisId << " again";
+					} else {
+						LOG(WARNING) << "Device " << p.openvrId << " rejected a haptic pulse on axis " << p.axisId;
+					}
+				}
+			}
+			continue; // more pulses may have been queued meanwhile
+		}
+		auto wakeUp = [_this]() { return _this->_hapticThreadStop || _this->_hapticPendingCount > 0; };
+		if (next == std::chrono::steady_clock::time_point::max()) {
+			_this->_hapticCond.wait(lock, wakeUp);
+		} else {
+			_this->_hapticCond.wait_until(lock, next);
+		}
+	}
+	LOG(DEBUG) << "Haptic thread stopped";
+}
+
 void CServerDriver::_trackedDeviceActivated(uint32_t deviceId, CTrackedDeviceDriver * device) {
 	m_openvrIdToVirtualDeviceMap[deviceId] = device;
 }
@@ -351,6 +553,11 @@ void CServerDriver::_trackedDeviceDeactivated(uint32_t deviceId) {
 }
 
 void CServerDriver::openvr_buttonEvent(uint32_t unWhichDevice, ButtonEventType eventType, vr::EVRButtonId eButtonId, double eventTimeOffset) {
+	if (_axisCoalescingEnabled) {
+		// Axis changes received before this button event must not arrive after it
+		std::lock_guard<std::recursive_mutex> lock(_axisCoalescingMutex);
+		_flushAxisEvents();
+	}
 	auto devicePtr = this->m_openvrIdToVirtualDeviceMap[unWhichDevice];
 	if (devicePtr && devicePtr->deviceType() == VirtualDeviceType::TrackedController) {
 		((CTrackedControllerDriver*)devicePtr)->buttonEvent(eventType, eButtonId, eventTimeOffset);
@@ -384,6 +591,46 @@ void CServerDriver::openvr_buttonEvent(uint32_t unWhichDevice, ButtonEventType e
 }
 
 void CServerDriver::openvr_axisEvent(uint32_t unWhichDevice, uint32_t unWhichAxis, const vr::VRControllerAxis_t & axisState) {
+	if (_axisCoalescingEnabled && unWhichDevice < vr::k_unMaxTrackedDeviceCount && unWhichAxis < vr::k_unControllerStateAxisCount) {
+		std::lock_guard<std::recursive_mutex> lock(_axisCoalescingMutex);
+		if (_axisCoalescingEnabled) {
+			auto& index = _pendingAxisEventIndex[unWhichDevice][unWhichAxis];
+			if (index) {
+				_pendingAxisEvents[index - 1].axisState = axisState;
+			} else {
+				_pendingAxisEvents.push_back({ unWhichDevice, unWhichAxis, axisState });
+				index = (uint16_t)_pendingAxisEvents.size();
+			}
+			return;
+		}
+	}
+	_sendAxisEvent(unWhichDevice, unWhichAxis, axisState);
+}
+
+void CServerDriver::openvr_setAxisEventCoalescing(bool enable, uint32_t flushIntervalMs) {
+	std::lock_guard<std::recursive_mutex> lock(_axisCoalescingMutex);
+	if (!enable) {
+		_flushAxisEvents();
+	}
+	_axisCoalescingEnabled = enable;
+	_axisCoalescingIntervalMs = flushIntervalMs;
+	_axisCoalescingNextFlush = std::chrono::steady_clock::now();
+	LOG(INFO) << "Axis event coalescing " << (enable ? "enabled" : "disabled") << " (flush interval " << flushIntervalMs << "ms)";
+}
+
+void CServerDriver::_flushAxisEvents() {
+	for (auto& e : _pendingAxisEvents) {
+		_pendingAxisEventIndex[e.deviceId][e.axisId] = 0;
+		try {
+			_sendAxisEvent(e.deviceId, e.axisId, e.axisState);
+		} catch (std::exception& ex) {
+			LOG(ERROR) << "Error while sending coalesced axis event: " << ex.what();
+		}
+	}
+	_pendingAxisEvents.clear();
+}
+
+void CServerDriver::_sendAxisEvent(uint32_t unWhichDevice, uint32_t unWhichAxis, const vr::VRControllerAxis_t & axisState) {
 	auto devicePtr = this->m_openvrIdToVirtualDeviceMap[unWhichDevice];
 	if (devicePtr && devicePtr->deviceType() == VirtualDeviceType::TrackedController) {
 		((CTrackedControllerDriver*)devicePtr)->axisEvent(unWhichAxis, axisState);
@@ -400,11 +647,7 @@ void CServerDriver::openvr_axisEvent(uint32_t unWhichDevice, uint32_t unWhichAxi
 
 void CServerDriver::openvr_poseUpdate(uint32_t unWhichDevice, vr::DriverPose_t & newPose, int64_t timestamp) {
 	auto devicePtr = this->m_openvrIdToVirtualDeviceMap[unWhichDevice];
-	auto now = std::chrono::duration_cast <std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-	auto diff = 0.0;
-	if (timestamp < now) {
-		diff = ((double)now - timestamp) / 1000.0;
-	}
+	auto diff = ipc::timestampAge(timestamp);
 	if (devicePtr) {
 		devicePtr->updatePose(newPose, -diff);
 	} else {
@@ -470,60 +713,182 @@ OpenvrDeviceManipulationInfo* CServerDriver::deviceManipulation_getInfo(uint32_t
 }
 
 
-void CServerDriver::motionCompensation_setCenterPos(const vr::HmdVector3d_t& centerPos, bool relativeToDevice) {
-	_motionCompensationCenterPosRaw = centerPos;
-	_motionCompensationCenterRawIsRelative = relativeToDevice;
-	if (relativeToDevice && _motionCompensationZeroPoseValid) {
-		_motionCompensationCenterPosZero = _motionCompensationZeroPos + _motionCompensationCenterPosRaw;
-	} else if (!relativeToDevice) {
-		_motionCompensationCenterPosZero = _motionCompensationCenterPosRaw;
+void CServerDriver::_mirrorVirtualDeviceInfo(CTrackedDeviceDriver* device) {
+	auto state = shmCommunicator.sharedState();
+	auto id = device->virtualDeviceId();
+	if (state && id < vr::k_unMaxTrackedDeviceCount) {
+		// Read under the lock too, so that the last store always carries the latest values
+		std::lock_guard<std::mutex> lock(_sharedStateWriteMutex);
+		ipc::SharedVirtualDeviceInfo info;
+		memset(&info, 0, sizeof(info));
+		info.valid = true;
+		info.openvrDeviceId = device->openvrDeviceId();
+		info.deviceType = device->deviceType();
+		strncpy_s(info.deviceSerial, device->serialNumber().c_str(), 127);
+		state->virtualDevices[id].info.store(info);
 	}
 }
 
-void CServerDriver::_enableMotionCompensation(bool enable) {
-	_motionCompensationZeroPoseValid = false;
-	_motionCompensationRefPoseValid = false;
-	_motionCompensationEnabled = enable;
+void CServerDriver::_mirrorVirtualDevicePose(uint32_t virtualDeviceId, const vr::DriverPose_t& pose) {
+	auto state = shmCommunicator.sharedState();
+	if (state && virtualDeviceId < vr::k_unMaxTrackedDeviceCount) {
+		state->virtualDevices[virtualDeviceId].pose.store(pose);
+	}
 }
 
-bool CServerDriver::_isMotionCompensationZeroPoseValid() {
-	return _motionCompensationZeroPoseValid;
+void CServerDriver::_mirrorVirtualControllerState(uint32_t virtualDeviceId, const vr::VRControllerState_t& controllerState) {
+	auto state = shmCommunicator.sharedState();
+	if (state && virtualDeviceId < vr::k_unMaxTrackedDeviceCount) {
+		state->virtualDevices[virtualDeviceId].controllerState.store(controllerState);
+	}
 }
 
-void CServerDriver::_setMotionCompensationZeroPose(const vr::DriverPose_t& pose) {
-	_motionCompensationZeroPos = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecPosition, true) - pose.vecWorldFromDriverTranslation;
-	if (_motionCompensationCenterRawIsRelative) {
-		_motionCompensationCenterPosZero = _motionCompensationZeroPos + _motionCompensationCenterPosRaw;
-	} else {
-		_motionCompensationCenterPosZero = _motionCompensationCenterPosRaw;
-	}
-	_motionCompensationZeroRot = vrmath::quaternionConjugate(pose.qWorldFromDriverRotation) * pose.qRotation;
-	_motionCompensationZeroPoseValid = true;
-}
-
-void CServerDriver::_updateMotionCompensationRefPose(const vr::DriverPose_t& pose) {
-	auto poseWorldRot = vrmath::quaternionConjugate(pose.qWorldFromDriverRotation) * pose.qRotation;
-	_motionCompensationRotDiff = poseWorldRot * vrmath::quaternionConjugate(_motionCompensationZeroRot);
-	auto poseWorldPos = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecPosition, true) - pose.vecWorldFromDriverTranslation;
-	_motionCompensationCenterPosCur = poseWorldPos + vrmath::quaternionRotateVector(_motionCompensationRotDiff, _motionCompensationCenterPosZero - _motionCompensationZeroPos);
-	_motionCompensationRefPoseValid = true;
-}
-
-bool CServerDriver::_applyMotionCompensation(vr::DriverPose_t& pose) {
-	if (_motionCompensationEnabled && _motionCompensationZeroPoseValid && _motionCompensationRefPoseValid) {
-		auto poseWorldRot = vrmath::quaternionConjugate(pose.qWorldFromDriverRotation) * pose.qRotation;
-		auto adjPoseWorldRot = vrmath::quaternionConjugate(_motionCompensationRotDiff) * poseWorldRot;
-		pose.qRotation = pose.qWorldFromDriverRotation * adjPoseWorldRot;
-		auto poseWorldPos = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecPosition, true) - pose.vecWorldFromDriverTranslation;
-		auto adjPoseWorldPos = _motionCompensationCenterPosZero + vrmath::quaternionRotateVector(_motionCompensationRotDiff, poseWorldPos - _motionCompensationCenterPosCur, true);
-		auto adjPoseDriverPos = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, adjPoseWorldPos) + pose.vecWorldFromDriverTranslation;
-		pose.vecPosition[0] = adjPoseDriverPos.v[0];
-		pose.vecPosition[1] = adjPoseDriverPos.v[1];
-		pose.vecPosition[2] = adjPoseDriverPos.v[2];
+void CServerDriver::_mirrorDeviceOffsets(OpenvrDeviceManipulationInfo* info) {
+	auto state = shmCommunicator.sharedState();
+	auto id = info->openvrId();
+	if (state && id < vr::k_unMaxTrackedDeviceCount) {
+		std::lock_guard<std::mutex> lock(_sharedStateWriteMutex);
+		ipc::SharedDeviceOffsets offsets;
+		memset(&offsets, 0, sizeof(offsets));
+		offsets.valid = true;
+		info->getOffsets(offsets.offsets);
+		state->deviceOffsets[id].store(offsets);
+	}
+}
+
+void CServerDriver::_deviceInfoChanged(uint32_t openvrId, DeviceNotificationType type) {
+	auto sequence = _deviceInfoSequence.fetch_add(1, std::memory_order_acq_rel) + 1;
+	if (sequence == 0) {
+		sequence = _deviceInfoSequence.fetch_add(1, std::memory_order_acq_rel) + 1; // 0 means "nothing known" to clients
+	}
+	shmCommunicator.notify(DeviceNotificationClass::DeviceInfo, { type, openvrId, sequence });
+}
+
+
+bool CServerDriver::deviceRouting_setRoutes(const DeviceRoute* routes, uint32_t count) {
+	std::lock_guard<std::mutex> lock(_routingMutex);
+	std::vector<DeviceRoute> clientRoutes(routes, routes + count);
+	if (!_publishRoutingTable(clientRoutes)) {
+		return false;
+	}
+	_clientRoutes = std::move(clientRoutes);
+	return true;
+}
+
+bool CServerDriver::_setDeviceModeRoutes(uint32_t openvrId, const DeviceRoute* routes, uint32_t count) {
+	if (openvrId >= vr::k_unMaxTrackedDeviceCount) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(_routingMutex);
+	if (count == 0 && _modeRoutes[openvrId].empty()) {
 		return true;
-	} else {
+	}
+	// Only keep the new routes when the table with them compiles
+	std::vector<DeviceRoute> modeRoutes(routes, routes + count);
+	_modeRoutes[openvrId].swap(modeRoutes);
+	if (!_publishRoutingTable(_clientRoutes)) {
+		_modeRoutes[openvrId].swap(modeRoutes);
+		LOG(ERROR) << "Could not compile the mode routes of device " << openvrId;
+		return false;
+	}
+	return true;
+}
+
+bool CServerDriver::_publishRoutingTable(const std::vector<DeviceRoute>& clientRoutes) {
+	std::vector<DeviceRoute> routes(clientRoutes);
+	for (auto& r : _modeRoutes) {
+		routes.insert(routes.end(), r.begin(), r.end());
+	}
+	std::shared_ptr<DeviceRoutingTable> table;
+	if (!routes.empty()) {
+		table = std::make_shared<DeviceRoutingTable>();
+		if (!table->compile(routes)) {
+			return false;
+		}
+	}
+	std::atomic_store(&_routingTable, std::shared_ptr<const DeviceRoutingTable>(table));
+	_routingTableVersion.fetch_add(1, std::memory_order_release);
+	LOG(DEBUG) << "Published routing table with " << routes.size() << " routes";
+	return true;
+}
+
+
+void CServerDriver::motionCompensation_setCenterPos(uint32_t group, const vr::HmdVector3d_t& centerPos, bool relativeToDevice) {
+	if (group >= MOTIONCOMPENSATION_MAXGROUPS) {
+		return;
+	}
+	auto& g = _motionCompensationGroups[group];
+	std::lock_guard<std::mutex> lock(g.writeMutex);
+	g.state.modify([&](MotionCompensationState& s) {
+		s.setCenter(centerPos, relativeToDevice);
+	});
+}
+
+void CServerDriver::_enableMotionCompensation(uint32_t group, bool enable) {
+	if (group >= MOTIONCOMPENSATION_MAXGROUPS) {
+		return;
+	}
+	auto& g = _motionCompensationGroups[group];
+	std::lock_guard<std::mutex> lock(g.writeMutex);
+	g.enabled = false;
+	g.state.modify([](MotionCompensationState& s) {
+		s.zeroPoseValid = false;
+		s.refPoseValid = false;
+	});
+	g.enabled = enable;
+}
+
+bool CServerDriver::_claimMotionCompensationGroup(uint32_t group) {
+	if (group >= MOTIONCOMPENSATION_MAXGROUPS) {
+		return false;
+	}
+	auto& g = _motionCompensationGroups[group];
+	std::lock_guard<std::mutex> lock(g.writeMutex);
+	if (g.enabled) {
+		return false;
+	}
+	g.state.modify([](MotionCompensationState& s) {
+		s.zeroPoseValid = false;
+		s.refPoseValid = false;
+	});
+	g.enabled = true;
+	return true;
+}
+
+bool CServerDriver::_isMotionCompensationZeroPoseValid(uint32_t group) {
+	return group < MOTIONCOMPENSATION_MAXGROUPS && _motionCompensationGroups[group].state.load().zeroPoseValid;
+}
+
+void CServerDriver::_setMotionCompensationZeroPose(uint32_t group, const vr::DriverPose_t& pose) {
+	if (group >= MOTIONCOMPENSATION_MAXGROUPS) {
+		return;
+	}
+	auto& g = _motionCompensationGroups[group];
+	std::lock_guard<std::mutex> lock(g.writeMutex);
+	g.state.modify([&](MotionCompensationState& s) {
+		s.setZeroPose(pose);
+	});
+}
+
+void CServerDriver::_updateMotionCompensationRefPose(uint32_t group, const vr::DriverPose_t& pose) {
+	if (group >= MOTIONCOMPENSATION_MAXGROUPS) {
+		return;
+	}
+	auto& g = _motionCompensationGroups[group];
+	auto refPoseTime = ipc::timestampNow() + (int64_t)(pose.poseTimeOffset * 1.0e9);
+	std::lock_guard<std::mutex> lock(g.writeMutex);
+	// Writers are serialized, so the current state can be read directly and only the result needs to be published
+	auto s = g.state.load();
+	s.updateReference(pose, refPoseTime);
+	g.state.store(s);
+}
+
+bool CServerDriver::_applyMotionCompensation(uint32_t group, vr::DriverPose_t& pose) {
+	if (group >= MOTIONCOMPENSATION_MAXGROUPS || !_motionCompensationGroups[group].enabled) {
 		return false;
 	}
+	auto poseTime = ipc::timestampNow() + (int64_t)(pose.poseTimeOffset * 1.0e9);
+	return _motionCompensationGroups[group].state.load().apply(pose, poseTime, _motionCompensationMaxExtrapolation);
 }
 
 } // end namespace driver
@@ -1,6 +1,8 @@
 
 #include "stdafx.h"
 #include "driver_vrinputemulator.h"
+#include <ipc_protocol.h>
+#include <openvr_math.h>
 
 namespace vrinputemulator {
 namespace driver {
@@ -23,11 +25,14 @@ vr::EVRInitError CTrackedDeviceDriver::Activate(uint32_t unObjectId) {
 	m_propertyContainer = vr::VRProperties()->TrackedDeviceToPropertyContainer(unObjectId);
 	m_openvrId = unObjectId;
 	m_serverDriver->_trackedDeviceActivated(m_openvrId, this);
-	for (auto& e : _deviceProperties) {
-		auto errorMessage = boost::apply_visitor(DevicePropertyValueVisitor(m_propertyContainer, (vr::ETrackedDeviceProperty)e.first), e.second);
-		if (!errorMessage.empty()) {
-			LOG(ERROR) << "Could not set tracked device property: " << errorMessage;
+	m_serverDriver->_mirrorVirtualDeviceInfo(this);
+	if (!_deviceProperties.empty()) {
+		std::vector<vr::ETrackedDeviceProperty> props;
+		props.reserve(_deviceProperties.size());
+		for (auto& e : _deviceProperties) {
+			props.push_back(e.deviceProperty);
 		}
+		_writeTrackedDeviceProperties(props.data(), props.size());
 	}
 	return vr::VRInitError_None;
 }
@@ -38,6 +43,7 @@ void CTrackedDeviceDriver::Deactivate() {
 	std::lock_guard<std::recursive_mutex> lock(_mutex);
 	m_serverDriver->_trackedDeviceDeactivated(m_openvrId);
 	m_openvrId = vr::k_unTrackedDeviceIndexInvalid;
+	m_serverDriver->_mirrorVirtualDeviceInfo(this);
 }
 
 
@@ -56,12 +62,65 @@ vr::DriverPose_t CTrackedDeviceDriver::GetPose() {
 }
 
 
+void CTrackedDeviceDriver::_writeTrackedDeviceProperties(const vr::ETrackedDeviceProperty* props, size_t count) {
+	_devicePropertyWrites.clear();
+	for (size_t i = 0; i < count; ++i) {
+		vr::PropertyWrite_t write;
+		memset(&write, 0, sizeof(vr::PropertyWrite_t));
+		write.prop = props[i];
+		auto value = _deviceProperties.find(props[i]);
+		if (!value) {
+			write.writeType = vr::PropertyWrite_Erase;
+		} else if (!value->toPropertyWrite(write)) {
+			LOG(ERROR) << "Could not set tracked device property " << props[i] << ": Unknown value type";
+			continue;
+		}
+		_devicePropertyWrites.push_back(write);
+	}
+	if (!_devicePropertyWrites.empty()) {
+		vr::VRPropertiesRaw()->WritePropertyBatch(m_propertyContainer, _devicePropertyWrites.data(), (uint32_t)_devicePropertyWrites.size());
+		for (auto& w : _devicePropertyWrites) {
+			if (w.eError != vr::TrackedProp_Success) {
+				LOG(ERROR) << "Could not set tracked device property " << w.prop << ": OpenVR returned an error: " << (int)w.eError;
+			}
+		}
+	}
+}
+
+
+void CTrackedDeviceDriver::updateTrackedDeviceProperties(const std::vector<DevicePropertyUpdate>& updates, bool notify) {
+	LOG(TRACE) << "CTrackedDeviceDriver[" << m_serialNumber << "]::updateTrackedDeviceProperties( " << updates.size() << " )";
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	std::vector<vr::ETrackedDeviceProperty> props;
+	props.reserve(updates.size());
+	for (auto& u : updates) {
+		if (u.remove) {
+			_deviceProperties.remove(u.deviceProperty);
+		} else {
+			_deviceProperties.set(u.deviceProperty, u.value);
+		}
+		props.push_back(u.deviceProperty);
+	}
+	// Only the final state of each property is written, so a property touched twice in the same batch is written once
+	std::sort(props.begin(), props.end());
+	props.erase(std::unique(props.begin(), props.end()), props.end());
+	if (notify && m_openvrId != vr::k_unTrackedDeviceIndexInvalid) {
+		_writeTrackedDeviceProperties(props.data(), props.size());
+	}
+}
+
+
 void CTrackedDeviceDriver::updatePose(const vr::DriverPose_t & newPose, double timeOffset, bool notify) {
 	LOG(TRACE) << "CTrackedDeviceDriver[" << m_serialNumber << "]::updatePose( " << timeOffset << " )";
 	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	auto sampleTime = ipc::timestampNow() + (int64_t)((newPose.poseTimeOffset + timeOffset) * 1.0e9);
+	m_poseResampler.sampleReplaced(m_pose, m_poseSampleTime, sampleTime);
 	m_pose = newPose;
 	m_pose.poseTimeOffset += timeOffset;
-	if (notify && m_openvrId != vr::k_unTrackedDeviceIndexInvalid) {
+	m_poseSampleTime = sampleTime;
+	m_serverDriver->_mirrorVirtualDevicePose(m_virtualDeviceId, m_pose);
+	// When resampling, poses are only sent by the resampling thread
+	if (notify && !m_poseResampler.enabled() && m_openvrId != vr::k_unTrackedDeviceIndexInvalid) {
 		vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_openvrId, m_pose, sizeof(vr::DriverPose_t));
 	}
 }
@@ -70,13 +129,57 @@ void CTrackedDeviceDriver::sendPoseUpdate(double timeOffset, bool onlyWhenConnec
 	LOG(TRACE) << "CTrackedDeviceDriver[" << m_serialNumber << "]::sendPoseUpdate( " << timeOffset << " )";
 	std::lock_guard<std::recursive_mutex> lock(_mutex);
 	if (!onlyWhenConnected || (m_pose.poseIsValid && m_pose.deviceIsConnected)) {
-		m_pose.poseTimeOffset = timeOffset;
 		if (m_openvrId != vr::k_unTrackedDeviceIndexInvalid) {
-			vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_openvrId, m_pose, sizeof(vr::DriverPose_t));
+			auto pose = m_pose;
+			auto age = ipc::timestampAge(m_poseSampleTime);
+			if (age <= m_poseExtrapolationHorizon) {
+				// OpenVR extrapolates from the velocities itself, it only needs to know how old the sample is
+				pose.poseTimeOffset = timeOffset - age;
+			} else {
+				// Don't let the device drift away when the source stops sending
+				vrmath::extrapolatePose(pose, m_poseExtrapolationHorizon);
+				for (unsigned i = 0; i < 3; ++i) {
+					pose.vecVelocity[i] = 0.0;
+					pose.vecAcceleration[i] = 0.0;
+					pose.vecAngularVelocity[i] = 0.0;
+					pose.vecAngularAcceleration[i] = 0.0;
+				}
+				pose.poseTimeOffset = timeOffset;
+			}
+			vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_openvrId, pose, sizeof(vr::DriverPose_t));
 		}
 	}
 }
 
+void CTrackedDeviceDriver::setPoseExtrapolationHorizon(double seconds) {
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	m_poseExtrapolationHorizon = seconds > 0.0 ? seconds : 0.0;
+}
+
+void CTrackedDeviceDriver::setPoseResampling(double delay, double outputRate) {
+	LOG(TRACE) << "CTrackedDeviceDriver[" << m_serialNumber << "]::setPoseResampling( " << delay << ", " << outputRate << " )";
+	{
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		m_poseResampler.configure(delay, outputRate);
+	}
+	m_serverDriver->_poseResamplingChanged();
+}
+
+int64_t CTrackedDeviceDriver::resamplePose(int64_t now) {
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	if (!m_poseResampler.enabled()) {
+		return INT64_MAX;
+	} else if (!m_poseResampler.due(now)) {
+		return m_poseResampler.next();
+	}
+	if (m_openvrId != vr::k_unTrackedDeviceIndexInvalid && m_poseSampleTime != 0 && m_pose.poseIsValid && m_pose.deviceIsConnected) {
+		vr::DriverPose_t pose;
+		m_poseResampler.resample(pose, m_pose, m_poseSampleTime, now, m_poseExtrapolationHorizon);
+		vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_openvrId, pose, sizeof(vr::DriverPose_t));
+	}
+	return m_poseResampler.advance(now);
+}
+
 void CTrackedDeviceDriver::publish() {
 	LOG(TRACE) << "CTrackedDeviceDriver[" << m_serialNumber << "]::publish()";
 	if (!m_published) {
@@ -92,8 +195,8 @@ void CTrackedDeviceDriver::publish() {
 }
 
 
-CTrackedControllerDriver::CTrackedControllerDriver(CServerDriver* parent, const std::string& serial)
-		: CTrackedDeviceDriver(parent, VirtualDeviceType::TrackedController, serial) {
+CTrackedControllerDriver::CTrackedControllerDriver(CServerDriver* parent, const std::string& serial, uint32_t virtualId)
+		: CTrackedDeviceDriver(parent, VirtualDeviceType::TrackedController, serial, virtualId) {
 	memset(&m_ControllerState, 0, sizeof(vr::VRControllerState_t));
 }
 
@@ -122,41 +225,57 @@ void CTrackedControllerDriver::updateControllerState(const vr::VRControllerState
 	if (notify && m_openvrId != vr::k_unTrackedDeviceIndexInvalid) {
 		auto oldState = m_ControllerState;
 		m_ControllerState = newState;
-		// Iterate over buttons and check for state changes
-		for (unsigned i = 0; i < vr::k_EButton_Max; ++i) {
-			auto oldTouchedState = oldState.ulButtonTouched & vr::ButtonMaskFromId((vr::EVRButtonId)i);
-			auto newTouchedState = newState.ulButtonTouched & vr::ButtonMaskFromId((vr::EVRButtonId)i);
-			if (!oldTouchedState && newTouchedState) {
-				LOG(DEBUG) << m_serialNumber << ": ButtonTouch detected: " << i;
-				vr::VRServerDriverHost()->TrackedDeviceButtonTouched(m_openvrId, (vr::EVRButtonId)i, offset);
-			} else if (oldTouchedState && !newTouchedState) {
-				LOG(DEBUG) << m_serialNumber << ": ButtonUntouch detected: " << i;
-				vr::VRServerDriverHost()->TrackedDeviceButtonUntouched(m_openvrId, (vr::EVRButtonId)i, offset);
+		m_serverDriver->_mirrorVirtualControllerState(m_virtualDeviceId, m_ControllerState);
+		// Only visits buttons whose state changed (lowest button id first, touch before press like before)
+		diffControllerState(oldState, newState, [&](unsigned buttonId, ButtonEventType eventType) {
+			auto button = (vr::EVRButtonId)buttonId;
+			switch (eventType) {
+			case ButtonEventType::ButtonTouched:
+				LOG(DEBUG) << m_serialNumber << ": ButtonTouch detected: " << buttonId;
+				vr::VRServerDriverHost()->TrackedDeviceButtonTouched(m_openvrId, button, offset);
+				break;
+			case ButtonEventType::ButtonUntouched:
+				LOG(DEBUG) << m_serialNumber << ": ButtonUntouch detected: " << buttonId;
+				vr::VRServerDriverHost()->TrackedDeviceButtonUntouched(m_openvrId, button, offset);
+				break;
+			case ButtonEventType::ButtonPressed:
+				LOG(DEBUG) << m_serialNumber << ": ButtonPress detected: " << buttonId;
+				vr::VRServerDriverHost()->TrackedDeviceButtonPressed(m_openvrId, button, offset);
+				break;
+			default:
+				LOG(DEBUG) << m_serialNumber << ": ButtonUnpress detected: " << buttonId;
+				vr::VRServerDriverHost()->TrackedDeviceButtonUnpressed(m_openvrId, button, offset);
+				break;
 			}
-			auto oldPressedState = oldState.ulButtonPressed & vr::ButtonMaskFromId((vr::EVRButtonId)i);
-			auto newPressedState = newState.ulButtonPressed & vr::ButtonMaskFromId((vr::EVRButtonId)i);
-			if (!oldPressedState && newPressedState) {
-				LOG(DEBUG) << m_serialNumber << ": ButtonPress detected: " << i;
-				vr::VRServerDriverHost()->TrackedDeviceButtonPressed(m_openvrId, (vr::EVRButtonId)i, offset);
-			} else if (oldPressedState && !newPressedState) {
-				LOG(DEBUG) << m_serialNumber << ": ButtonUnpress detected: " << i;
-				vr::VRServerDriverHost()->TrackedDeviceButtonUnpressed(m_openvrId, (vr::EVRButtonId)i, offset);
-			}
-		}
-		// Iterate over axis and check for state changes
-		for (unsigned i = 0; i < vr::k_unControllerStateAxisCount; ++i) {
-			if (oldState.rAxis[i].x != newState.rAxis[i].x || oldState.rAxis[i].y != newState.rAxis[i].y) {
-				LOG(DEBUG) << m_serialNumber << ": AxisChange detected: " << i;
-				vr::VRServerDriverHost()->TrackedDeviceAxisUpdated(m_openvrId, i, newState.rAxis[i]);
-			}
-		}
+		}, [&](unsigned axisId) {
+			LOG(DEBUG) << m_serialNumber << ": AxisChange detected: " << axisId;
+			vr::VRServerDriverHost()->TrackedDeviceAxisUpdated(m_openvrId, axisId, newState.rAxis[axisId]);
+		});
 	} else {
 		m_ControllerState = newState;
+		m_serverDriver->_mirrorVirtualControllerState(m_virtualDeviceId, m_ControllerState);
+	}
+}
+
+void CTrackedControllerDriver::updateControllerStateDelta(uint32_t packetNum, uint64_t buttonPressed, uint64_t buttonTouched, uint32_t dirtyAxes, const vr::VRControllerAxis_t * axes, double offset, bool notify) {
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	auto newState = m_ControllerState;
+	newState.unPacketNum = packetNum;
+	newState.ulButtonPressed = buttonPressed;
+	newState.ulButtonTouched = buttonTouched;
+	while (dirtyAxes) {
+		auto axisId = lowestSetBit(dirtyAxes);
+		dirtyAxes &= dirtyAxes - 1;
+		if (axisId < vr::k_unControllerStateAxisCount) {
+			newState.rAxis[axisId] = *axes++;
+		}
 	}
+	updateControllerState(newState, offset, notify);
 }
 
 void CTrackedControllerDriver::buttonEvent(ButtonEventType eventType, uint32_t buttonId, double timeOffset, bool notify) {
 	LOG(TRACE) << "CTrackedControllerDriver[" << m_serialNumber << "]::buttonEvent( " << (int)eventType << ", " << buttonId << ", " << timeOffset << " )";
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
 	switch (eventType) {
 		case ButtonEventType::ButtonPressed:
 			m_ControllerState.ulButtonPressed |= vr::ButtonMaskFromId((vr::EVRButtonId)buttonId);
@@ -185,12 +304,15 @@ void CTrackedControllerDriver::buttonEvent(ButtonEventType eventType, uint32_t b
 		default:
 			break;
 	}
+	m_serverDriver->_mirrorVirtualControllerState(m_virtualDeviceId, m_ControllerState);
 }
 
 void CTrackedControllerDriver::axisEvent(uint32_t axisId, const vr::VRControllerAxis_t & axisState, bool notify) {
 	LOG(TRACE) << "CTrackedControllerDriver[" << m_serialNumber << "]::axisEvent( " << axisId << " )";
 	if (axisId < vr::k_unControllerStateAxisCount) {
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
 		m_ControllerState.rAxis[axisId] = axisState;
+		m_serverDriver->_mirrorVirtualControllerState(m_virtualDeviceId, m_ControllerState);
 		if (notify && m_openvrId != vr::k_unTrackedDeviceIndexInvalid) {
 			vr::VRServerDriverHost()->TrackedDeviceAxisUpdated(m_openvrId, axisId, m_ControllerState.rAxis[axisId]);
 		}
@@ -3,14 +3,26 @@
 #include "stdafx.h"
 #include <openvr_driver.h>
 #include <vector>
+#include <deque>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <thread>
-#include <boost/variant.hpp>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include "logging.h"
 #include <vrinputemulator_types.h>
-#include "utils/DevicePropertyValueVisitor.h"
+#include "utils/DevicePropertyStore.h"
+#include "utils/AxisTransform.h"
+#include "utils/ControllerStateDiff.h"
+#include "utils/IpcRequestQueues.h"
+#include "utils/MotionCompensation.h"
+#include "utils/PointerHashMap.h"
+#include "utils/PoseFilter.h"
+#include "utils/PoseResampler.h"
+#include "utils/SeqLock.h"
+#include "utils/DeviceRoutingTable.h"
 #include "com/shm/driver_ipc_shm.h"
 
 
@@ -83,9 +95,22 @@ private:
 	bool m_enableButtonMapping = false;
 	std::map<vr::EVRButtonId, vr::EVRButtonId> m_buttonMapping;
 
+	AxisTransformer m_axisTransforms[vr::k_unControllerStateAxisCount];
+	bool m_axisTransformsEnabled = false; // any of them
+
 	bool m_redirectSuspended = false;
 	OpenvrDeviceManipulationInfo* m_redirectRef = nullptr;
 
+	PoseFilterChain m_poseFilter;
+	uint32_t m_motionCompensationGroup = 0;
+
+	std::shared_ptr<const DeviceRoutingTable> m_routingTable; // cached, refreshed when the published version changes
+	uint32_t m_routingTableVersion = 0;
+	const DeviceRoutingTable::Dispatch* _routes(DeviceRouteChannel channel);
+	bool _isPreempted(const DeviceRoutingTable::Target& target);
+	bool _updateModeRoutes(); // false when the routes could not be installed, the old ones stay
+	void _infoChanged(); // notifies clients about a change of what deviceManipulation_getInfo() reports
+
 public:
 	OpenvrDeviceManipulationInfo() {}
 	OpenvrDeviceManipulationInfo(vr::ITrackedDeviceServerDriver* driver, vr::ETrackedDeviceClass eDeviceClass, uint32_t openvrId, vr::IVRServerDriverHost* driverHost)
@@ -113,27 +138,26 @@ public:
 	int _disableOldMode(int newMode);
 
 	bool areOffsetsEnabled() const { return m_offsetsEnabled; }
-	void enableOffsets(bool enable) { m_offsetsEnabled = enable; }
-	const vr::HmdQuaternion_t& worldFromDriverRotationOffset() const { return m_worldFromDriverRotationOffset; }
-	vr::HmdQuaternion_t& worldFromDriverRotationOffset() { return m_worldFromDriverRotationOffset; }
-	const vr::HmdVector3d_t& worldFromDriverTranslationOffset() const { return m_worldFromDriverTranslationOffset; }
-	vr::HmdVector3d_t& worldFromDriverTranslationOffset() { return m_worldFromDriverTranslationOffset; }
-	const vr::HmdQuaternion_t& driverFromHeadRotationOffset() const { return m_driverFromHeadRotationOffset; }
-	vr::HmdQuaternion_t& driverFromHeadRotationOffset() { return m_driverFromHeadRotationOffset; }
-	const vr::HmdVector3d_t& driverFromHeadTranslationOffset() const { return m_driverFromHeadTranslationOffset; }
-	vr::HmdVector3d_t& driverFromHeadTranslationOffset() { return m_driverFromHeadTranslationOffset; }
-	const vr::HmdQuaternion_t& deviceRotationOffset() const { return m_deviceRotationOffset; }
-	vr::HmdQuaternion_t& deviceRotationOffset() { return m_deviceRotationOffset; }
-	const vr::HmdVector3d_t& deviceTranslationOffset() const { return m_deviceTranslationOffset; }
-	vr::HmdVector3d_t& deviceTranslationOffset() { return m_deviceTranslationOffset; }
+	void enableOffsets(bool enable);
+	void getOffsets(DeviceOffsets& offsets);
+	// Applies the components selected by mask (DeviceOffsetsMask bits) at once, add .. multiply/add instead of replace
+	void setOffsets(const DeviceOffsets& offsets, uint32_t mask, bool add = false);
 
 	bool buttonMappingEnabled() const { return m_enableButtonMapping; }
-	void setButtonMappingEnabled(bool enable) { m_enableButtonMapping = enable; }
+	void setButtonMappingEnabled(bool enable);
 	void addButtonMapping(vr::EVRButtonId button, vr::EVRButtonId mappedButton);
 	bool getButtonMapping(vr::EVRButtonId button, vr::EVRButtonId& mappedButton);
 	void eraseButtonMapping(vr::EVRButtonId button);
 	void eraseAllButtonMappings();
 
+	const AxisTransform& axisTransform(uint32_t axisId) const { return m_axisTransforms[axisId].config(); }
+	void setAxisTransform(const AxisTransform& transform);
+
+	uint32_t motionCompensationGroup() const { return m_motionCompensationGroup; }
+	int setMotionCompensationGroup(uint32_t group);
+	const PoseFilterChain& poseFilter() const { return m_poseFilter; }
+	void setPoseFilter(const PoseFilterStage* stages, uint32_t count);
+
 	bool redirectSuspended() const { return m_redirectSuspended; }
 	OpenvrDeviceManipulationInfo* redirectRef() const { return m_redirectRef; }
 
@@ -141,7 +165,10 @@ public:
 	void handleButtonEvent(vr::IVRServerDriverHost* driver, void* origFunc, uint32_t& unWhichDevice, ButtonEventType eventType, vr::EVRButtonId eButtonId, double eventTimeOffset);
 	void handleAxisEvent(vr::IVRServerDriverHost* driver, _DetourTrackedDeviceAxisUpdated_t origFunc, uint32_t& unWhichDevice, uint32_t unWhichAxis, const vr::VRControllerAxis_t& axisState);
 
+	// Queues the pulse on the haptic lane of the device that should vibrate, never blocks on the hardware
 	bool triggerHapticPulse(uint32_t unAxisId, uint16_t usPulseDurationMicroseconds, bool directMode = false);
+	// Called from the haptic lane
+	bool _dispatchHapticPulse(uint32_t unAxisId, uint16_t usPulseDurationMicroseconds);
 };
 
 
@@ -201,6 +228,9 @@ public:
 
 	void openvr_axisEvent(uint32_t unWhichDevice, uint32_t unWhichAxis, const vr::VRControllerAxis_t& axisState);
 
+	/** When enabled only the latest axis state per device and axis is kept and sent once per frame (or every flushIntervalMs) */
+	void openvr_setAxisEventCoalescing(bool enable, uint32_t flushIntervalMs = 0);
+
 	void openvr_poseUpdate(uint32_t unWhichDevice, vr::DriverPose_t& newPose, int64_t timestamp);
 
 	void openvr_proximityEvent(uint32_t unWhichDevice, bool bProximitySensorTriggered);
@@ -209,7 +239,13 @@ public:
 
 	OpenvrDeviceManipulationInfo* deviceManipulation_getInfo(uint32_t unWhichDevice);
 
-	void motionCompensation_setCenterPos(const vr::HmdVector3d_t& centerPos, bool relativeToDevice);
+	/** Changes whenever a device is added or the manipulation state of a device changes, never 0 */
+	uint32_t deviceManipulation_getInfoSequence() const { return _deviceInfoSequence.load(std::memory_order_acquire); }
+
+	void motionCompensation_setCenterPos(uint32_t group, const vr::HmdVector3d_t& centerPos, bool relativeToDevice);
+
+	/** Replaces all routes set by clients. Returns false (and changes nothing) when a route is invalid. */
+	bool deviceRouting_setRoutes(const DeviceRoute* routes, uint32_t count);
 
 
 	// internal API
@@ -220,11 +256,38 @@ public:
 	/** Called by virtual devices when they are deactivated */
 	void _trackedDeviceDeactivated(uint32_t deviceId);
 
-	void _enableMotionCompensation(bool enable);
-	bool _isMotionCompensationZeroPoseValid();
-	void _setMotionCompensationZeroPose(const vr::DriverPose_t& pose);
-	void _updateMotionCompensationRefPose(const vr::DriverPose_t& pose);
-	bool _applyMotionCompensation(vr::DriverPose_t& pose);
+	// Motion compensation groups are independent, each one has its own reference device and center
+	void _enableMotionCompensation(uint32_t group, bool enable);
+	// Enables the group for a new reference device, fails when it already has one
+	bool _claimMotionCompensationGroup(uint32_t group);
+	bool _isMotionCompensationZeroPoseValid(uint32_t group);
+	void _setMotionCompensationZeroPose(uint32_t group, const vr::DriverPose_t& pose);
+	void _updateMotionCompensationRefPose(uint32_t group, const vr::DriverPose_t& pose);
+	bool _applyMotionCompensation(uint32_t group, vr::DriverPose_t& pose);
+
+	/** Merges the pulse into the device's pending pulse and dispatches it from the haptic thread */
+	bool _scheduleHapticPulse(OpenvrDeviceManipulationInfo* device, uint32_t axisId, uint16_t durationMicroseconds);
+
+	/** Called by virtual devices when their pose resampling settings changed */
+	void _poseResamplingChanged();
+
+	// Mirror the state into the shared memory segment clients read without ipc requests (no-ops when the segment could
+	// not be created). Device info and offsets are written from several threads and serialized by _sharedStateWriteMutex,
+	// pose and controller state only while holding the device's mutex.
+	void _mirrorVirtualDeviceInfo(CTrackedDeviceDriver* device);
+	void _mirrorVirtualDevicePose(uint32_t virtualDeviceId, const vr::DriverPose_t& pose);
+	void _mirrorVirtualControllerState(uint32_t virtualDeviceId, const vr::VRControllerState_t& state);
+	void _mirrorDeviceOffsets(OpenvrDeviceManipulationInfo* info);
+
+	/** Called whenever something reported by deviceManipulation_getInfo() changes, notifies subscribed clients */
+	void _deviceInfoChanged(uint32_t openvrId, DeviceNotificationType type = DeviceNotificationType::DeviceInfoChanged);
+
+	// Routes are compiled into an immutable table which is swapped atomically, devices pick it up on their next event
+	bool _setDeviceModeRoutes(uint32_t openvrId, const DeviceRoute* routes, uint32_t count);
+	uint32_t _getRoutingTableVersion() const { return _routingTableVersion.load(std::memory_order_acquire); }
+	std::shared_ptr<const DeviceRoutingTable> _getRoutingTable() const { return std::atomic_load(&_routingTable); }
+	bool _isRoutingSourceActive(uint32_t openvrId) const { return _routingSourceActive[openvrId].load(std::memory_order_relaxed); }
+	void _setRoutingSourceActive(uint32_t openvrId, bool active) { _routingSourceActive[openvrId].store(active, std::memory_order_relaxed); }
 
 
 private:
@@ -236,29 +299,81 @@ private:
 	std::shared_ptr<CTrackedDeviceDriver> m_virtualDevices[vr::k_unMaxTrackedDeviceCount];
 	CTrackedDeviceDriver* m_openvrIdToVirtualDeviceMap[vr::k_unMaxTrackedDeviceCount];
 
+	// SharedSeqLock allows only one writer per entry at a time
+	std::mutex _sharedStateWriteMutex;
+
+	//// pose resampling related ////
+	std::thread _poseResamplingThread;
+	std::mutex _poseResamplingMutex;
+	std::condition_variable _poseResamplingCond;
+	bool _poseResamplingThreadStop = false;
+	bool _poseResamplingDirty = false; // settings changed, recompute the next deadline
+	static void _poseResamplingThreadFunc(CServerDriver* _this);
+
+	//// haptics related ////
+	struct _HapticLane {
+		OpenvrDeviceManipulationInfo* device = nullptr;
+		bool pending = false;
+		uint16_t durationMicroseconds = 0;
+		std::chrono::steady_clock::time_point due;
+		std::chrono::steady_clock::time_point lastDispatch;
+		bool failing = false; // the last dispatched pulse was rejected, only changes are logged
+	};
+	std::thread _hapticThread;
+	std::mutex _hapticMutex;
+	std::condition_variable _hapticCond;
+	bool _hapticThreadStop = false;
+	uint32_t _hapticPendingCount = 0;
+	_HapticLane _hapticLanes[vr::k_unMaxTrackedDeviceCount][vr::k_unControllerStateAxisCount]; // index == openvrId, axisId
+	// OpenVR drivers accept only one pulse per 5 ms, pulses arriving in between are merged
+	const std::chrono::microseconds _hapticMinInterval{ 5000 };
+	static void _hapticThreadFunc(CServerDriver* _this);
+
 	//// ipc shm related ////
 	IpcShmCommunicator shmCommunicator;
 
 
 	//// openvr device manipulation related ////
 	std::recursive_mutex _openvrDevicesMutex;
-	static std::map<vr::ITrackedDeviceServerDriver*, std::shared_ptr<OpenvrDeviceManipulationInfo>> _openvrDeviceInfos;
+	static std::vector<std::shared_ptr<OpenvrDeviceManipulationInfo>> _openvrDeviceInfos; // owns the infos, never shrinks
+	static PointerHashMap<vr::ITrackedDeviceServerDriver*, OpenvrDeviceManipulationInfo*, 8> _driverToDeviceInfoMap;
 	static OpenvrDeviceManipulationInfo* _openvrIdToDeviceInfoMap[vr::k_unMaxTrackedDeviceCount];
+	std::atomic<uint32_t> _deviceInfoSequence{ 1 };
 
-	//// motion compensation related ////
-	bool _motionCompensationEnabled = false;
-
-	bool _motionCompensationZeroPoseValid = false;
-	vr::HmdVector3d_t _motionCompensationZeroPos;
-	vr::HmdQuaternion_t _motionCompensationZeroRot;
-	
-	vr::HmdVector3d_t _motionCompensationCenterPosRaw;
-	bool _motionCompensationCenterRawIsRelative = false;
-	vr::HmdVector3d_t _motionCompensationCenterPosZero;
+	//// axis event coalescing related ////
+	struct _PendingAxisEvent {
+		uint32_t deviceId;
+		uint32_t axisId;
+		vr::VRControllerAxis_t axisState;
+	};
+	std::recursive_mutex _axisCoalescingMutex;
+	std::atomic<bool> _axisCoalescingEnabled{ false }; // written under _axisCoalescingMutex, checked without it first
+	uint32_t _axisCoalescingIntervalMs = 0;
+	std::chrono::steady_clock::time_point _axisCoalescingNextFlush;
+	std::vector<_PendingAxisEvent> _pendingAxisEvents; // one entry per device and axis, in order of first update
+	uint16_t _pendingAxisEventIndex[vr::k_unMaxTrackedDeviceCount][vr::k_unControllerStateAxisCount]; // index + 1 into _pendingAxisEvents, 0 .. none
+	void _sendAxisEvent(uint32_t unWhichDevice, uint32_t unWhichAxis, const vr::VRControllerAxis_t& axisState);
+	void _flushAxisEvents();
+
+	//// device routing related ////
+	std::mutex _routingMutex;
+	std::vector<DeviceRoute> _clientRoutes;
+	std::vector<DeviceRoute> _modeRoutes[vr::k_unMaxTrackedDeviceCount]; // installed by redirect/swap modes, per device
+	std::shared_ptr<const DeviceRoutingTable> _routingTable; // nullptr .. no routes, only accessed through atomic_load/atomic_store
+	std::atomic<uint32_t> _routingTableVersion{ 0 };
+	std::atomic<bool> _routingSourceActive[vr::k_unMaxTrackedDeviceCount];
+	bool _publishRoutingTable(const std::vector<DeviceRoute>& clientRoutes);
 
-	bool _motionCompensationRefPoseValid = false;
-	vr::HmdVector3d_t _motionCompensationCenterPosCur;
-	vr::HmdQuaternion_t _motionCompensationRotDiff;
+	//// motion compensation related ////
+	// Written from the reference device's pose updates and ipc, read from every other device's pose updates (possibly
+	// on other threads). Readers get a consistent snapshot without locking, writers are serialized by the mutex.
+	struct _MotionCompensationGroup {
+		std::atomic<bool> enabled{ false }; // checked before taking a snapshot
+		std::mutex writeMutex;
+		SeqLock<MotionCompensationState> state;
+	};
+	_MotionCompensationGroup _motionCompensationGroups[MOTIONCOMPENSATION_MAXGROUPS];
+	const double _motionCompensationMaxExtrapolation = 0.05; // seconds
 
 	//// function hooks related ////
 
@@ -290,13 +405,14 @@ private:
 	static _DetourFuncInfo<_DetourTrackedDeviceAxisUpdated_t> _axisUpdatedDetour;
 	static void _axisUpdatedDetourFunc(vr::IVRServerDriverHost* _this, uint32_t unWhichDevice, uint32_t unWhichAxis, const vr::VRControllerAxis_t & axisState);
 
-	static std::vector<_DetourFuncInfo<_DetourTrackedDeviceActivate_t>> _deviceActivateDetours;
+	// Deques, because the maps below point into them and push_back must not move existing entries
+	static std::deque<_DetourFuncInfo<_DetourTrackedDeviceActivate_t>> _deviceActivateDetours;
 	static vr::EVRInitError _deviceActivateDetourFunc(vr::ITrackedDeviceServerDriver* _this, uint32_t unObjectId);
-	static std::map<vr::ITrackedDeviceServerDriver*, _DetourFuncInfo<_DetourTrackedDeviceActivate_t>*> _deviceActivateDetourMap; // _this => DetourInfo
+	static PointerHashMap<vr::ITrackedDeviceServerDriver*, _DetourFuncInfo<_DetourTrackedDeviceActivate_t>*, 8> _deviceActivateDetourMap; // _this => DetourInfo
 
-	static std::vector<_DetourFuncInfo<_DetourTriggerHapticPulse_t>> _deviceTriggerHapticPulseDetours;
+	static std::deque<_DetourFuncInfo<_DetourTriggerHapticPulse_t>> _deviceTriggerHapticPulseDetours;
 	static bool _deviceTriggerHapticPulseDetourFunc(vr::IVRControllerComponent* _this, uint32_t unAxisId, uint16_t usPulseDurationMicroseconds);
-	static std::map<vr::IVRControllerComponent*, std::shared_ptr<OpenvrDeviceManipulationInfo>> _controllerComponentToDeviceInfos; // ControllerComponent => ManipulationInfo
+	static PointerHashMap<vr::IVRControllerComponent*, OpenvrDeviceManipulationInfo*, 8> _controllerComponentToDeviceInfos; // ControllerComponent => ManipulationInfo
 };
 
 
@@ -320,8 +436,14 @@ protected:
 	vr::PropertyContainerHandle_t m_propertyContainer = vr::k_ulInvalidPropertyContainer;
 
 	vr::DriverPose_t m_pose;
-	typedef boost::variant<int32_t, uint64_t, float, bool, std::string, vr::HmdMatrix34_t, vr::HmdMatrix44_t, vr::HmdVector3_t, vr::HmdVector4_t> _devicePropertyType_t;
-	std::map<int, _devicePropertyType_t> _deviceProperties;
+	int64_t m_poseSampleTime = 0; // driver clock time m_pose was sampled at
+	double m_poseExtrapolationHorizon = 0.05; // seconds
+	PoseResampler m_poseResampler;
+	DevicePropertyStore _deviceProperties;
+	std::vector<vr::PropertyWrite_t> _devicePropertyWrites; // reused by _writeTrackedDeviceProperties
+
+	// Pushes the current state of the given properties to OpenVR with one batch write (erases the ones no longer in the store)
+	void _writeTrackedDeviceProperties(const vr::ETrackedDeviceProperty* props, size_t count);
 
 public:
 	CTrackedDeviceDriver(CServerDriver* parent, VirtualDeviceType type, const std::string& serial, uint32_t virtualId = vr::k_unTrackedDeviceIndexInvalid);
@@ -352,55 +474,53 @@ public:
 	void publish();
 
 	void updatePose(const vr::DriverPose_t& newPose, double timeOffset, bool notify = true);
+	/** Re-sends the last pose. It is extrapolated to the current time for at most the extrapolation horizon, then held still. */
 	void sendPoseUpdate(double timeOffset = 0.0, bool onlyWhenConnected = true);
 
+	double poseExtrapolationHorizon() { return m_poseExtrapolationHorizon; }
+	void setPoseExtrapolationHorizon(double seconds);
+
+	bool poseResampling() { return m_poseResampler.enabled(); }
+	/** Emits poses at outputRate Hz from the resampling thread, interpolated between the samples around (now - delay). 0 .. disabled */
+	void setPoseResampling(double delay, double outputRate);
+	/** Sends the resampled pose if it is due and returns the driver clock time of the next one */
+	int64_t resamplePose(int64_t now);
+
 	template<class T>
 	T getTrackedDeviceProperty(vr::ETrackedDeviceProperty prop, vr::ETrackedPropertyError * pError) {
 		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		T retval = T();
+		auto error = _deviceProperties.get(prop, retval);
 		if (pError) {
-			*pError = vr::TrackedProp_Success;
-		}
-		auto p = _deviceProperties.find((int)prop);
-		if (p != _deviceProperties.end()) {
-			try {
-				T retval = boost::get<T>(p->second);
-				return retval;
-			} catch (std::exception&) {
-				if (pError) {
-					*pError = vr::TrackedProp_WrongDataType;
-				}
-				return T();
-			}
-		} else {
-			if (pError) {
-				*pError = vr::TrackedProp_ValueNotProvidedByDevice;
-			}
-			return T();
+			*pError = error;
 		}
+		return error == vr::TrackedProp_Success ? retval : T();
 	}
 
 	template<class T>
 	void setTrackedDeviceProperty(vr::ETrackedDeviceProperty prop, const T& value, bool notify = true) {
 		std::lock_guard<std::recursive_mutex> lock(_mutex);
-		_deviceProperties[prop] = value;
+		_deviceProperties.set(prop, value);
 		if (notify && m_openvrId != vr::k_unTrackedDeviceIndexInvalid) {
-			auto errorMessage = boost::apply_visitor(DevicePropertyValueVisitor(m_propertyContainer, prop), _deviceProperties[prop]);
-			if (!errorMessage.empty()) {
-				LOG(ERROR) << "Could not set tracked device property: " << errorMessage;
-			}
+			_writeTrackedDeviceProperties(&prop, 1);
 		}
 	}
 
 	void removeTrackedDeviceProperty(vr::ETrackedDeviceProperty prop, bool notify = true) {
 		std::lock_guard<std::recursive_mutex> lock(_mutex);
-		auto i = _deviceProperties.find(prop);
-		if (i != _deviceProperties.end()) {
-			_deviceProperties.erase(i);
-			if (notify && m_openvrId != vr::k_unTrackedDeviceIndexInvalid) {
-				vr::VRProperties()->EraseProperty(m_propertyContainer, prop);
-			}
+		if (_deviceProperties.remove(prop) && notify && m_openvrId != vr::k_unTrackedDeviceIndexInvalid) {
+			_writeTrackedDeviceProperties(&prop, 1);
 		}
 	}
+
+	struct DevicePropertyUpdate {
+		vr::ETrackedDeviceProperty deviceProperty;
+		bool remove;
+		DevicePropertyValue value;
+	};
+
+	// Applies all updates under one lock and pushes the resulting values to OpenVR with a single property batch write
+	void updateTrackedDeviceProperties(const std::vector<DevicePropertyUpdate>& updates, bool notify = true);
 };
 
 
@@ -415,7 +535,7 @@ private:
 	vr::VRControllerState_t m_ControllerState;
 
 public:
-	CTrackedControllerDriver(CServerDriver* parent, const std::string& serial);
+	CTrackedControllerDriver(CServerDriver* parent, const std::string& serial, uint32_t virtualId);
 
 	// from ITrackedDeviceServerDriver
 
@@ -431,6 +551,7 @@ public:
 	vr::VRControllerState_t& controllerState() { return m_ControllerState; }
 
 	void updateControllerState(const vr::VRControllerState_t& newState, double timeOffset, bool notify = true);
+	void updateControllerStateDelta(uint32_t packetNum, uint64_t buttonPressed, uint64_t buttonTouched, uint32_t dirtyAxes, const vr::VRControllerAxis_t* axes, double timeOffset, bool notify = true);
 	void buttonEvent(ButtonEventType eventType, uint32_t buttonId, double timeOffset, bool notify = true);
 	void axisEvent(uint32_t axisId, const vr::VRControllerAxis_t& axisState, bool notify = true);
 
@@ -0,0 +1,134 @@
+#pragma once
+
+
+#include <openvr_driver.h>
+#include <vrinputemulator_types.h>
+#include <cstring>
+#include <cmath>
+
+namespace vrinputemulator {
+namespace driver {
+
+
+/**
+* An AxisTransform compiled for the event path.
+*
+* The response curve is sampled into a lookup table when configured, so applying it costs the same
+* for every curve type. Not thread-safe, the owner has to synchronize access.
+**/
+class AxisTransformer {
+public:
+	static const unsigned lutSize = 64;
+
+	AxisTransformer() {
+		std::memset(&_config, 0, sizeof(_config));
+		_config.buttonId = AXISTRANSFORM_NOBUTTON;
+		_config.remapAxisId = AXISTRANSFORM_NOREMAP;
+	}
+
+	bool enabled() const { return _config.enabled; }
+	const AxisTransform& config() const { return _config; }
+	bool buttonPressed() const { return _buttonPressed; }
+
+	void configure(const AxisTransform& transform) {
+		_config = transform;
+		if (_config.curvePointCount > AXISCURVE_MAXPOINTS) {
+			_config.curvePointCount = AXISCURVE_MAXPOINTS;
+		}
+		if (_config.saturation <= _config.deadzone || _config.saturation > 1.0f) {
+			_config.saturation = 1.0f;
+		}
+		if (_config.deadzone < 0.0f) {
+			_config.deadzone = 0.0f;
+		}
+		_deadzoneScale = 1.0f / (_config.saturation - _config.deadzone);
+		for (unsigned i = 0; i <= lutSize; ++i) {
+			_lut[i] = _evaluateCurve((float)i / (float)lutSize);
+		}
+		_buttonPressed = false;
+	}
+
+	// Transforms the axis state in place and returns the axis id to send it as.
+	// buttonEvent: 0 .. none, 1 .. button got pressed, 2 .. button got released
+	uint32_t apply(vr::VRControllerAxis_t& state, int& buttonEvent) {
+		buttonEvent = 0;
+		if (_config.swapXY) {
+			auto x = state.x;
+			state.x = state.y;
+			state.y = x;
+		}
+		if (_config.invertX) {
+			state.x = -state.x;
+		}
+		if (_config.invertY) {
+			state.y = -state.y;
+		}
+		auto magnitude = std::sqrt(state.x * state.x + state.y * state.y);
+		if (magnitude <= _config.deadzone) {
+			state.x = 0.0f;
+			state.y = 0.0f;
+		} else {
+			auto input = (magnitude - _config.deadzone) * _deadzoneScale;
+			if (input > 1.0f) {
+				input = 1.0f;
+			}
+			auto pos = input * (float)lutSize;
+			auto i = (unsigned)pos;
+			if (i >= lutSize) {
+				i = lutSize - 1;
+			}
+			auto output = _lut[i] + (pos - (float)i) * (_lut[i + 1] - _lut[i]);
+			auto scale = output / magnitude;
+			state.x *= scale;
+			state.y *= scale;
+		}
+		if (_config.buttonId != AXISTRANSFORM_NOBUTTON) {
+			auto value = std::fabs(state.x);
+			if (!_buttonPressed && value >= _config.buttonThreshold) {
+				_buttonPressed = true;
+				buttonEvent = 1;
+			} else if (_buttonPressed && value < _config.buttonThreshold - _buttonHysteresis) {
+				_buttonPressed = false;
+				buttonEvent = 2;
+			}
+		}
+		return _config.remapAxisId != AXISTRANSFORM_NOREMAP ? _config.remapAxisId : _config.axisId;
+	}
+
+private:
+	static constexpr float _buttonHysteresis = 0.05f; // keeps a noisy axis from chattering at the threshold
+
+	AxisTransform _config;
+	float _deadzoneScale = 1.0f;
+	float _lut[lutSize + 1];
+	bool _buttonPressed = false;
+
+	float _evaluateCurve(float input) const {
+		switch (_config.curveType) {
+		case AxisCurveType::Power:
+			return _config.curveParam > 0.0f ? std::pow(input, _config.curveParam) : input;
+		case AxisCurveType::Points: {
+			float x0 = 0.0f, y0 = 0.0f;
+			for (uint32_t i = 0; i <= _config.curvePointCount; ++i) {
+				float x1 = 1.0f, y1 = 1.0f;
+				if (i < _config.curvePointCount) {
+					x1 = _config.curvePoints[i][0];
+					y1 = _config.curvePoints[i][1];
+				}
+				if (input <= x1) {
+					return x1 > x0 ? y0 + (input - x0) / (x1 - x0) * (y1 - y0) : y1;
+				}
+				x0 = x1;
+				y0 = y1;
+			}
+			return y0;
+		}
+		default:
+			return input;
+		}
+	}
+};
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
@@ -0,0 +1,71 @@
+#pragma once
+
+
+#include <openvr_driver.h>
+#include <vrinputemulator_types.h>
+#include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+namespace vrinputemulator {
+namespace driver {
+
+
+// Index of the lowest set bit, value must not be 0
+inline unsigned lowestSetBit(uint64_t value) {
+#if defined(_MSC_VER) && defined(_WIN64)
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return index;
+#elif defined(_MSC_VER)
+	// No 64 bit scan on x86
+	unsigned long index;
+	if (_BitScanForward(&index, (uint32_t)value)) {
+		return index;
+	}
+	_BitScanForward(&index, (uint32_t)(value >> 32));
+	return index + 32;
+#else
+	return (unsigned)__builtin_ctzll(value);
+#endif
+}
+
+
+/**
+* Calls buttonEvent(buttonId, ButtonEventType) for every button whose touched or pressed state differs between the two
+* states (ascending button ids, touch before press), then axisEvent(axisId) for every changed axis.
+*
+* Only the bits that changed are visited. Returns false, without calling anything, when nothing changed.
+**/
+template<class ButtonEvent, class AxisEvent>
+bool diffControllerState(const vr::VRControllerState_t& oldState, const vr::VRControllerState_t& newState, ButtonEvent buttonEvent, AxisEvent axisEvent) {
+	uint64_t touchedChanges = oldState.ulButtonTouched ^ newState.ulButtonTouched;
+	uint64_t pressedChanges = oldState.ulButtonPressed ^ newState.ulButtonPressed;
+	uint64_t buttonChanges = touchedChanges | pressedChanges;
+	if (!buttonChanges && std::memcmp(oldState.rAxis, newState.rAxis, sizeof(newState.rAxis)) == 0) {
+		return false;
+	}
+	while (buttonChanges) {
+		auto buttonId = lowestSetBit(buttonChanges);
+		buttonChanges &= buttonChanges - 1;
+		uint64_t mask = 1ull << buttonId;
+		if (touchedChanges & mask) {
+			buttonEvent(buttonId, (newState.ulButtonTouched & mask) ? ButtonEventType::ButtonTouched : ButtonEventType::ButtonUntouched);
+		}
+		if (pressedChanges & mask) {
+			buttonEvent(buttonId, (newState.ulButtonPressed & mask) ? ButtonEventType::ButtonPressed : ButtonEventType::ButtonUnpressed);
+		}
+	}
+	for (unsigned i = 0; i < vr::k_unControllerStateAxisCount; ++i) {
+		if (oldState.rAxis[i].x != newState.rAxis[i].x || oldState.rAxis[i].y != newState.rAxis[i].y) {
+			axisEvent(i);
+		}
+	}
+	return true;
+}
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
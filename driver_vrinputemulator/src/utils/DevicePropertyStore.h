@@ -0,0 +1,241 @@
+#pragma once
+
+
+#include <openvr_driver.h>
+#include <vrinputemulator_types.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+namespace vrinputemulator {
+namespace driver {
+
+
+// Maps the supported fixed-size value types to their DevicePropertyValueType and OpenVR property tag
+template<class T> struct DevicePropertyTraits;
+template<> struct DevicePropertyTraits<int32_t> { static const DevicePropertyValueType valueType = DevicePropertyValueType::INT32; };
+template<> struct DevicePropertyTraits<uint64_t> { static const DevicePropertyValueType valueType = DevicePropertyValueType::UINT64; };
+template<> struct DevicePropertyTraits<float> { static const DevicePropertyValueType valueType = DevicePropertyValueType::FLOAT; };
+template<> struct DevicePropertyTraits<bool> { static const DevicePropertyValueType valueType = DevicePropertyValueType::BOOL; };
+template<> struct DevicePropertyTraits<vr::HmdMatrix34_t> { static const DevicePropertyValueType valueType = DevicePropertyValueType::MATRIX34; };
+template<> struct DevicePropertyTraits<vr::HmdMatrix44_t> { static const DevicePropertyValueType valueType = DevicePropertyValueType::MATRIX44; };
+template<> struct DevicePropertyTraits<vr::HmdVector3_t> { static const DevicePropertyValueType valueType = DevicePropertyValueType::VECTOR3; };
+template<> struct DevicePropertyTraits<vr::HmdVector4_t> { static const DevicePropertyValueType valueType = DevicePropertyValueType::VECTOR4; };
+
+
+/**
+* A single typed property value.
+*
+* All fixed-size types and strings shorter than 64 bytes are stored inline, only longer strings need a heap allocation.
+**/
+class DevicePropertyValue {
+public:
+	DevicePropertyValue() {}
+	DevicePropertyValue(const DevicePropertyValue& other) { *this = other; }
+	// noexcept, so that std::vector moves instead of copies (and allocates) when it grows
+	DevicePropertyValue(DevicePropertyValue&& other) noexcept { *this = std::move(other); }
+
+	DevicePropertyValue& operator=(const DevicePropertyValue& other) {
+		if (this != &other) {
+			_assign(other._type, other.data(), other._size, other._size);
+		}
+		return *this;
+	}
+
+	DevicePropertyValue& operator=(DevicePropertyValue&& other) noexcept {
+		if (this != &other) {
+			_type = other._type;
+			_size = other._size;
+			_heapCapacity = other._heapCapacity;
+			_heap = std::move(other._heap);
+			std::memcpy(_inline, other._inline, sizeof(_inline));
+			other._heapCapacity = 0;
+			other._size = 0;
+		}
+		return *this;
+	}
+
+	template<class T>
+	void set(const T& value) {
+		_assign(DevicePropertyTraits<T>::valueType, &value, sizeof(T), sizeof(T));
+	}
+	// value does not need to be null-terminated, only length bytes are read
+	void set(const char* value, size_t length) {
+		_assign(DevicePropertyValueType::STRING, value, (uint32_t)length + 1, (uint32_t)length);
+		const_cast<char*>((const char*)data())[length] = '\0';
+	}
+	void set(const char* value) {
+		set(value, std::strlen(value));
+	}
+	void set(const std::string& value) {
+		set(value.c_str(), value.size());
+	}
+
+	// Returns vr::TrackedProp_WrongDataType instead of throwing when the stored type does not match
+	template<class T>
+	vr::ETrackedPropertyError get(T& value) const {
+		if (_type != DevicePropertyTraits<T>::valueType) {
+			return vr::TrackedProp_WrongDataType;
+		}
+		std::memcpy(&value, data(), sizeof(T));
+		return vr::TrackedProp_Success;
+	}
+	vr::ETrackedPropertyError get(std::string& value) const {
+		if (_type != DevicePropertyValueType::STRING) {
+			return vr::TrackedProp_WrongDataType;
+		}
+		value.assign((const char*)data(), _size - 1);
+		return vr::TrackedProp_Success;
+	}
+
+	DevicePropertyValueType type() const { return _type; }
+	uint32_t size() const { return _size; }
+	const void* data() const { return _size > sizeof(_inline) ? (const void*)_heap.get() : (const void*)_inline; }
+
+	vr::PropertyTypeTag_t tag() const {
+		switch (_type) {
+		case DevicePropertyValueType::INT32:
+			return vr::k_unInt32PropertyTag;
+		case DevicePropertyValueType::UINT64:
+			return vr::k_unUint64PropertyTag;
+		case DevicePropertyValueType::FLOAT:
+			return vr::k_unFloatPropertyTag;
+		case DevicePropertyValueType::BOOL:
+			return vr::k_unBoolPropertyTag;
+		case DevicePropertyValueType::STRING:
+			return vr::k_unStringPropertyTag;
+		case DevicePropertyValueType::MATRIX34:
+			return vr::k_unHmdMatrix34PropertyTag;
+		case DevicePropertyValueType::MATRIX44:
+			return vr::k_unHmdMatrix44PropertyTag;
+		case DevicePropertyValueType::VECTOR3:
+			return vr::k_unHmdVector3PropertyTag;
+		case DevicePropertyValueType::VECTOR4:
+			return vr::k_unHmdVector4PropertyTag;
+		default:
+			return vr::k_unInvalidPropertyTag;
+		}
+	}
+
+	// Fills a vr::PropertyWrite_t for vr::VRPropertiesRaw()->WritePropertyBatch(). The write points into this value.
+	bool toPropertyWrite(vr::PropertyWrite_t& write) const {
+		auto t = tag();
+		if (t == vr::k_unInvalidPropertyTag) {
+			return false;
+		}
+		write.writeType = vr::PropertyWrite_Set;
+		write.pvBuffer = const_cast<void*>(data());
+		write.unBufferSize = _size;
+		write.unTag = t;
+		return true;
+	}
+
+private:
+	DevicePropertyValueType _type = (DevicePropertyValueType)0;
+	uint32_t _size = 0;
+	uint32_t _heapCapacity = 0;
+	union {
+		uint64_t _align;
+		uint8_t _inline[sizeof(vr::HmdMatrix44_t)];
+	};
+	std::unique_ptr<uint8_t[]> _heap;
+
+	// Stores a value of size bytes, of which the first copySize are copied from value
+	void _assign(DevicePropertyValueType type, const void* value, uint32_t size, uint32_t copySize) {
+		if (size > sizeof(_inline)) {
+			if (_heapCapacity < size) {
+				_heap.reset(new uint8_t[size]);
+				_heapCapacity = size;
+			}
+			std::memcpy(_heap.get(), value, copySize);
+		} else {
+			std::memcpy(_inline, value, copySize);
+		}
+		_type = type;
+		_size = size;
+	}
+};
+
+
+/**
+* Device property container that keeps its entries in a vector sorted by property id.
+*
+* Lookups are a binary search over contiguous memory and setting an existing property never allocates.
+**/
+class DevicePropertyStore {
+public:
+	struct Entry {
+		vr::ETrackedDeviceProperty deviceProperty;
+		DevicePropertyValue value;
+	};
+
+	template<class T>
+	vr::ETrackedPropertyError get(vr::ETrackedDeviceProperty prop, T& value) const {
+		auto v = find(prop);
+		if (!v) {
+			return vr::TrackedProp_ValueNotProvidedByDevice;
+		}
+		return v->get(value);
+	}
+
+	template<class T>
+	void set(vr::ETrackedDeviceProperty prop, const T& value) {
+		_findOrInsert(prop).set(value);
+	}
+	void set(vr::ETrackedDeviceProperty prop, const char* value) {
+		_findOrInsert(prop).set(value);
+	}
+	void set(vr::ETrackedDeviceProperty prop, const DevicePropertyValue& value) {
+		_findOrInsert(prop) = value;
+	}
+
+	bool remove(vr::ETrackedDeviceProperty prop) {
+		auto i = _lowerBound(prop);
+		if (i != _entries.end() && i->deviceProperty == prop) {
+			_entries.erase(i);
+			return true;
+		}
+		return false;
+	}
+
+	const DevicePropertyValue* find(vr::ETrackedDeviceProperty prop) const {
+		auto i = std::lower_bound(_entries.begin(), _entries.end(), prop, [](const Entry& e, vr::ETrackedDeviceProperty p) {
+			return e.deviceProperty < p;
+		});
+		if (i != _entries.end() && i->deviceProperty == prop) {
+			return &i->value;
+		}
+		return nullptr;
+	}
+
+	size_t size() const { return _entries.size(); }
+	bool empty() const { return _entries.empty(); }
+	void reserve(size_t count) { _entries.reserve(count); }
+	std::vector<Entry>::const_iterator begin() const { return _entries.begin(); }
+	std::vector<Entry>::const_iterator end() const { return _entries.end(); }
+
+private:
+	std::vector<Entry> _entries;
+
+	std::vector<Entry>::iterator _lowerBound(vr::ETrackedDeviceProperty prop) {
+		return std::lower_bound(_entries.begin(), _entries.end(), prop, [](const Entry& e, vr::ETrackedDeviceProperty p) {
+			return e.deviceProperty < p;
+		});
+	}
+
+	DevicePropertyValue& _findOrInsert(vr::ETrackedDeviceProperty prop) {
+		auto i = _lowerBound(prop);
+		if (i == _entries.end() || i->deviceProperty != prop) {
+			Entry e;
+			e.deviceProperty = prop;
+			i = _entries.insert(i, std::move(e));
+		}
+		return i->value;
+	}
+};
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
@@ -0,0 +1,135 @@
+#pragma once
+
+
+#include <openvr_driver.h>
+#include <vrinputemulator_types.h>
+#include <vector>
+
+namespace vrinputemulator {
+namespace driver {
+
+
+/**
+* Routes compiled into per-device dispatch lists.
+*
+* A device with at least one route on a channel sends its events on that channel only to its route targets, devices
+* without routes keep sending to themselves. When several sources are routed to the same target, a source is muted
+* while a source with a higher priority for that target is active.
+* Immutable once compiled, so it can be shared between threads without locking.
+**/
+class DeviceRoutingTable {
+public:
+	static const unsigned channelCount = 3;
+
+	struct Target {
+		uint32_t openvrId;
+		std::vector<uint32_t> preemptedBy; // sources with a higher priority for this target
+	};
+
+	struct Dispatch {
+		bool used = false;
+		bool disconnectSelf = false; // pose only: nothing is sent to the source itself anymore
+		std::vector<Target> targets; // without drop routes
+	};
+
+	// Returns nullptr when the source has no routes on the channel
+	const Dispatch* find(uint32_t sourceId, DeviceRouteChannel channel) const {
+		auto& d = _dispatch[sourceId][_channelIndex(channel)];
+		return d.used ? &d : nullptr;
+	}
+
+	// Returns false when a route references an invalid device id or no channel
+	bool compile(const std::vector<DeviceRoute>& routes) {
+		for (auto& r : routes) {
+			if (r.sourceId >= vr::k_unMaxTrackedDeviceCount
+					|| (r.targetId >= vr::k_unMaxTrackedDeviceCount && r.targetId != DEVICEROUTING_DROP)
+					|| (r.channels & (uint32_t)DeviceRouteChannel::All) == 0) {
+				return false;
+			}
+		}
+		struct _Feeder {
+			uint32_t sourceId;
+			int32_t priority;
+		};
+		for (unsigned c = 0; c < channelCount; ++c) {
+			uint32_t channelBit = 1u << c;
+			std::vector<_Feeder> feeders[vr::k_unMaxTrackedDeviceCount]; // per target
+			for (auto& r : routes) {
+				if (!(r.channels & channelBit)) {
+					continue;
+				}
+				_dispatch[r.sourceId][c].used = true;
+				if (r.targetId == DEVICEROUTING_DROP) {
+					continue;
+				}
+				auto& f = feeders[r.targetId];
+				bool found = false;
+				for (auto& e : f) {
+					if (e.sourceId == r.sourceId) { // duplicate route, the higher priority wins
+						if (r.priority > e.priority) {
+							e.priority = r.priority;
+						}
+						found = true;
+						break;
+					}
+				}
+				if (!found) {
+					f.push_back({ r.sourceId, r.priority });
+					_dispatch[r.sourceId][c].targets.push_back({ r.targetId, {} });
+				}
+			}
+			for (uint32_t s = 0; s < vr::k_unMaxTrackedDeviceCount; ++s) {
+				auto& d = _dispatch[s][c];
+				if (!d.used) {
+					continue;
+				}
+				bool sendsToSelf = false;
+				for (auto& t : d.targets) {
+					int32_t priority = 0;
+					for (auto& e : feeders[t.openvrId]) {
+						if (e.sourceId == s) {
+							priority = e.priority;
+						}
+					}
+					for (auto& e : feeders[t.openvrId]) {
+						if (e.sourceId != s && e.priority > priority) {
+							t.preemptedBy.push_back(e.sourceId);
+						}
+					}
+					if (t.openvrId == s) {
+						sendsToSelf = true;
+					}
+				}
+				if (DeviceRouteChannel(channelBit) == DeviceRouteChannel::Pose && !sendsToSelf) {
+					// A device that gets its pose from other sources must not flicker to disconnected
+					bool fed = false;
+					for (auto& e : feeders[s]) {
+						if (e.sourceId != s) {
+							fed = true;
+						}
+					}
+					d.disconnectSelf = !fed;
+				}
+			}
+		}
+		return true;
+	}
+
+private:
+	Dispatch _dispatch[vr::k_unMaxTrackedDeviceCount][channelCount];
+
+	static unsigned _channelIndex(DeviceRouteChannel channel) {
+		switch (channel) {
+		case DeviceRouteChannel::Buttons:
+			return 1;
+		case DeviceRouteChannel::Axes:
+			return 2;
+		default:
+			return 0;
+		}
+	}
+};
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
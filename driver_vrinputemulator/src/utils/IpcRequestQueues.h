@@ -0,0 +1,135 @@
+#pragma once
+
+
+#include <boost/interprocess/ipc/message_queue.hpp>
+#include <boost/interprocess/sync/named_semaphore.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vrinputemulator {
+namespace driver {
+
+
+/**
+* The request queues the ipc thread waits on: the server queue and one request queue per client.
+*
+* A busy client can only fill its own queue. The queues are serviced round-robin, at most requestQuota requests in a
+* row from one queue, so a flooding client cannot starve the others. Clients post the doorbell once per request, that
+* way one thread can wait on all queues. Only used by the ipc thread.
+**/
+class IpcRequestQueues {
+public:
+	static const unsigned requestQuota = 16;
+
+	IpcRequestQueues(boost::interprocess::message_queue& serverQueue, size_t maxRequestCount, size_t maxRequestSize)
+		: _serverQueue(serverQueue), _maxRequestCount(maxRequestCount), _maxRequestSize(maxRequestSize) {}
+	~IpcRequestQueues() { close(); }
+
+	// Creates the doorbell. Without one there are no client queues and only the server queue is polled.
+	void open(const std::string& doorbellName) {
+		close();
+		boost::interprocess::named_semaphore::remove(doorbellName.c_str());
+		_doorbell = std::make_shared<boost::interprocess::named_semaphore>(boost::interprocess::create_only, doorbellName.c_str(), 0);
+		_doorbellName = doorbellName;
+	}
+
+	// Removes the doorbell and all client queues
+	void close() {
+		while (!_queues.empty()) {
+			remove(_queues.back().clientId);
+		}
+		if (_doorbell) {
+			_doorbell.reset();
+			boost::interprocess::named_semaphore::remove(_doorbellName.c_str());
+		}
+	}
+
+	bool hasDoorbell() const { return (bool)_doorbell; }
+	size_t clientCount() const { return _queues.size(); }
+
+	// Creates the request queue of a client. Returns false when there is no doorbell, throws when the queue cannot be created.
+	bool add(uint32_t clientId, const std::string& name) {
+		if (!_doorbell) {
+			return false; // nothing would wake up the ipc thread
+		}
+		boost::interprocess::message_queue::remove(name.c_str());
+		auto queue = std::make_shared<boost::interprocess::message_queue>(
+			boost::interprocess::create_only, name.c_str(), _maxRequestCount, _maxRequestSize);
+		_queues.push_back({ clientId, name, queue });
+		return true;
+	}
+
+	void remove(uint32_t clientId) {
+		for (size_t i = 0; i < _queues.size(); ++i) {
+			if (_queues[i].clientId == clientId) {
+				boost::interprocess::message_queue::remove(_queues[i].name.c_str());
+				_queues.erase(_queues.begin() + i);
+				// Keep the position on the queue that is currently being served
+				if (_next == i + 1) {
+					_served = 0;
+				} else if (_next > i + 1) {
+					_next--;
+				}
+				return;
+			}
+		}
+	}
+
+	// Waits up to timeoutMs for a request to be announced, then takes the next request in round-robin order. Clients
+	// of an older protocol version don't post the doorbell, so the queues are also looked at on timeout.
+	// Returns false when there was nothing to receive.
+	bool receive(void* buffer, size_t bufferSize, uint64_t& recvSize, unsigned timeoutMs) {
+		auto timeout = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(timeoutMs);
+		unsigned priority;
+		if (!_doorbell) {
+			return _serverQueue.timed_receive(buffer, bufferSize, recvSize, priority, timeout);
+		}
+		_doorbell->timed_wait(timeout);
+		auto queueCount = _queues.size() + 1;
+		if (_next >= queueCount) {
+			_next = 0;
+			_served = 0;
+		}
+		for (size_t n = 0; n <= queueCount; ++n) {
+			if (_served < requestQuota) {
+				auto& queue = _next == 0 ? _serverQueue : *_queues[_next - 1].queue;
+				if (queue.try_receive(buffer, bufferSize, recvSize, priority)) {
+					_served++;
+					return true;
+				}
+			}
+			_next = (_next + 1) % queueCount;
+			_served = 0;
+		}
+		return false;
+	}
+
+private:
+	struct _Queue {
+		uint32_t clientId;
+		std::string name;
+		std::shared_ptr<boost::interprocess::message_queue> queue;
+	};
+	boost::interprocess::message_queue& _serverQueue;
+	size_t _maxRequestCount;
+	size_t _maxRequestSize;
+	std::vector<_Queue> _queues;
+	size_t _next = 0; // 0 .. server queue, i .. _queues[i - 1]
+	unsigned _served = 0; // requests taken from _next in a row
+	std::string _doorbellName;
+	std::shared_ptr<boost::interprocess::named_semaphore> _doorbell;
+};
+
+
+// Sends without blocking the ipc thread for more than timeoutMs. A client whose queue stays full is not reading it.
+inline bool ipcTimedSend(boost::interprocess::message_queue& queue, const void* buffer, size_t size, unsigned timeoutMs) {
+	auto timeout = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(timeoutMs);
+	return queue.timed_send(buffer, size, 0, timeout);
+}
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
@@ -0,0 +1,140 @@
+#pragma once
+
+
+#include <openvr_driver.h>
+#include <openvr_math.h>
+#include <cstdint>
+
+namespace vrinputemulator {
+namespace driver {
+
+
+/**
+* State of a motion compensation group and the math that removes the reference body's motion from other poses.
+*
+* The reference device is rigidly attached to a moving platform, its pose at the zero pose time defines the platform
+* frame. Corrected poses are expressed as if the platform had never moved. Times are driver clock nanoseconds and
+* passed in by the caller. Trivially copyable, so it can live in a SeqLock.
+**/
+struct MotionCompensationState {
+	bool zeroPoseValid = false;
+	vr::HmdVector3d_t zeroPos = { 0.0, 0.0, 0.0 };
+	vr::HmdQuaternion_t zeroRot = { 1.0, 0.0, 0.0, 0.0 };
+
+	vr::HmdVector3d_t centerPosRaw = { 0.0, 0.0, 0.0 };
+	bool centerRawIsRelative = false;
+	vr::HmdVector3d_t centerPosZero = { 0.0, 0.0, 0.0 };
+
+	bool refPoseValid = false;
+	vr::HmdVector3d_t centerPosCur = { 0.0, 0.0, 0.0 };
+	vr::HmdQuaternion_t rotDiff = { 1.0, 0.0, 0.0, 0.0 };
+	// Kinematic state of the reference body (world space), the center's velocity/acceleration include the lever arm
+	vr::HmdVector3d_t centerVel = { 0.0, 0.0, 0.0 };
+	vr::HmdVector3d_t centerAcc = { 0.0, 0.0, 0.0 };
+	vr::HmdVector3d_t refAngVel = { 0.0, 0.0, 0.0 };
+	vr::HmdVector3d_t refAngAcc = { 0.0, 0.0, 0.0 };
+	int64_t refPoseTime = 0; // driver clock time the reference pose was sampled at
+
+	// Center of rotation, either absolute or relative to the reference device's zero pose
+	void setCenter(const vr::HmdVector3d_t& centerPos, bool relativeToDevice) {
+		centerPosRaw = centerPos;
+		centerRawIsRelative = relativeToDevice;
+		if (relativeToDevice && zeroPoseValid) {
+			centerPosZero = zeroPos + centerPosRaw;
+		} else if (!relativeToDevice) {
+			centerPosZero = centerPosRaw;
+		}
+	}
+
+	void setZeroPose(const vr::DriverPose_t& pose) {
+		zeroPos = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecPosition, true) - pose.vecWorldFromDriverTranslation;
+		zeroRot = vrmath::quaternionConjugate(pose.qWorldFromDriverRotation) * pose.qRotation;
+		if (centerRawIsRelative) {
+			centerPosZero = zeroPos + centerPosRaw;
+		} else {
+			centerPosZero = centerPosRaw;
+		}
+		zeroPoseValid = true;
+	}
+
+	// pose: reference device pose sampled at poseTime
+	void updateReference(const vr::DriverPose_t& pose, int64_t poseTime) {
+		auto poseWorldRot = vrmath::quaternionConjugate(pose.qWorldFromDriverRotation) * pose.qRotation;
+		rotDiff = poseWorldRot * vrmath::quaternionConjugate(zeroRot);
+		auto poseWorldPos = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecPosition, true) - pose.vecWorldFromDriverTranslation;
+		centerPosCur = poseWorldPos + vrmath::quaternionRotateVector(rotDiff, centerPosZero - zeroPos);
+		// The center is rigidly attached to the reference body
+		auto leverArm = centerPosCur - poseWorldPos;
+		refAngVel = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecAngularVelocity, true);
+		refAngAcc = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecAngularAcceleration, true);
+		auto angVelCrossArm = vrmath::crossProduct(refAngVel, leverArm);
+		centerVel = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecVelocity, true) + angVelCrossArm;
+		centerAcc = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecAcceleration, true)
+			+ vrmath::crossProduct(refAngAcc, leverArm) + vrmath::crossProduct(refAngVel, angVelCrossArm);
+		refPoseTime = poseTime;
+		refPoseValid = true;
+	}
+
+	// Removes the platform motion from pose (sampled at poseTime). The reference is extrapolated to poseTime, by at
+	// most maxExtrapolation seconds. Returns false when there is no zero or reference pose yet.
+	bool apply(vr::DriverPose_t& pose, int64_t poseTime, double maxExtrapolation) const {
+		if (!zeroPoseValid || !refPoseValid) {
+			return false;
+		}
+		// The reference device usually reports less often than the devices it corrects (e.g. 369Hz vs. 1120Hz),
+		// so extrapolate the reference to the time of this pose
+		auto dt = (double)(poseTime - refPoseTime) / 1.0e9;
+		if (dt > maxExtrapolation) {
+			dt = maxExtrapolation;
+		} else if (dt < -maxExtrapolation) {
+			dt = -maxExtrapolation;
+		}
+		auto& alpha = refAngAcc;
+		auto w = refAngVel + alpha * dt;
+		double refRot[3] = {
+			refAngVel.v[0] * dt + 0.5 * alpha.v[0] * dt * dt,
+			refAngVel.v[1] * dt + 0.5 * alpha.v[1] * dt * dt,
+			refAngVel.v[2] * dt + 0.5 * alpha.v[2] * dt * dt
+		};
+		auto curRotDiff = vrmath::quaternionFromRotationVector(refRot) * rotDiff;
+		auto curCenterPos = centerPosCur + centerVel * dt + centerAcc * (0.5 * dt * dt);
+		auto curCenterVel = centerVel + centerAcc * dt;
+
+		auto poseWorldRot = vrmath::quaternionConjugate(pose.qWorldFromDriverRotation) * pose.qRotation;
+		auto adjPoseWorldRot = vrmath::quaternionConjugate(curRotDiff) * poseWorldRot;
+		pose.qRotation = pose.qWorldFromDriverRotation * adjPoseWorldRot;
+		auto poseWorldPos = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecPosition, true) - pose.vecWorldFromDriverTranslation;
+		auto adjPoseWorldPos = centerPosZero + vrmath::quaternionRotateVector(curRotDiff, poseWorldPos - curCenterPos, true);
+		auto adjPoseDriverPos = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, adjPoseWorldPos) + pose.vecWorldFromDriverTranslation;
+		pose.vecPosition[0] = adjPoseDriverPos.v[0];
+		pose.vecPosition[1] = adjPoseDriverPos.v[1];
+		pose.vecPosition[2] = adjPoseDriverPos.v[2];
+
+		// Velocities and accelerations relative to the rotating reference frame, otherwise OpenVR's
+		// prediction extrapolates the platform motion we just removed from the position
+		auto r = poseWorldPos - curCenterPos;
+		auto relVel = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecVelocity, true)
+			- curCenterVel - vrmath::crossProduct(w, r);
+		auto relAcc = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecAcceleration, true)
+			- centerAcc - vrmath::crossProduct(alpha, r) - vrmath::crossProduct(w, vrmath::crossProduct(w, r))
+			- vrmath::crossProduct(w, relVel) * 2.0;
+		auto relAngVel = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecAngularVelocity, true) - w;
+		auto relAngAcc = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, pose.vecAngularAcceleration, true)
+			- alpha - vrmath::crossProduct(w, relAngVel);
+		auto toDriver = [&](const vr::HmdVector3d_t& v, double (&out)[3]) {
+			auto d = vrmath::quaternionRotateVector(pose.qWorldFromDriverRotation, vrmath::quaternionRotateVector(curRotDiff, v, true));
+			out[0] = d.v[0];
+			out[1] = d.v[1];
+			out[2] = d.v[2];
+		};
+		toDriver(relVel, pose.vecVelocity);
+		toDriver(relAcc, pose.vecAcceleration);
+		toDriver(relAngVel, pose.vecAngularVelocity);
+		toDriver(relAngAcc, pose.vecAngularAcceleration);
+		return true;
+	}
+};
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
@@ -0,0 +1,99 @@
+#pragma once
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace vrinputemulator {
+namespace driver {
+
+
+/**
+* Open addressing hash table keyed by pointers, entries can be added and overwritten but not removed.
+*
+* Fixed capacity and linear probing, so lookups touch one or two cache lines and never allocate. Keys and values are
+* atomics and new entries are published with a release store of the key, which makes find() safe to call concurrently
+* with insert() and assign(). Writers have to be serialized by the caller.
+**/
+template<class K, class V, unsigned CapacityLog2>
+class PointerHashMap {
+	static_assert(std::is_pointer<K>::value, "PointerHashMap requires a pointer key");
+	static_assert(std::is_trivially_copyable<V>::value, "PointerHashMap requires a trivially copyable value");
+
+public:
+	static const size_t capacity = size_t(1) << CapacityLog2;
+
+	PointerHashMap() {
+		for (auto& s : _slots) {
+			s.key.store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	// Returns false when the key already exists (the old value is kept) or the table is full
+	bool insert(K key, const V& value) {
+		return _store(key, value, false);
+	}
+
+	// Like insert(), but replaces the value of an existing key. Returns false when the table is full.
+	bool assign(K key, const V& value) {
+		return _store(key, value, true);
+	}
+
+	// Returns V() when not found
+	V find(K key) const {
+		auto i = _hash(key);
+		for (size_t n = 0; n < capacity; ++n, i = (i + 1) & (capacity - 1)) {
+			auto slotKey = _slots[i].key.load(std::memory_order_acquire);
+			if (slotKey == key) {
+				return _slots[i].value.load(std::memory_order_acquire);
+			} else if (!slotKey) {
+				return V();
+			}
+		}
+		return V();
+	}
+
+	size_t size() const { return _size; }
+
+private:
+	struct _Slot {
+		std::atomic<K> key;
+		std::atomic<V> value;
+	};
+	_Slot _slots[capacity];
+	size_t _size = 0;
+
+	bool _store(K key, const V& value, bool overwrite) {
+		if (!key) {
+			return false;
+		}
+		auto i = _hash(key);
+		for (size_t n = 0; n < capacity; ++n, i = (i + 1) & (capacity - 1)) {
+			auto slotKey = _slots[i].key.load(std::memory_order_relaxed);
+			if (slotKey == key) {
+				if (overwrite) {
+					_slots[i].value.store(value, std::memory_order_release);
+				}
+				return overwrite;
+			} else if (!slotKey) {
+				_slots[i].value.store(value, std::memory_order_relaxed);
+				_slots[i].key.store(key, std::memory_order_release);
+				_size++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Fibonacci hashing, the low bits of heap and vtable pointers are mostly zero
+	static size_t _hash(K key) {
+		auto h = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ull;
+		return (size_t)(h >> (64 - CapacityLog2));
+	}
+};
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
@@ -0,0 +1,197 @@
+#pragma once
+
+
+#include <openvr_driver.h>
+#include <vrinputemulator_types.h>
+#include <openvr_math.h>
+#include <cstring>
+#include <cmath>
+
+namespace vrinputemulator {
+namespace driver {
+
+
+/**
+* A chain of up to POSEFILTER_MAXSTAGES pose filters, applied in order.
+*
+* Each stage filters position and rotation. All state lives inline so filtering a pose never allocates.
+* Not thread-safe, the owner has to synchronize access.
+**/
+class PoseFilterChain {
+public:
+	PoseFilterChain() {
+		std::memset(_stages, 0, sizeof(_stages));
+	}
+
+	bool empty() const { return _stageCount == 0; }
+	uint32_t stageCount() const { return _stageCount; }
+	const PoseFilterStage& stage(uint32_t i) const { return _stages[i].config; }
+
+	// Replaces all stages and resets the filter state. Stages of type None are skipped.
+	void configure(const PoseFilterStage* stages, uint32_t count) {
+		std::memset(_stages, 0, sizeof(_stages));
+		_stageCount = 0;
+		for (uint32_t i = 0; i < count && _stageCount < POSEFILTER_MAXSTAGES; ++i) {
+			if (stages[i].type != PoseFilterType::None) {
+				_stages[_stageCount++].config = stages[i];
+			}
+		}
+		reset();
+	}
+
+	// Forgets the filter state, the next pose passes through unfiltered
+	void reset() {
+		for (uint32_t i = 0; i < _stageCount; ++i) {
+			_stages[i].initialized = false;
+		}
+		_lastTimestamp = 0;
+	}
+
+	// timestamp: driver clock time (ns) the pose was sampled at
+	void apply(vr::DriverPose_t& pose, int64_t timestamp) {
+		if (_stageCount == 0) {
+			return;
+		}
+		double dt = _lastTimestamp != 0 ? (double)(timestamp - _lastTimestamp) / 1.0e9 : 0.0;
+		if (_lastTimestamp != 0 && dt > 0.5) {
+			reset(); // Tracking gap, don't smear the old state into the new pose
+		}
+		_lastTimestamp = timestamp;
+		if (dt < 1.0e-5) {
+			dt = 1.0e-5; // Repeated samples (e.g. periodic re-sends)
+		}
+		for (uint32_t i = 0; i < _stageCount; ++i) {
+			auto& s = _stages[i];
+			if (!s.initialized) {
+				_initStage(s, pose);
+				continue;
+			}
+			switch (s.config.type) {
+			case PoseFilterType::OneEuro:
+				_applyOneEuro(s, pose, dt);
+				break;
+			case PoseFilterType::Exponential:
+				_applyExponential(s, pose);
+				break;
+			case PoseFilterType::Kalman:
+				_applyKalman(s, pose, dt);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+private:
+	struct _Stage {
+		PoseFilterStage config;
+		bool initialized;
+		double pos[3];
+		double posDerivative[3]; // One Euro: filtered speed, Kalman: velocity estimate
+		double posCovariance[3][3]; // Kalman: P00, P01, P11 per axis
+		vr::HmdQuaternion_t rot;
+		double rotDerivative; // One Euro: filtered angular speed
+		double rotCovariance; // Kalman
+	};
+
+	_Stage _stages[POSEFILTER_MAXSTAGES];
+	uint32_t _stageCount = 0;
+	int64_t _lastTimestamp = 0;
+
+	static void _initStage(_Stage& s, const vr::DriverPose_t& pose) {
+		for (unsigned a = 0; a < 3; ++a) {
+			s.pos[a] = pose.vecPosition[a];
+			s.posDerivative[a] = 0.0;
+			s.posCovariance[a][0] = s.config.params[1];
+			s.posCovariance[a][1] = 0.0;
+			s.posCovariance[a][2] = s.config.params[0];
+		}
+		s.rot = pose.qRotation;
+		s.rotDerivative = 0.0;
+		s.rotCovariance = s.config.params[1];
+		s.initialized = true;
+	}
+
+	static void _writeBack(const _Stage& s, vr::DriverPose_t& pose) {
+		for (unsigned a = 0; a < 3; ++a) {
+			pose.vecPosition[a] = s.pos[a];
+		}
+		pose.qRotation = s.rot;
+	}
+
+	static double _quaternionAngle(const vr::HmdQuaternion_t& a, const vr::HmdQuaternion_t& b) {
+		auto d = std::fabs(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z);
+		return d >= 1.0 ? 0.0 : 2.0 * std::acos(d);
+	}
+
+	// Smoothing factor of a first order low-pass with the given cutoff frequency
+	static double _lowPassAlpha(double cutoff, double dt) {
+		auto tau = 1.0 / (2.0 * 3.14159265358979323846 * cutoff);
+		return 1.0 / (1.0 + tau / dt);
+	}
+
+	// Casiez et al., "1€ Filter: A Simple Speed-based Low-pass Filter for Noisy Input in Interactive Systems"
+	static void _applyOneEuro(_Stage& s, vr::DriverPose_t& pose, double dt) {
+		auto minCutoff = s.config.params[0];
+		auto beta = s.config.params[1];
+		auto derivativeAlpha = _lowPassAlpha(s.config.params[2], dt);
+		double speed2 = 0.0;
+		for (unsigned a = 0; a < 3; ++a) {
+			auto dx = (pose.vecPosition[a] - s.pos[a]) / dt;
+			s.posDerivative[a] += derivativeAlpha * (dx - s.posDerivative[a]);
+			speed2 += s.posDerivative[a] * s.posDerivative[a];
+		}
+		auto alpha = _lowPassAlpha(minCutoff + beta * std::sqrt(speed2), dt);
+		for (unsigned a = 0; a < 3; ++a) {
+			s.pos[a] += alpha * (pose.vecPosition[a] - s.pos[a]);
+		}
+		auto angularSpeed = _quaternionAngle(s.rot, pose.qRotation) / dt;
+		s.rotDerivative += derivativeAlpha * (angularSpeed - s.rotDerivative);
+		s.rot = vrmath::quaternionSlerp(s.rot, pose.qRotation, _lowPassAlpha(minCutoff + beta * s.rotDerivative, dt));
+		_writeBack(s, pose);
+	}
+
+	static void _applyExponential(_Stage& s, vr::DriverPose_t& pose) {
+		auto alpha = s.config.params[0];
+		if (alpha <= 0.0 || alpha > 1.0) {
+			alpha = 1.0;
+		}
+		for (unsigned a = 0; a < 3; ++a) {
+			s.pos[a] += alpha * (pose.vecPosition[a] - s.pos[a]);
+		}
+		s.rot = vrmath::quaternionSlerp(s.rot, pose.qRotation, alpha);
+		_writeBack(s, pose);
+	}
+
+	// Constant velocity model per position axis, random walk for the rotation
+	static void _applyKalman(_Stage& s, vr::DriverPose_t& pose, double dt) {
+		auto q = s.config.params[0];
+		auto r = s.config.params[1];
+		for (unsigned a = 0; a < 3; ++a) {
+			auto& p = s.posCovariance[a];
+			// predict
+			s.pos[a] += s.posDerivative[a] * dt;
+			p[0] += dt * (2.0 * p[1] + dt * p[2]) + q * dt * dt * dt / 3.0;
+			p[1] += dt * p[2] + q * dt * dt / 2.0;
+			p[2] += q * dt;
+			// update
+			auto k0 = p[0] / (p[0] + r);
+			auto k1 = p[1] / (p[0] + r);
+			auto residual = pose.vecPosition[a] - s.pos[a];
+			s.pos[a] += k0 * residual;
+			s.posDerivative[a] += k1 * residual;
+			p[2] -= k1 * p[1];
+			p[1] -= k0 * p[1];
+			p[0] -= k0 * p[0];
+		}
+		s.rotCovariance += q * dt;
+		auto k = s.rotCovariance / (s.rotCovariance + r);
+		s.rotCovariance *= 1.0 - k;
+		s.rot = vrmath::quaternionSlerp(s.rot, pose.qRotation, k);
+		_writeBack(s, pose);
+	}
+};
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
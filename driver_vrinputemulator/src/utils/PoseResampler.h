@@ -0,0 +1,115 @@
+#pragma once
+
+
+#include <openvr_driver.h>
+#include <openvr_math.h>
+#include <cstdint>
+
+
+#define POSERESAMPLER_HISTORY 4
+
+namespace vrinputemulator {
+namespace driver {
+
+
+/**
+* Turns poses arriving at an irregular rate into poses at a fixed output rate.
+*
+* The output pose for time now is the pose at (now - delay), interpolated between the two samples around that
+* time. The last POSERESAMPLER_HISTORY samples before the current one are kept inline, so a delay of a few sample
+* intervals still finds its pair. Without a newer sample to interpolate towards, the current sample is extrapolated
+* up to the extrapolation horizon. Depends on nothing but its arguments, so the owner keeps the current sample and the
+* clock. Not thread-safe, the owner has to synchronize access.
+**/
+class PoseResampler {
+public:
+	bool enabled() const { return _interval > 0; }
+	int64_t interval() const { return _interval; }
+	int64_t next() const { return _next; }
+	bool due(int64_t now) const { return enabled() && now >= _next; }
+
+	// delay in seconds, outputRate in Hz (0 .. disabled). Restarts the output cadence.
+	void configure(double delay, double outputRate) {
+		_delay = delay > 0.0 ? (int64_t)(delay * 1.0e9) : 0;
+		_interval = outputRate > 0.0 ? (int64_t)(1.0e9 / outputRate) : 0;
+		_next = 0;
+		if (_interval == 0) {
+			_historyCount = 0;
+		}
+	}
+
+	// Has to be called before the current sample (taken at currentTime, 0 .. none) is replaced by one taken at sampleTime
+	void sampleReplaced(const vr::DriverPose_t& current, int64_t currentTime, int64_t sampleTime) {
+		if (enabled() && currentTime != 0 && sampleTime > currentTime) {
+			for (unsigned i = POSERESAMPLER_HISTORY - 1; i > 0; --i) {
+				_history[i] = _history[i - 1];
+			}
+			_history[0].pose = current;
+			_history[0].time = currentTime;
+			if (_historyCount < POSERESAMPLER_HISTORY) {
+				++_historyCount;
+			}
+		}
+	}
+
+	// Computes the output pose for now from the current sample (taken at currentTime). horizon in seconds.
+	void resample(vr::DriverPose_t& result, const vr::DriverPose_t& current, int64_t currentTime, int64_t now, double horizon) const {
+		auto t = now - _delay;
+		if (_historyCount > 0 && t < currentTime) {
+			// Newest pair of samples around t, or the oldest one when t lies before all of them
+			const vr::DriverPose_t* newer = &current;
+			int64_t newerTime = currentTime;
+			unsigned i = 0;
+			while (i + 1 < _historyCount && _history[i].time > t) {
+				newer = &_history[i].pose;
+				newerTime = _history[i].time;
+				++i;
+			}
+			double alpha = 0.0;
+			if (t > _history[i].time) {
+				alpha = (double)(t - _history[i].time) / (double)(newerTime - _history[i].time);
+			}
+			vrmath::interpolatePose(result, _history[i].pose, *newer, alpha);
+		} else {
+			result = current;
+			auto dt = (double)(t - currentTime) / 1.0e9;
+			if (dt > 0.0) {
+				vrmath::extrapolatePose(result, dt < horizon ? dt : horizon);
+				if (dt > horizon) {
+					// Don't let the device drift away when the source stops sending
+					for (unsigned i = 0; i < 3; ++i) {
+						result.vecVelocity[i] = 0.0;
+						result.vecAcceleration[i] = 0.0;
+						result.vecAngularVelocity[i] = 0.0;
+						result.vecAngularAcceleration[i] = 0.0;
+					}
+				}
+			}
+		}
+		result.poseTimeOffset = 0.0;
+	}
+
+	// Schedules the next output pose and returns its time. Keeps a fixed cadence, but doesn't try to catch up after a stall.
+	int64_t advance(int64_t now) {
+		_next += _interval;
+		if (_next <= now) {
+			_next = now + _interval;
+		}
+		return _next;
+	}
+
+private:
+	int64_t _delay = 0; // nanoseconds
+	int64_t _interval = 0; // nanoseconds, 0 .. disabled
+	int64_t _next = 0; // time of the next output pose
+	struct _Sample {
+		vr::DriverPose_t pose;
+		int64_t time;
+	};
+	_Sample _history[POSERESAMPLER_HISTORY]; // samples before the current one, newest first
+	unsigned _historyCount = 0;
+};
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
@@ -0,0 +1,67 @@
+#pragma once
+
+
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+
+namespace vrinputemulator {
+namespace driver {
+
+
+/**
+* A value protected by a sequence lock.
+*
+* Readers always get a consistent copy without locking and never block the writer. A reader that overlaps with a write
+* simply retries. Writers have to be serialized by the caller. Meant for small values that are read far more often than written.
+**/
+template<class T>
+class SeqLock {
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+public:
+	SeqLock() : _sequence(0), _value() {}
+
+	T load() const {
+		T result;
+		unsigned spins = 0;
+		for (;;) {
+			auto seq = _sequence.load(std::memory_order_acquire);
+			if ((seq & 1) == 0) {
+				std::memcpy(&result, &_value, sizeof(T));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (_sequence.load(std::memory_order_relaxed) == seq) {
+					return result;
+				}
+			}
+			// Writes are short, only give up the time slice when the writer got preempted
+			if (++spins > 64) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// Calls f with a reference to the stored value. Readers retry until f has returned.
+	template<class F>
+	void modify(F f) {
+		auto seq = _sequence.load(std::memory_order_relaxed);
+		_sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		f(_value);
+		_sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	void store(const T& value) {
+		modify([&value](T& v) { v = value; });
+	}
+
+private:
+	std::atomic<uint32_t> _sequence; // odd while a write is in progress
+	T _value;
+};
+
+
+} // end namespace driver
+} // end namespace vrinputemulator
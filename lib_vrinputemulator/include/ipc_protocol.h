@@ -2,14 +2,30 @@
 
 #include "vrinputemulator_types.h"
 #include <utility>
+#include <cstddef>
+#include <chrono>
 
 
-#define IPC_PROTOCOL_VERSION 1
+#define IPC_PROTOCOL_VERSION 16
 
 namespace vrinputemulator {
 namespace ipc {
 
 
+// Message timestamps are steady_clock nanoseconds. Clients convert them to the driver's clock before sending
+// (see VRInputEmulator::syncClock()).
+inline int64_t timestampNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Seconds that have passed since the given timestamp (never negative)
+inline double timestampAge(int64_t timestamp) {
+	auto now = timestampNow();
+	return timestamp < now ? (double)(now - timestamp) / 1.0e9 : 0.0;
+}
+
+
+
 enum class RequestType : uint32_t {
 	None,
 
@@ -25,6 +41,7 @@ enum class RequestType : uint32_t {
 	OpenVR_AxisEvent,
 	OpenVR_ProximitySensorEvent,
 	OpenVR_VendorSpecificEvent,
+	OpenVR_SetAxisEventCoalescing, // not fire and forget
 
 	// These are indented to manage virtual devices and require the internal device id.
 	// The Reply is send to the client's message queue.
@@ -38,6 +55,10 @@ enum class RequestType : uint32_t {
 	VirtualDevices_RemoveDeviceProperty,
 	VirtualDevices_SetDevicePose,
 	VirtualDevices_SetControllerState,
+	VirtualDevices_SetDeviceProperties,
+	VirtualDevices_SetControllerStateDelta,
+	VirtualDevices_SetPoseExtrapolation,
+	VirtualDevices_SetPoseResampling,
 
 	DeviceManipulation_GetDeviceInfo,
 	DeviceManipulation_ButtonMapping,
@@ -49,7 +70,13 @@ enum class RequestType : uint32_t {
 	DeviceManipulation_MotionCompensationMode,
 	DeviceManipulation_FakeDisconnectedMode,
 	DeviceManipulation_TriggerHapticPulse,
-	DeviceManipulation_SetMotionCompensationProperties
+	DeviceManipulation_SetMotionCompensationProperties,
+	DeviceManipulation_SetPoseFilter,
+	DeviceManipulation_SetMotionCompensationGroup,
+	DeviceManipulation_SetRoutes,
+	DeviceManipulation_SetAxisTransform,
+	DeviceManipulation_GetAllDeviceInfo,
+	IPC_Subscribe
 };
 
 
@@ -68,7 +95,10 @@ enum class ReplyType : uint32_t {
 	VirtualDevices_AddDevice,
 
 	DeviceManipulation_GetDeviceInfo,
-	DeviceManipulation_GetDeviceOffsets
+	DeviceManipulation_GetDeviceOffsets,
+	DeviceManipulation_GetAllDeviceInfo,
+
+	Notification // pushed by the driver, messageId is always 0
 };
 
 
@@ -152,6 +182,14 @@ struct Request_OpenVR_VendorSpecificEvent {
 };
 
 
+struct Request_OpenVR_SetAxisEventCoalescing {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	bool enable;
+	uint32_t flushIntervalMs; // 0 .. flush every frame
+};
+
+
 struct Request_VirtualDevices_GenericClientMessage {
 	uint32_t clientId;
 	uint32_t messageId; // Used to associate with Reply
@@ -199,6 +237,30 @@ struct Request_VirtualDevices_RemoveDeviceProperty {
 	vr::ETrackedDeviceProperty deviceProperty;
 };
 
+#define REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_DATASIZE 256
+// Limits of a whole batch, larger batches are rejected when they are committed
+#define REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_MAXBATCHSIZE (64 * 1024)
+#define REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_MAXENTRIES 1024
+
+// Header of a packed entry in Request_VirtualDevices_SetDeviceProperties::data, the value bytes follow directly.
+struct Request_VirtualDevices_SetDeviceProperties_Entry {
+	vr::ETrackedDeviceProperty deviceProperty;
+	DevicePropertyValueType valueType;
+	uint32_t valueSize; // 0 .. remove property
+};
+
+// Large property lists are split into several messages. The driver stages the entries per client
+// and applies all of them at once when it receives the message with the commit flag set.
+struct Request_VirtualDevices_SetDeviceProperties {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t virtualDeviceId;
+	bool commit;
+	uint32_t entryCount;
+	uint32_t dataSize;
+	uint8_t data[REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_DATASIZE];
+};
+
 struct Request_VirtualDevices_SetDevicePose {
 	uint32_t clientId;
 	uint32_t messageId; // Used to associate with Reply
@@ -213,6 +275,34 @@ struct Request_VirtualDevices_SetControllerState {
 	vr::VRControllerState_t controllerState;
 };
 
+// Button masks are always sent in full, axes only when they changed. The message is sent truncated
+// after the last contained axis (see Request::controllerStateDeltaSize()).
+struct Request_VirtualDevices_SetControllerStateDelta {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t virtualDeviceId;
+	uint32_t packetNum;
+	uint64_t buttonPressed;
+	uint64_t buttonTouched;
+	uint32_t dirtyAxes; // bit i set .. axis i is contained in axes
+	vr::VRControllerAxis_t axes[vr::k_unControllerStateAxisCount]; // dirty axes only, in ascending order
+};
+
+struct Request_VirtualDevices_SetPoseExtrapolation {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t virtualDeviceId;
+	double horizon; // seconds
+};
+
+struct Request_VirtualDevices_SetPoseResampling {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t virtualDeviceId;
+	double delay; // seconds
+	double outputRate; // Hz, 0 .. disabled
+};
+
 struct Request_DeviceManipulation_ButtonMapping {
 	uint32_t clientId;
 	uint32_t messageId; // Used to associate with Reply
@@ -227,23 +317,9 @@ struct Request_DeviceManipulation_SetDeviceOffsets {
 	uint32_t clientId;
 	uint32_t messageId; // Used to associate with Reply
 	uint32_t deviceId;
-	uint32_t enableOffsets; // 0 .. don't change, 1 .. enable, 2 .. disable
 	uint32_t offsetOperation; // 0 .. set, 1 .. add
-	// world-from-driver universe offsets
-	bool worldFromDriverRotationOffsetValid;
-	vr::HmdQuaternion_t worldFromDriverRotationOffset;
-	bool worldFromDriverTranslationOffsetValid;
-	vr::HmdVector3d_t worldFromDriverTranslationOffset;
-	// driver-from-head universe offsets
-	bool driverFromHeadRotationOffsetValid;
-	vr::HmdQuaternion_t driverFromHeadRotationOffset;
-	bool driverFromHeadTranslationOffsetValid;
-	vr::HmdVector3d_t driverFromHeadTranslationOffset;
-	// device offsets
-	bool deviceRotationOffsetValid;
-	vr::HmdQuaternion_t deviceRotationOffset;
-	bool deviceTranslationOffsetValid;
-	vr::HmdVector3d_t deviceTranslationOffset;
+	uint32_t mask; // DeviceOffsetsMask bits, all selected components are applied at once
+	DeviceOffsets offsets; // offsets.deviceId is ignored
 };
 
 struct Request_DeviceManipulation_RedirectMode {
@@ -280,24 +356,69 @@ struct Request_DeviceManipulation_TriggerHapticPulse {
 struct Request_DeviceManipulation_SetMotionCompensationProperties {
 	uint32_t clientId;
 	uint32_t messageId; // Used to associate with Reply
+	uint32_t group;
 	vr::HmdVector3d_t centerPos;
 	bool centerRelativeToDevice;
 };
 
+struct Request_DeviceManipulation_SetMotionCompensationGroup {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t deviceId;
+	uint32_t group; // MOTIONCOMPENSATION_NOGROUP .. none
+};
+
+struct Request_DeviceManipulation_SetPoseFilter {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t deviceId;
+	uint32_t stageCount; // 0 .. no filtering
+	PoseFilterStage stages[POSEFILTER_MAXSTAGES];
+};
+
+struct Request_DeviceManipulation_SetRoutes {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t routeCount; // replaces all routes, 0 .. clear
+	DeviceRoute routes[DEVICEROUTING_MAXROUTES];
+};
+
+struct Request_DeviceManipulation_SetAxisTransform {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t deviceId;
+	AxisTransform transform; // replaces the transform of transform.axisId
+};
+
+struct Request_DeviceManipulation_GetAllDeviceInfo {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t knownSequence; // sequence of the last reply, 0 .. none
+};
+
+struct Request_IPC_Subscribe {
+	uint32_t clientId;
+	uint32_t messageId; // Used to associate with Reply
+	uint32_t notificationClasses; // DeviceNotificationClass bit mask, replaces the previous one, 0 .. unsubscribe
+};
+
 
 struct Request {
 	Request() {}
 	Request(RequestType type) : type(type) {
-		timestamp = std::chrono::duration_cast <std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		timestamp = timestampNow();
 	}
-	Request(RequestType type, uint64_t timestamp) : type(type), timestamp(timestamp) {}
+	Request(RequestType type, int64_t timestamp) : type(type), timestamp(timestamp) {}
 
 	void refreshTimestamp() {
-		timestamp = std::chrono::duration_cast <std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		timestamp = timestampNow();
 	}
 
+	// Number of bytes that need to be sent for a controller state delta containing axisCount axes
+	static size_t controllerStateDeltaSize(unsigned axisCount);
+
 	RequestType type = RequestType::None;
-	int64_t timestamp = 0; // milliseconds since epoch
+	int64_t timestamp = 0; // steady_clock nanoseconds
 	union {
 		Request_IPC_ClientConnect ipc_ClientConnect;
 		Request_IPC_ClientDisconnect ipc_ClientDisconnect;
@@ -307,6 +428,7 @@ struct Request {
 		Request_OpenVR_AxisEvent ipc_AxisEvent;
 		Request_OpenVR_ProximitySensorEvent ovr_ProximitySensorEvent;
 		Request_OpenVR_VendorSpecificEvent ovr_VendorSpecificEvent;
+		Request_OpenVR_SetAxisEventCoalescing ovr_SetAxisEventCoalescing;
 		Request_VirtualDevices_GenericClientMessage vd_GenericClientMessage;
 		Request_VirtualDevices_GenericDeviceIdMessage vd_GenericDeviceIdMessage;
 		Request_VirtualDevices_AddDevice vd_AddDevice;
@@ -314,6 +436,10 @@ struct Request {
 		Request_VirtualDevices_RemoveDeviceProperty vd_RemoveDeviceProperty;
 		Request_VirtualDevices_SetDevicePose vd_SetDevicePose;
 		Request_VirtualDevices_SetControllerState vd_SetControllerState;
+		Request_VirtualDevices_SetDeviceProperties vd_SetDeviceProperties;
+		Request_VirtualDevices_SetControllerStateDelta vd_SetControllerStateDelta;
+		Request_VirtualDevices_SetPoseExtrapolation vd_SetPoseExtrapolation;
+		Request_VirtualDevices_SetPoseResampling vd_SetPoseResampling;
 		Request_DeviceManipulation_ButtonMapping dm_ButtonMapping;
 		Request_DeviceManipulation_SetDeviceOffsets dm_DeviceOffsets;
 		Request_DeviceManipulation_RedirectMode dm_RedirectMode;
@@ -321,18 +447,30 @@ struct Request {
 		Request_DeviceManipulation_MotionCompensationMode dm_MotionCompensationMode;
 		Request_DeviceManipulation_TriggerHapticPulse dm_triggerHapticPulse;
 		Request_DeviceManipulation_SetMotionCompensationProperties dm_SetMotionCompensationProperties;
+		Request_DeviceManipulation_SetPoseFilter dm_SetPoseFilter;
+		Request_DeviceManipulation_SetMotionCompensationGroup dm_SetMotionCompensationGroup;
+		Request_DeviceManipulation_SetRoutes dm_SetRoutes;
+		Request_DeviceManipulation_SetAxisTransform dm_SetAxisTransform;
+		Request_DeviceManipulation_GetAllDeviceInfo dm_GetAllDeviceInfo;
+		Request_IPC_Subscribe ipc_Subscribe;
 	} msg;
 };
 
+inline size_t Request::controllerStateDeltaSize(unsigned axisCount) {
+	return offsetof(Request, msg) + offsetof(Request_VirtualDevices_SetControllerStateDelta, axes) + axisCount * sizeof(vr::VRControllerAxis_t);
+}
+
 
 
 struct Reply_IPC_ClientConnect {
 	uint32_t clientId;
 	uint32_t ipcProcotolVersion;
+	char requestQueueName[128]; // dedicated queue for all further requests, empty .. keep using the server queue
 };
 
 struct Reply_IPC_Ping {
 	uint64_t nonce;
+	int64_t receiveTimestamp; // driver clock when the ping was received
 };
 
 struct Reply_VirtualDevices_GetDeviceCount {
@@ -366,6 +504,37 @@ struct Reply_DeviceManipulation_GetDeviceInfo {
 	bool offsetsEnabled;
 	bool buttonMappingEnabled;
 	bool redirectSuspended;
+	uint32_t motionCompensationGroup;
+	uint32_t refDeviceId;
+};
+
+#define DEVICEINFOENTRY_NOREFDEVICE 0xFF
+#define DEVICEINFOENTRY_NOGROUP 0xFF // MOTIONCOMPENSATION_NOGROUP does not fit into a byte
+static_assert(MOTIONCOMPENSATION_MAXGROUPS < DEVICEINFOENTRY_NOGROUP, "motion compensation groups must fit into DeviceInfoEntry");
+
+// Packed to keep the reply small, all devices fit into one message
+struct DeviceInfoEntry {
+	uint8_t deviceId;
+	uint8_t deviceClass;
+	uint8_t deviceMode;
+	uint8_t flags; // see DeviceInfoEntryFlags
+	uint8_t refDeviceId; // DEVICEINFOENTRY_NOREFDEVICE .. none
+	uint8_t motionCompensationGroup; // DEVICEINFOENTRY_NOGROUP .. MOTIONCOMPENSATION_NOGROUP
+	uint8_t reserved[2];
+};
+
+enum DeviceInfoEntryFlags : uint8_t {
+	DeviceInfoEntry_OffsetsEnabled = 1,
+	DeviceInfoEntry_ButtonMappingEnabled = 2,
+	DeviceInfoEntry_RedirectSuspended = 4
+};
+
+// The message is sent truncated after the last device (see Reply::allDeviceInfoSize()).
+struct Reply_DeviceManipulation_GetAllDeviceInfo {
+	uint32_t sequence; // changes whenever a device is added or its manipulation state changes
+	bool unchanged; // sequence equals knownSequence, devices is empty
+	uint32_t deviceCount;
+	DeviceInfoEntry devices[vr::k_unMaxTrackedDeviceCount];
 };
 
 
@@ -385,12 +554,18 @@ struct Reply_DeviceManipulation_GetDeviceOffsets {
 struct Reply {
 	Reply() {}
 	Reply(ReplyType type) : type(type) {
-		timestamp = std::chrono::duration_cast <std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		timestamp = timestampNow();
 	}
-	Reply(ReplyType type, uint64_t timestamp) : type(type), timestamp(timestamp) {}
+	Reply(ReplyType type, int64_t timestamp) : type(type), timestamp(timestamp) {}
+
+	// Number of bytes that need to be sent for an all device info reply containing deviceCount devices
+	static size_t allDeviceInfoSize(unsigned deviceCount);
+
+	// Whether a received message of recvSize bytes is complete
+	bool isComplete(uint64_t recvSize) const;
 
 	ReplyType type = ReplyType::None;
-	uint64_t timestamp = 0; // milliseconds since epoch
+	int64_t timestamp = 0; // steady_clock nanoseconds (driver clock)
 	uint32_t messageId;
 	ReplyStatus status;
 	union {
@@ -403,9 +578,23 @@ struct Reply {
 		Reply_VirtualDevices_AddDevice vd_AddDevice;
 		Reply_DeviceManipulation_GetDeviceInfo dm_deviceInfo;
 		Reply_DeviceManipulation_GetDeviceOffsets dm_deviceOffsets;
+		Reply_DeviceManipulation_GetAllDeviceInfo dm_allDeviceInfo;
+		DeviceNotification notification;
 	} msg;
 };
 
+inline size_t Reply::allDeviceInfoSize(unsigned deviceCount) {
+	return offsetof(Reply, msg) + offsetof(Reply_DeviceManipulation_GetAllDeviceInfo, devices) + deviceCount * sizeof(DeviceInfoEntry);
+}
+
+inline bool Reply::isComplete(uint64_t recvSize) const {
+	if (recvSize == sizeof(Reply)) {
+		return true;
+	}
+	return type == ReplyType::DeviceManipulation_GetAllDeviceInfo && recvSize >= allDeviceInfoSize(0) && recvSize < sizeof(Reply)
+		&& msg.dm_allDeviceInfo.deviceCount <= vr::k_unMaxTrackedDeviceCount && recvSize >= allDeviceInfoSize(msg.dm_allDeviceInfo.deviceCount);
+}
+
 
 } // end namespace ipc
 } // end namespace vrinputemulator
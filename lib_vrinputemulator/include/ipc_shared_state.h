@@ -0,0 +1,84 @@
+#pragma once
+
+#include "vrinputemulator_types.h"
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+
+// Name of the shared memory segment the driver mirrors its state into
+#define IPC_SHAREDSTATE_NAME "driver_vrinputemulator.shared_state"
+
+namespace vrinputemulator {
+namespace ipc {
+
+
+/**
+* A value in shared memory protected by a sequence lock.
+*
+* The driver is the only writer and serializes writes per value, clients copy the value without locking. Unlike the
+* driver's SeqLock a reader gives up after a bounded number of attempts, since the writer lives in another process
+* and may have died in the middle of a write. Aligned to a cache line so that neighbouring values don't interfere.
+**/
+template<class T>
+struct alignas(64) SharedSeqLock {
+	static_assert(std::is_trivially_copyable<T>::value, "SharedSeqLock requires a trivially copyable type");
+	static_assert(ATOMIC_INT_LOCK_FREE == 2, "SharedSeqLock requires lock-free atomics");
+
+	std::atomic<uint32_t> sequence; // odd while a write is in progress
+	T value;
+
+	// Returns false when no consistent copy could be taken
+	bool tryLoad(T& result, unsigned maxAttempts = 256) const {
+		for (unsigned n = 0; n < maxAttempts; ++n) {
+			auto seq = sequence.load(std::memory_order_acquire);
+			if ((seq & 1) == 0) {
+				std::memcpy(&result, &value, sizeof(T));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (sequence.load(std::memory_order_relaxed) == seq) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void store(const T& v) {
+		auto seq = sequence.load(std::memory_order_relaxed);
+		sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(&value, &v, sizeof(T));
+		sequence.store(seq + 2, std::memory_order_release);
+	}
+};
+
+
+struct SharedVirtualDeviceInfo {
+	bool valid; // false .. there is no virtual device with this id
+	uint32_t openvrDeviceId;
+	VirtualDeviceType deviceType;
+	char deviceSerial[128];
+};
+
+struct SharedVirtualDevice {
+	SharedSeqLock<SharedVirtualDeviceInfo> info;
+	SharedSeqLock<vr::DriverPose_t> pose;
+	SharedSeqLock<vr::VRControllerState_t> controllerState; // only TrackedController devices
+};
+
+struct SharedDeviceOffsets {
+	bool valid; // false .. the driver does not know a device with this id
+	DeviceOffsets offsets;
+};
+
+
+// Read-only for clients. Everything is zero until the driver has written it.
+struct SharedState {
+	uint32_t protocolVersion; // IPC_PROTOCOL_VERSION of the driver
+	SharedVirtualDevice virtualDevices[vr::k_unMaxTrackedDeviceCount]; // index == virtual device id
+	SharedSeqLock<SharedDeviceOffsets> deviceOffsets[vr::k_unMaxTrackedDeviceCount]; // index == openvr device id
+};
+
+
+} // end namespace ipc
+} // end namespace vrinputemulator
@@ -65,6 +65,14 @@ inline vr::HmdVector3d_t operator-(const vr::HmdVector3d_t& lhs, const double (&
 	};
 }
 
+inline vr::HmdVector3d_t operator*(const vr::HmdVector3d_t& lhs, double rhs) {
+	return{
+		lhs.v[0] * rhs,
+		lhs.v[1] * rhs,
+		lhs.v[2] * rhs
+	};
+}
+
 
 namespace vrmath {
 
@@ -78,6 +86,15 @@ namespace vrmath {
 		};
 	}
 
+	// Rotation vector: direction is the rotation axis, length the angle in radians
+	inline vr::HmdQuaternion_t quaternionFromRotationVector(const double (&v)[3]) {
+		auto angle = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (angle < 1e-12) {
+			return { 1.0, 0.0, 0.0, 0.0 };
+		}
+		return quaternionFromRotationAxis(angle, v[0] / angle, v[1] / angle, v[2] / angle);
+	}
+
 	inline vr::HmdQuaternion_t quaternionFromRotationX(double rot) {
 		auto ha = rot / 2;
 		return{
@@ -182,6 +199,14 @@ namespace vrmath {
 		}
 	}
 
+	inline vr::HmdVector3d_t crossProduct(const vr::HmdVector3d_t& a, const vr::HmdVector3d_t& b) {
+		return {
+			a.v[1] * b.v[2] - a.v[2] * b.v[1],
+			a.v[2] * b.v[0] - a.v[0] * b.v[2],
+			a.v[0] * b.v[1] - a.v[1] * b.v[0]
+		};
+	}
+
 	inline vr::HmdMatrix34_t matMul33(const vr::HmdMatrix34_t& a, const vr::HmdMatrix34_t& b) {
 		vr::HmdMatrix34_t result;
 		for (unsigned i = 0; i < 3; i++) {
@@ -239,6 +264,68 @@ namespace vrmath {
 		return result;
 	}
 
+	// Moves the pose dt seconds forward using its linear velocity, acceleration and angular velocity
+	template<class PoseType>
+	inline void extrapolatePose(PoseType& pose, double dt) {
+		for (unsigned i = 0; i < 3; ++i) {
+			pose.vecPosition[i] += pose.vecVelocity[i] * dt + 0.5 * pose.vecAcceleration[i] * dt * dt;
+			pose.vecVelocity[i] += pose.vecAcceleration[i] * dt;
+		}
+		double rot[3] = {
+			pose.vecAngularVelocity[0] * dt + 0.5 * pose.vecAngularAcceleration[0] * dt * dt,
+			pose.vecAngularVelocity[1] * dt + 0.5 * pose.vecAngularAcceleration[1] * dt * dt,
+			pose.vecAngularVelocity[2] * dt + 0.5 * pose.vecAngularAcceleration[2] * dt * dt
+		};
+		pose.qRotation = quaternionFromRotationVector(rot) * pose.qRotation;
+		for (unsigned i = 0; i < 3; ++i) {
+			pose.vecAngularVelocity[i] += pose.vecAngularAcceleration[i] * dt;
+		}
+	}
+
+	// Spherical linear interpolation, takes the shorter arc
+	inline vr::HmdQuaternion_t quaternionSlerp(const vr::HmdQuaternion_t& a, const vr::HmdQuaternion_t& b, double t) {
+		auto d = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+		auto sign = 1.0;
+		if (d < 0.0) {
+			d = -d;
+			sign = -1.0;
+		}
+		double wa, wb;
+		if (d > 0.9995) {
+			// Nearly parallel, lerp is precise enough and avoids dividing by sin(~0)
+			wa = 1.0 - t;
+			wb = t;
+		} else {
+			auto theta = std::acos(d);
+			auto s = std::sin(theta);
+			wa = std::sin((1.0 - t) * theta) / s;
+			wb = std::sin(t * theta) / s;
+		}
+		wb *= sign;
+		vr::HmdQuaternion_t r = {
+			wa * a.w + wb * b.w,
+			wa * a.x + wb * b.x,
+			wa * a.y + wb * b.y,
+			wa * a.z + wb * b.z
+		};
+		auto n = std::sqrt(r.w * r.w + r.x * r.x + r.y * r.y + r.z * r.z);
+		return { r.w / n, r.x / n, r.y / n, r.z / n };
+	}
+
+	// Interpolates the pose between a (t = 0) and b (t = 1). Rotation uses slerp, everything else is linear.
+	template<class PoseType>
+	inline void interpolatePose(PoseType& result, const PoseType& a, const PoseType& b, double t) {
+		result = b;
+		for (unsigned i = 0; i < 3; ++i) {
+			result.vecPosition[i] = a.vecPosition[i] + (b.vecPosition[i] - a.vecPosition[i]) * t;
+			result.vecVelocity[i] = a.vecVelocity[i] + (b.vecVelocity[i] - a.vecVelocity[i]) * t;
+			result.vecAcceleration[i] = a.vecAcceleration[i] + (b.vecAcceleration[i] - a.vecAcceleration[i]) * t;
+			result.vecAngularVelocity[i] = a.vecAngularVelocity[i] + (b.vecAngularVelocity[i] - a.vecAngularVelocity[i]) * t;
+			result.vecAngularAcceleration[i] = a.vecAngularAcceleration[i] + (b.vecAngularAcceleration[i] - a.vecAngularAcceleration[i]) * t;
+		}
+		result.qRotation = quaternionSlerp(a.qRotation, b.qRotation, t);
+	}
+
 	inline vr::HmdMatrix34_t transposeMul33(const vr::HmdMatrix34_t& a) {
 		vr::HmdMatrix34_t result;
 		for (unsigned i = 0; i < 3; i++) {
@@ -6,11 +6,18 @@
 #include <mutex>
 #include <thread>
 #include <map>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
 #include <memory>
 #include <random>
 #include <string>
 #include <openvr.h>
 #include <boost/interprocess/ipc/message_queue.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/named_semaphore.hpp>
 
 
 namespace vr {
@@ -83,6 +90,7 @@ namespace vr {
 
 
 #include <ipc_protocol.h>
+#include <ipc_shared_state.h>
 
 
 namespace vrinputemulator {
@@ -119,6 +127,10 @@ class vrinputemulator_toomanydevices : public vrinputemulator_exception {
 	using vrinputemulator_exception::vrinputemulator_exception;
 };
 
+class vrinputemulator_timeout : public vrinputemulator_exception {
+	using vrinputemulator_exception::vrinputemulator_exception;
+};
+
 
 struct VirtualDeviceInfo {
 	uint32_t virtualDeviceId;
@@ -128,6 +140,183 @@ struct VirtualDeviceInfo {
 };
 
 
+struct AllDeviceInfo {
+	uint32_t sequence;
+	bool unchanged; // nothing changed since the known sequence, devices is empty
+	std::vector<DeviceInfo> devices;
+};
+
+
+// List of device properties to be set or removed with a single call to setVirtualDeviceProperties().
+class DevicePropertyList {
+	friend class VRInputEmulator;
+public:
+	void set(vr::ETrackedDeviceProperty deviceProperty, int32_t value);
+	void set(vr::ETrackedDeviceProperty deviceProperty, uint64_t value);
+	void set(vr::ETrackedDeviceProperty deviceProperty, float value);
+	void set(vr::ETrackedDeviceProperty deviceProperty, bool value);
+	void set(vr::ETrackedDeviceProperty deviceProperty, const std::string& value);
+	void set(vr::ETrackedDeviceProperty deviceProperty, const char* value);
+	void set(vr::ETrackedDeviceProperty deviceProperty, const vr::HmdMatrix34_t& value);
+	void set(vr::ETrackedDeviceProperty deviceProperty, const vr::HmdMatrix44_t& value);
+	void set(vr::ETrackedDeviceProperty deviceProperty, const vr::HmdVector3_t& value);
+	void set(vr::ETrackedDeviceProperty deviceProperty, const vr::HmdVector4_t& value);
+	void remove(vr::ETrackedDeviceProperty deviceProperty);
+
+	size_t size() const { return _entries.size(); }
+	bool empty() const { return _entries.empty(); }
+	void clear() { _entries.clear(); }
+
+private:
+	// Each entry is already packed into its wire format (entry header + value bytes)
+	std::vector<std::vector<uint8_t>> _entries;
+	void _add(vr::ETrackedDeviceProperty deviceProperty, DevicePropertyValueType valueType, const void* value, uint32_t valueSize);
+};
+
+
+// Shared state of a request that waits for its reply. Completed by the ipc thread.
+struct _AsyncRequest {
+	enum class Result { Pending, Ok, TimedOut, Disconnected };
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	Result result = Result::Pending;
+	ipc::Reply reply;
+	std::chrono::steady_clock::time_point deadline;
+	std::function<void()> callback;
+	// Allocation-free alternative to callback (used to resume coroutines)
+	void (*resumeHook)(void*) = nullptr;
+	void* resumeContext = nullptr;
+
+	void complete(Result r, const ipc::Reply* resp = nullptr) {
+		std::function<void()> cb;
+		void (*hook)(void*);
+		void* hookContext;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (result != Result::Pending) {
+				return;
+			}
+			if (resp) {
+				reply = *resp;
+			}
+			result = r;
+			cb = std::move(callback);
+			callback = nullptr;
+			hook = resumeHook;
+			hookContext = resumeContext;
+			resumeHook = nullptr;
+		}
+		cv.notify_all();
+		if (cb) {
+			cb();
+		}
+		if (hook) {
+			hook(hookContext);
+		}
+	}
+};
+
+
+/**
+* Result of an asynchronous VRInputEmulator call.
+*
+* get() blocks until the reply has been received and then returns the value or throws the same exceptions
+* as the corresponding modal call. Requests that are not answered before their deadline throw vrinputemulator_timeout.
+* A completion callback can be registered with then(). It is called from the ipc thread, so it must not wait
+* on other replies (modal calls included).
+**/
+template<class T>
+class AsyncResult {
+	friend class VRInputEmulator;
+public:
+	typedef std::function<T(const ipc::Reply&)> ReplyHandler;
+
+	// Fire-and-forget result, ready immediately
+	AsyncResult() {}
+	// Result of a request that is completed elsewhere by calling request->complete()
+	AsyncResult(std::shared_ptr<_AsyncRequest> request, ReplyHandler handler) : _request(std::move(request)), _handler(std::move(handler)) {}
+
+	// false for fire-and-forget requests
+	bool valid() const { return (bool)_request; }
+
+	bool isReady() const {
+		if (!_request) {
+			return true;
+		}
+		std::lock_guard<std::mutex> lock(_request->mutex);
+		return _request->result != _AsyncRequest::Result::Pending;
+	}
+
+	// Returns true when the reply is available (or the request failed) within the given time
+	bool wait(uint32_t timeoutMs) const {
+		if (!_request) {
+			return true;
+		}
+		std::unique_lock<std::mutex> lock(_request->mutex);
+		return _request->cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() {
+			return _request->result != _AsyncRequest::Result::Pending;
+		});
+	}
+
+	T get() const {
+		if (!_request) {
+			return T();
+		}
+		{
+			std::unique_lock<std::mutex> lock(_request->mutex);
+			_request->cv.wait(lock, [this]() {
+				return _request->result != _AsyncRequest::Result::Pending;
+			});
+		}
+		if (_request->result == _AsyncRequest::Result::TimedOut) {
+			throw vrinputemulator_timeout("Request timed out.");
+		} else if (_request->result == _AsyncRequest::Result::Disconnected) {
+			throw vrinputemulator_connectionerror("Connection closed while waiting for reply.");
+		}
+		return _handler(_request->reply);
+	}
+
+	// Calls the callback once the request has completed (immediately when it already has)
+	void then(std::function<void(const AsyncResult<T>&)> callback) {
+		if (!_request) {
+			callback(*this);
+			return;
+		}
+		AsyncResult<T> self = *this;
+		{
+			std::lock_guard<std::mutex> lock(_request->mutex);
+			if (_request->result == _AsyncRequest::Result::Pending) {
+				_request->callback = [self, callback]() {
+					callback(self);
+				};
+				return;
+			}
+		}
+		callback(self);
+	}
+
+	// Low-level variant of then() that does not allocate. Returns false when the request has already completed,
+	// in which case fn is not called.
+	bool resumeOnCompletion(void (*fn)(void*), void* context) {
+		if (!_request) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(_request->mutex);
+		if (_request->result != _AsyncRequest::Result::Pending) {
+			return false;
+		}
+		_request->resumeHook = fn;
+		_request->resumeContext = context;
+		return true;
+	}
+
+private:
+	std::shared_ptr<_AsyncRequest> _request;
+	ReplyHandler _handler;
+};
+
+
 class VRInputEmulator {
 public:
 	VRInputEmulator(const std::string& driverQueue = "driver_vrinputemulator.server_queue", const std::string& clientQueue = "driver_vrinputemulator.client_queue.");
@@ -137,20 +326,58 @@ public:
 	bool isConnected() const;
 	void disconnect();
 
+	// Deadline for replies to modal and asynchronous calls (0 .. wait forever)
+	void setRequestTimeout(uint32_t timeoutMs) { _requestTimeoutMs = timeoutMs; }
+	uint32_t requestTimeout() const { return _requestTimeoutMs; }
+
 	void ping(bool modal = true, bool enableReply = false);
+	AsyncResult<void> pingAsync();
+
+	// Estimates offset and drift between the local steady_clock and the driver's from the round trips of
+	// a few pings. Called by connect(), call it again now and then to keep the drift estimate accurate.
+	// All message timestamps are converted to the driver's clock before sending.
+	void syncClock(unsigned samples = 8);
+	int64_t toDriverTime(int64_t localTimestamp) const;
+
+	// When enabled, openvrButtonEvent and openvrAxisEvent calls are collected and sent as batch messages.
+	// A batch is sent when it is full, when flush() is called or maxDelayMs after its first event
+	// (checked by the ipc thread, so call flush() once per frame when latency matters).
+	void setEventBuffering(bool enable, uint32_t maxDelayMs = 10);
+	bool eventBuffering() const { return _eventBuffering; }
+	void flush();
+
+	// Lets the driver push notifications of the given classes (DeviceNotificationClass bit mask, 0 .. unsubscribe).
+	// The handler is called from the ipc thread, so it must not block and must not make modal calls.
+	typedef std::function<void(const DeviceNotification&)> NotificationHandler;
+	void subscribe(uint32_t notificationClasses, NotificationHandler handler, bool modal = true);
+	AsyncResult<void> subscribeAsync(uint32_t notificationClasses, NotificationHandler handler, bool wantReply = true);
 
 	void openvrUpdatePose(uint32_t deviceId, const vr::DriverPose_t& pose);
 	void openvrButtonEvent(ButtonEventType eventType, uint32_t deviceId, vr::EVRButtonId buttonId, double timeOffset = 0.0);
 	void openvrAxisEvent(uint32_t deviceId, uint32_t axisId, const vr::VRControllerAxis_t& axisState);
 	void openvrProximitySensorEvent(uint32_t deviceId, bool sensorTriggered);
 	void openvrVendorSpecificEvent(uint32_t deviceId, vr::EVREventType eventType, const vr::VREvent_Data_t& eventData, double timeOffset = 0.0);
+	// Lets the driver only forward the latest axis state per device and axis once per frame (or every flushIntervalMs)
+	void setAxisEventCoalescing(bool enable, uint32_t flushIntervalMs = 0, bool modal = true);
+	AsyncResult<void> setAxisEventCoalescingAsync(bool enable, uint32_t flushIntervalMs = 0, bool wantReply = true);
+
+	// The modal calls below are thin wrappers around their *Async counterparts.
+	// *Async calls with wantReply = false are sent fire-and-forget and return an empty result.
 
 	uint32_t getVirtualDeviceCount();
+	AsyncResult<uint32_t> getVirtualDeviceCountAsync();
+	// The modal getters below read the driver's shared memory mirror when it is available and only fall back to
+	// an ipc request when it is not (or the device is unknown). The asynchronous variants always send a request.
 	VirtualDeviceInfo getVirtualDeviceInfo(uint32_t virtualDeviceId);
+	AsyncResult<VirtualDeviceInfo> getVirtualDeviceInfoAsync(uint32_t virtualDeviceId);
 	vr::DriverPose_t getVirtualDevicePose(uint32_t virtualDeviceId);
+	AsyncResult<vr::DriverPose_t> getVirtualDevicePoseAsync(uint32_t virtualDeviceId);
 	vr::VRControllerState_t getVirtualControllerState(uint32_t virtualDeviceId);
+	AsyncResult<vr::VRControllerState_t> getVirtualControllerStateAsync(uint32_t virtualDeviceId);
 	uint32_t addVirtualDevice(VirtualDeviceType deviceType, const std::string& deviceSerial, bool softfail = true);
+	AsyncResult<uint32_t> addVirtualDeviceAsync(VirtualDeviceType deviceType, const std::string& deviceSerial, bool softfail = true);
 	void publishVirtualDevice(uint32_t virtualDeviceId, bool modal = true);
+	AsyncResult<void> publishVirtualDeviceAsync(uint32_t virtualDeviceId, bool wantReply = true);
 	void setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, int32_t value, bool modal = true);
 	void setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, uint64_t value, bool modal = true);
 	void setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, float value, bool modal = true);
@@ -158,38 +385,114 @@ public:
 	void setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const std::string& value, bool modal = true);
 	void setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const char* value, bool modal = true);
 	void setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const vr::HmdMatrix34_t& value, bool modal = true);
+	AsyncResult<void> setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, int32_t value, bool wantReply = true);
+	AsyncResult<void> setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, uint64_t value, bool wantReply = true);
+	AsyncResult<void> setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, float value, bool wantReply = true);
+	AsyncResult<void> setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, bool value, bool wantReply = true);
+	AsyncResult<void> setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const std::string& value, bool wantReply = true);
+	AsyncResult<void> setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const char* value, bool wantReply = true);
+	AsyncResult<void> setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const vr::HmdMatrix34_t& value, bool wantReply = true);
 	void removeVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, bool modal = true);
+	AsyncResult<void> removeVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, bool wantReply = true);
+	void setVirtualDeviceProperties(uint32_t virtualDeviceId, const DevicePropertyList& properties, bool modal = true);
+	AsyncResult<void> setVirtualDevicePropertiesAsync(uint32_t virtualDeviceId, const DevicePropertyList& properties, bool wantReply = true);
 	void setVirtualDevicePose(uint32_t virtualDeviceId, const vr::DriverPose_t& pose, bool modal = true);
+	AsyncResult<void> setVirtualDevicePoseAsync(uint32_t virtualDeviceId, const vr::DriverPose_t& pose, bool wantReply = true);
 	void setVirtualControllerState(uint32_t virtualDeviceId, const vr::VRControllerState_t& state, bool modal = true);
+	AsyncResult<void> setVirtualControllerStateAsync(uint32_t virtualDeviceId, const vr::VRControllerState_t& state, bool wantReply = true);
+	// Between pose updates the driver extrapolates the last pose for at most horizonSeconds (0 .. hold the last pose)
+	void setVirtualDevicePoseExtrapolation(uint32_t virtualDeviceId, double horizonSeconds, bool modal = true);
+	AsyncResult<void> setVirtualDevicePoseExtrapolationAsync(uint32_t virtualDeviceId, double horizonSeconds, bool wantReply = true);
+	// The driver emits poses at outputRate Hz, interpolated between the two latest samples as they were delaySeconds ago
+	// (outputRate 0 .. disabled, poses are sent on every update and each frame like before)
+	void setVirtualDevicePoseResampling(uint32_t virtualDeviceId, double delaySeconds, double outputRate, bool modal = true);
+	AsyncResult<void> setVirtualDevicePoseResamplingAsync(uint32_t virtualDeviceId, double delaySeconds, double outputRate, bool wantReply = true);
 
 	void enableDeviceButtonMapping(uint32_t deviceId, bool enable, bool modal = true);
+	AsyncResult<void> enableDeviceButtonMappingAsync(uint32_t deviceId, bool enable, bool wantReply = true);
 	void addDeviceButtonMapping(uint32_t deviceId, vr::EVRButtonId button, vr::EVRButtonId mapped, bool modal = true);
+	AsyncResult<void> addDeviceButtonMappingAsync(uint32_t deviceId, vr::EVRButtonId button, vr::EVRButtonId mapped, bool wantReply = true);
 	void removeDeviceButtonMapping(uint32_t deviceId, vr::EVRButtonId button, bool modal = true);
+	AsyncResult<void> removeDeviceButtonMappingAsync(uint32_t deviceId, vr::EVRButtonId button, bool wantReply = true);
 	void removeAllDeviceButtonMappings(uint32_t deviceId, bool modal = true);
+	AsyncResult<void> removeAllDeviceButtonMappingsAsync(uint32_t deviceId, bool wantReply = true);
+
+	// Replaces the driver-side transform of transform.axisId (enabled == false .. pass the axis through unchanged)
+	void setDeviceAxisTransform(uint32_t deviceId, const AxisTransform& transform, bool modal = true);
+	AsyncResult<void> setDeviceAxisTransformAsync(uint32_t deviceId, const AxisTransform& transform, bool wantReply = true);
 
 	void getDeviceOffsets(uint32_t deviceId, DeviceOffsets& data);
+	AsyncResult<DeviceOffsets> getDeviceOffsetsAsync(uint32_t deviceId);
 	void enableDeviceOffsets(uint32_t deviceId, bool enable, bool modal = true);
+	AsyncResult<void> enableDeviceOffsetsAsync(uint32_t deviceId, bool enable, bool wantReply = true);
+	// Sets the components selected by mask (DeviceOffsetsMask bits) of offsets.deviceId with a single request.
+	// The driver's pose path sees either all of them or none, never a mix of old and new offsets.
+	void setDeviceOffsets(const DeviceOffsets& offsets, uint32_t mask = (uint32_t)DeviceOffsetsMask::All, bool modal = true);
+	AsyncResult<void> setDeviceOffsetsAsync(const DeviceOffsets& offsets, uint32_t mask = (uint32_t)DeviceOffsetsMask::All, bool wantReply = true);
+	// Same for several devices. The requests are pipelined, so this waits for one round trip instead of one per device.
+	// Throws the error of the first failed device, the other devices are updated regardless.
+	void setDeviceOffsets(const std::vector<DeviceOffsets>& offsets, uint32_t mask = (uint32_t)DeviceOffsetsMask::All);
 	void setWorldFromDriverRotationOffset(uint32_t deviceId, const vr::HmdQuaternion_t& value, bool modal = true);
+	AsyncResult<void> setWorldFromDriverRotationOffsetAsync(uint32_t deviceId, const vr::HmdQuaternion_t& value, bool wantReply = true);
 	void setWorldFromDriverTranslationOffset(uint32_t deviceId, const vr::HmdVector3d_t& value, bool modal = true);
+	AsyncResult<void> setWorldFromDriverTranslationOffsetAsync(uint32_t deviceId, const vr::HmdVector3d_t& value, bool wantReply = true);
 	void setDriverFromHeadRotationOffset(uint32_t deviceId, const vr::HmdQuaternion_t& value, bool modal = true);
+	AsyncResult<void> setDriverFromHeadRotationOffsetAsync(uint32_t deviceId, const vr::HmdQuaternion_t& value, bool wantReply = true);
 	void setDriverFromHeadTranslationOffset(uint32_t deviceId, const vr::HmdVector3d_t& value, bool modal = true);
+	AsyncResult<void> setDriverFromHeadTranslationOffsetAsync(uint32_t deviceId, const vr::HmdVector3d_t& value, bool wantReply = true);
 	void setDriverRotationOffset(uint32_t deviceId, const vr::HmdQuaternion_t& value, bool modal = true);
+	AsyncResult<void> setDriverRotationOffsetAsync(uint32_t deviceId, const vr::HmdQuaternion_t& value, bool wantReply = true);
 	void setDriverTranslationOffset(uint32_t deviceId, const vr::HmdVector3d_t& value, bool modal = true);
+	AsyncResult<void> setDriverTranslationOffsetAsync(uint32_t deviceId, const vr::HmdVector3d_t& value, bool wantReply = true);
 
 	void getDeviceInfo(uint32_t deviceId, DeviceInfo& info);
+	AsyncResult<DeviceInfo> getDeviceInfoAsync(uint32_t deviceId);
+	// Returns false (and leaves devices untouched) when nothing changed since sequence, otherwise updates sequence
+	bool getAllDeviceInfo(std::vector<DeviceInfo>& devices, uint32_t& sequence);
+	AsyncResult<AllDeviceInfo> getAllDeviceInfoAsync(uint32_t knownSequence = 0);
 	void setDeviceNormalMode(uint32_t deviceId, bool modal = true);
+	AsyncResult<void> setDeviceNormalModeAsync(uint32_t deviceId, bool wantReply = true);
 	void setDeviceFakeDisconnectedMode(uint32_t deviceId, bool modal = true);
+	AsyncResult<void> setDeviceFakeDisconnectedModeAsync(uint32_t deviceId, bool wantReply = true);
 	void setDeviceRedictMode(uint32_t deviceId, uint32_t target, bool modal = true);
+	AsyncResult<void> setDeviceRedictModeAsync(uint32_t deviceId, uint32_t target, bool wantReply = true);
 	void setDeviceSwapMode(uint32_t deviceId, uint32_t target, bool modal = true);
+	AsyncResult<void> setDeviceSwapModeAsync(uint32_t deviceId, uint32_t target, bool wantReply = true);
 	void setDeviceMotionCompensationMode(uint32_t deviceId, const vr::HmdVector3d_t& centerPos = vr::HmdVector3d_t(), bool relativeToDevice = false, bool modal = true);
+	AsyncResult<void> setDeviceMotionCompensationModeAsync(uint32_t deviceId, const vr::HmdVector3d_t& centerPos = vr::HmdVector3d_t(), bool relativeToDevice = false, bool wantReply = true);
 
+	// Sets the center of motion compensation group 0
 	void setMotionCompensationCenter(const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool modal = true);
+	AsyncResult<void> setMotionCompensationCenterAsync(const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool wantReply = true);
+	void setMotionCompensationGroupCenter(uint32_t group, const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool modal = true);
+	AsyncResult<void> setMotionCompensationGroupCenterAsync(uint32_t group, const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool wantReply = true);
+	// Each of the MOTIONCOMPENSATION_MAXGROUPS groups has its own reference device (the one in motion compensation mode)
+	// and center, and only compensates its own devices. All devices start in group 0, MOTIONCOMPENSATION_NOGROUP opts out.
+	// A second reference device for a group is rejected with vrinputemulator_alreadyinuse.
+	void setDeviceMotionCompensationGroup(uint32_t deviceId, uint32_t group, bool modal = true);
+	AsyncResult<void> setDeviceMotionCompensationGroupAsync(uint32_t deviceId, uint32_t group, bool wantReply = true);
+
+	// Filter chain applied by the driver to the device's raw poses (stageCount 0 .. no filtering, at most POSEFILTER_MAXSTAGES)
+	void setDevicePoseFilter(uint32_t deviceId, const PoseFilterStage* stages, uint32_t stageCount, bool modal = true);
+	AsyncResult<void> setDevicePoseFilterAsync(uint32_t deviceId, const PoseFilterStage* stages, uint32_t stageCount, bool wantReply = true);
+	// Single One Euro filter with default parameters
+	void enableDevicePoseFilter(uint32_t deviceId, bool enable, bool modal = true);
+	AsyncResult<void> enableDevicePoseFilterAsync(uint32_t deviceId, bool enable, bool wantReply = true);
+
+	// Replaces all device routes (at most DEVICEROUTING_MAXROUTES, routeCount 0 .. clear). A device with routes on a channel
+	// sends that channel's events only to its route targets. Redirect and swap modes keep working on top of these routes.
+	void setDeviceRoutes(const DeviceRoute* routes, uint32_t routeCount, bool modal = true);
+	AsyncResult<void> setDeviceRoutesAsync(const DeviceRoute* routes, uint32_t routeCount, bool wantReply = true);
 
 	void triggerHapticPulse(uint32_t deviceId, uint32_t axisId, uint16_t durationMicroseconds, bool directMode, bool modal = true);
+	AsyncResult<void> triggerHapticPulseAsync(uint32_t deviceId, uint32_t axisId, uint16_t durationMicroseconds, bool directMode, bool wantReply = true);
 
 private:
 	std::recursive_mutex _mutex;
+	// Held from the first staged chunk of a property batch to its commit, the driver stages batches per client
+	std::mutex _propertyBatchMutex;
 	uint32_t m_clientId = 0;
+	uint32_t _requestTimeoutMs = 5000;
 
 	bool _ipcThreadRunning = false;
 	volatile bool _ipcThreadStop = false;
@@ -198,20 +501,62 @@ private:
 
 	std::random_device _ipcRandomDevice;
 	std::uniform_int_distribution<uint32_t> _ipcRandomDist;
-	struct _ipcPromiseMapEntry {
-		_ipcPromiseMapEntry() : isValid(false) {}
-		_ipcPromiseMapEntry(std::promise<ipc::Reply>&& _promise, bool isValid = true) 
-				: promise(std::move(_promise)), isValid(isValid) {}
-		bool isValid;
-		std::promise<ipc::Reply> promise;
-	};
-	std::map<uint32_t, _ipcPromiseMapEntry> _ipcPromiseMap;
+	std::map<uint32_t, std::shared_ptr<_AsyncRequest>> _ipcPendingRequests; // messageId => request waiting for its reply
+	NotificationHandler _notificationHandler; // guarded by _mutex
+	// Read-only mirror of the driver state, nullptr .. not available
+	std::shared_ptr<boost::interprocess::shared_memory_object> _sharedStateMemory;
+	std::shared_ptr<boost::interprocess::mapped_region> _sharedStateRegion;
+	const ipc::SharedState* _sharedState = nullptr;
+	void _openSharedState();
 	std::string _ipcServerQueueName;
 	std::string _ipcClientQueueName;
 	boost::interprocess::message_queue* _ipcServerQueue = nullptr;
 	boost::interprocess::message_queue* _ipcClientQueue = nullptr;
-
-	void _setVirtualDeviceProperty(uint32_t emulatorDeviceId, vr::ETrackedDeviceProperty deviceProperty, std::function<void(ipc::Request&)>, bool modal);
+	boost::interprocess::message_queue* _ipcRequestQueue = nullptr; // assigned by the driver at connect, nullptr .. use _ipcServerQueue
+	boost::interprocess::named_semaphore* _ipcDoorbell = nullptr; // posted once per request, nullptr .. driver polls the server queue
+	// Buffered button or axis events (eventCount == 0 .. empty)
+	bool _eventBuffering = false;
+	uint32_t _eventBufferMaxDelayMs = 10;
+	ipc::Request _eventBuffer;
+	std::chrono::steady_clock::time_point _eventBufferDeadline;
+	// Prepares _eventBuffer for another event of the given type, must be called with _mutex held
+	void _prepareEventBuffer(ipc::RequestType type);
+	void _flushEvents(bool onlyExpired = false);
+	// Last controller state sent per virtual device, used to only send what changed
+	std::map<uint32_t, vr::VRControllerState_t> _controllerShadowStates;
+
+	// Clock synchronization, offset(t) = _clockOffset + _clockDrift * (t - _clockReference)
+	mutable std::mutex _clockSyncMutex;
+	std::vector<std::pair<int64_t, int64_t>> _clockSamples; // local time => offset
+	double _clockOffset = 0.0;
+	double _clockDrift = 0.0;
+	int64_t _clockReference = 0;
+
+	// Converts the timestamp to the driver's clock and sends the message
+	void _send(const ipc::Request& message, size_t messageSize = sizeof(ipc::Request));
+	// Registers a pending request with a fresh message id and deadline, then sends the message
+	std::shared_ptr<_AsyncRequest> _sendRequest(ipc::Request& message, uint32_t& messageIdField, size_t messageSize = sizeof(ipc::Request));
+	// Completes all pending requests whose deadline has passed
+	void _expirePendingRequests();
+
+	template<class T>
+	AsyncResult<T> _sendAsync(ipc::Request& message, uint32_t& messageIdField, typename AsyncResult<T>::ReplyHandler handler, bool wantReply = true, size_t messageSize = sizeof(ipc::Request)) {
+		if (!_ipcServerQueue) {
+			throw vrinputemulator_connectionerror("No active connection.");
+		}
+		AsyncResult<T> result;
+		if (wantReply) {
+			result._handler = std::move(handler);
+			result._request = _sendRequest(message, messageIdField, messageSize);
+		} else {
+			messageIdField = 0;
+			_send(message, messageSize);
+		}
+		return result;
+	}
+
+	AsyncResult<void> _setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, std::function<void(ipc::Request&)> dataHandler, bool wantReply);
+	AsyncResult<void> _setDeviceOffsets(uint32_t deviceId, uint32_t mask, std::function<void(DeviceOffsets&)> dataHandler, bool wantReply);
 };
 
 } // end namespace vrinputemulator
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "vrinputemulator.h"
+
+// Only available when the including project is compiled with C++20 coroutine support (v142 or later with
+// /std:c++latest, the v140 projects of this repository compile it out). The library itself does not depend on it.
+#if defined(__cpp_impl_coroutine) || (defined(_MSVC_LANG) && _MSVC_LANG > 201703L)
+
+#include <coroutine>
+
+
+namespace vrinputemulator {
+
+
+/**
+* Makes AsyncResult<T> awaitable:
+*
+*     uint32_t count = co_await inputEmulator.getVirtualDeviceCountAsync();
+*
+* The awaiting coroutine is resumed directly from the ipc thread once the reply has arrived (or the request
+* timed out), so suspending does not allocate and does not block a thread. Issuing the request still allocates
+* its shared _AsyncRequest state (and the reply handler, when its captures exceed std::function's small buffer).
+* Code following the co_await runs on the ipc thread until the next suspension point and therefore must not
+* make modal calls.
+**/
+template<class T>
+class AsyncResultAwaiter {
+public:
+	explicit AsyncResultAwaiter(AsyncResult<T> result) : _result(std::move(result)) {}
+
+	bool await_ready() const {
+		return _result.isReady();
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle) {
+		// false .. already completed, continue without suspending
+		return _result.resumeOnCompletion(&_resume, handle.address());
+	}
+
+	T await_resume() const {
+		return _result.get();
+	}
+
+private:
+	AsyncResult<T> _result;
+
+	static void _resume(void* address) {
+		std::coroutine_handle<>::from_address(address).resume();
+	}
+};
+
+
+template<class T>
+AsyncResultAwaiter<T> operator co_await(AsyncResult<T> result) {
+	return AsyncResultAwaiter<T>(std::move(result));
+}
+
+
+} // end namespace vrinputemulator
+
+#endif
@@ -34,6 +34,91 @@ namespace vrinputemulator {
 	};
 
 
+	#define POSEFILTER_MAXSTAGES 4
+
+	enum class PoseFilterType : uint32_t {
+		None = 0,
+		OneEuro = 1, // params: min cutoff frequency (Hz), speed coefficient beta, derivative cutoff frequency (Hz)
+		Exponential = 2, // params: smoothing factor per sample (0, 1]
+		Kalman = 3 // params: process noise, measurement noise
+	};
+
+
+	struct PoseFilterStage {
+		PoseFilterType type;
+		double params[3];
+	};
+
+
+	#define MOTIONCOMPENSATION_MAXGROUPS 8
+	#define MOTIONCOMPENSATION_NOGROUP 0xFFFFFFFF // device is neither compensated nor a reference
+
+
+	#define AXISCURVE_MAXPOINTS 8
+	#define AXISTRANSFORM_NOBUTTON 0xFFFFFFFF
+	#define AXISTRANSFORM_NOREMAP 0xFFFFFFFF
+
+	enum class AxisCurveType : uint32_t {
+		Linear = 0,
+		Power = 1, // curveParam: exponent
+		Points = 2 // piecewise linear through curvePoints, (0, 0) and (1, 1) are implied
+	};
+
+
+	// Applied by the driver to one axis of a device, in this order: swap, invert, deadzone, curve, button threshold, remap.
+	// Deadzone and curve act on the magnitude of (x, y) and keep the direction.
+	struct AxisTransform {
+		uint32_t axisId;
+		bool enabled;
+		bool swapXY;
+		bool invertX;
+		bool invertY;
+		float deadzone; // magnitudes below become 0, the rest is rescaled to [0, 1]
+		float saturation; // magnitudes above count as 1 (0 .. 1.0)
+		AxisCurveType curveType;
+		float curveParam;
+		uint32_t curvePointCount;
+		float curvePoints[AXISCURVE_MAXPOINTS][2]; // (input, output) in [0, 1], ascending input
+		uint32_t remapAxisId; // axis the result is sent as, AXISTRANSFORM_NOREMAP .. axisId
+		uint32_t buttonId; // pressed while |x| >= buttonThreshold, AXISTRANSFORM_NOBUTTON .. none
+		float buttonThreshold;
+	};
+
+
+	#define DEVICEROUTING_MAXROUTES 16 // client routes, redirect/swap modes add their own
+	#define DEVICEROUTING_DROP 0xFFFFFFFF // route target: discard the events
+
+
+	enum class DeviceRouteChannel : uint32_t {
+		Pose = 1,
+		Buttons = 2,
+		Axes = 4,
+		All = 7
+	};
+
+
+	struct DeviceRoute {
+		uint32_t sourceId;
+		uint32_t targetId; // or DEVICEROUTING_DROP
+		uint32_t channels; // DeviceRouteChannel bit mask
+		int32_t priority; // when several sources are routed to the same target the active one with the highest priority wins
+	};
+
+
+	// Selects the components of a DeviceOffsets that a setDeviceOffsets call changes
+	enum class DeviceOffsetsMask : uint32_t {
+		WorldFromDriverRotation = 1,
+		WorldFromDriverTranslation = 2,
+		DriverFromHeadRotation = 4,
+		DriverFromHeadTranslation = 8,
+		DeviceRotation = 16,
+		DeviceTranslation = 32,
+		Enabled = 64, // offsetsEnabled
+		Offsets = 63,
+		All = 127
+	};
+
+
 	struct DeviceOffsets {
 		uint32_t deviceId;
 		bool offsetsEnabled;
@@ -53,6 +138,32 @@ namespace vrinputemulator {
 		bool offsetsEnabled;
 		bool buttonMappingEnabled;
 		bool redirectSuspended;
+		uint32_t motionCompensationGroup;
+		uint32_t refDeviceId; // other device of a redirect or swap, vr::k_unTrackedDeviceIndexInvalid .. none
+	};
+
+
+	enum class DeviceNotificationClass : uint32_t {
+		DeviceInfo = 1, // DeviceAdded, DeviceInfoChanged
+		VirtualDevices = 2, // VirtualDeviceAdded, VirtualDevicePublished
+		All = 3
+	};
+
+
+	enum class DeviceNotificationType : uint32_t {
+		None = 0,
+		DeviceAdded = 1, // deviceId: openvr id
+		DeviceInfoChanged = 2, // mode, offsets enabled, button mapping or redirect suspension; deviceId: openvr id
+		VirtualDeviceAdded = 3, // deviceId: virtual device id
+		VirtualDevicePublished = 4 // deviceId: virtual device id
+	};
+
+
+	// Pushed by the driver to subscribed clients
+	struct DeviceNotification {
+		DeviceNotificationType type;
+		uint32_t deviceId;
+		uint32_t sequence; // device info sequence after the change (see VRInputEmulator::getAllDeviceInfo())
 	};
 
 } // end namespace vrinputemulator
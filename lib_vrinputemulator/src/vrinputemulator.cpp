@@ -17,29 +17,72 @@
 
 namespace vrinputemulator {
 
+// Throws the exception matching the reply status
+static void _checkReplyStatus(const ipc::Reply& resp, const char* context, const char* invalidTypeMsg = nullptr) {
+	if (resp.status == ipc::ReplyStatus::Ok) {
+		return;
+	}
+	std::stringstream ss;
+	ss << "Error while " << context << ": ";
+	if (resp.status == ipc::ReplyStatus::InvalidId) {
+		ss << "Invalid device id";
+		throw vrinputemulator_invalidid(ss.str());
+	} else if (resp.status == ipc::ReplyStatus::NotFound) {
+		ss << "Device not found";
+		throw vrinputemulator_notfound(ss.str());
+	} else if (invalidTypeMsg && resp.status == ipc::ReplyStatus::InvalidType) {
+		ss << invalidTypeMsg;
+		throw vrinputemulator_invalidtype(ss.str());
+	} else {
+		ss << "Error code " << (int)resp.status;
+		throw vrinputemulator_exception(ss.str());
+	}
+}
+
+
 // Receives and dispatches ipc messages
 void VRInputEmulator::_ipcThreadFunc(VRInputEmulator * _this) {
 	_this->_ipcThreadRunning = true;
+	auto nextExpiryCheck = std::chrono::steady_clock::now();
 	while (!_this->_ipcThreadStop) {
 		try {
 			ipc::Reply message;
 			uint64_t recv_size;
 			unsigned priority;
-			boost::posix_time::ptime timeout = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(50);
+			boost::posix_time::ptime timeout = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(10);
 			if (_this->_ipcClientQueue->timed_receive(&message, sizeof(ipc::Reply), recv_size, priority, timeout)) {
-				if (recv_size == sizeof(ipc::Reply)) {
-					std::lock_guard<std::recursive_mutex> lock(_this->_mutex);
-					auto i = _this->_ipcPromiseMap.find(message.messageId);
-					if (i != _this->_ipcPromiseMap.end()) {
-						if (i->second.isValid) {
-							i->second.promise.set_value(message);
-						} else {
-							_this->_ipcPromiseMap.erase(i); // nobody wants it, so we delete it
+				if (!message.isComplete(recv_size)) {
+					WRITELOG(ERROR, "Error in ipc receive loop: received size is wrong (" << recv_size << ")" << std::endl);
+				} else if (message.type == ipc::ReplyType::Notification) {
+					NotificationHandler handler;
+					{
+						std::lock_guard<std::recursive_mutex> lock(_this->_mutex);
+						handler = _this->_notificationHandler;
+					}
+					if (handler) {
+						handler(message.msg.notification);
+					}
+				} else {
+					std::shared_ptr<_AsyncRequest> request;
+					{
+						std::lock_guard<std::recursive_mutex> lock(_this->_mutex);
+						auto i = _this->_ipcPendingRequests.find(message.messageId);
+						if (i != _this->_ipcPendingRequests.end()) {
+							request = std::move(i->second);
+							_this->_ipcPendingRequests.erase(i);
 						}
 					}
+					// Completion callbacks must not run while we hold the lock
+					if (request) {
+						request->complete(_AsyncRequest::Result::Ok, &message);
+					}
 				}
-			} else {
-				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			_this->_flushEvents(true);
+			auto now = std::chrono::steady_clock::now();
+			if (now >= nextExpiryCheck) {
+				_this->_expirePendingRequests();
+				nextExpiryCheck = now + std::chrono::milliseconds(10);
 			}
 		} catch (std::exception& ex) {
 			WRITELOG(ERROR, "Exception in ipc receive loop: " << ex.what() << std::endl);
@@ -49,10 +92,135 @@ void VRInputEmulator::_ipcThreadFunc(VRInputEmulator * _this) {
 }
 
 
+void VRInputEmulator::_expirePendingRequests() {
+	std::vector<std::shared_ptr<_AsyncRequest>> expired;
+	{
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		auto now = std::chrono::steady_clock::now();
+		auto i = _ipcPendingRequests.begin();
+		while (i != _ipcPendingRequests.end()) {
+			if (i->second->deadline <= now) {
+				expired.push_back(std::move(i->second));
+				i = _ipcPendingRequests.erase(i);
+			} else {
+				++i;
+			}
+		}
+	}
+	for (auto& r : expired) {
+		r->complete(_AsyncRequest::Result::TimedOut);
+	}
+}
+
+
+std::shared_ptr<_AsyncRequest> VRInputEmulator::_sendRequest(ipc::Request& message, uint32_t& messageIdField, size_t messageSize) {
+	if (!_ipcServerQueue) {
+		throw vrinputemulator_connectionerror("No active connection.");
+	}
+	auto request = std::make_shared<_AsyncRequest>();
+	if (_requestTimeoutMs > 0) {
+		request->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_requestTimeoutMs);
+	} else {
+		request->deadline = std::chrono::steady_clock::time_point::max();
+	}
+	uint32_t messageId;
+	{
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		do {
+			messageId = _ipcRandomDist(_ipcRandomDevice);
+		} while (messageId == 0 || _ipcPendingRequests.find(messageId) != _ipcPendingRequests.end());
+		_ipcPendingRequests.insert({ messageId, request });
+	}
+	messageIdField = messageId;
+	try {
+		_send(message, messageSize);
+	} catch (...) {
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		_ipcPendingRequests.erase(messageId);
+		throw;
+	}
+	return request;
+}
+
+
+void VRInputEmulator::_send(const ipc::Request& message, size_t messageSize) {
+	// Converted on a copy, callers may send the same message more than once
+	ipc::Request driverMessage(message);
+	driverMessage.timestamp = toDriverTime(message.timestamp);
+	(_ipcRequestQueue ? _ipcRequestQueue : _ipcServerQueue)->send(&driverMessage, messageSize, 0);
+	if (_ipcDoorbell) {
+		_ipcDoorbell->post();
+	}
+}
+
+
+int64_t VRInputEmulator::toDriverTime(int64_t localTimestamp) const {
+	std::lock_guard<std::mutex> lock(_clockSyncMutex);
+	return localTimestamp + (int64_t)(_clockOffset + _clockDrift * (double)(localTimestamp - _clockReference));
+}
+
+
+void VRInputEmulator::syncClock(unsigned samples) {
+	// Use the ping with the shortest round trip, its driver-side receive time is closest to the midpoint
+	int64_t bestRoundTrip = INT64_MAX;
+	int64_t bestLocalTime = 0;
+	int64_t bestOffset = 0;
+	for (unsigned i = 0; i < samples; ++i) {
+		ipc::Request message(ipc::RequestType::IPC_Ping);
+		message.msg.ipc_Ping.clientId = m_clientId;
+		message.msg.ipc_Ping.nonce = _ipcRandomDist(_ipcRandomDevice);
+		auto sendTime = ipc::timestampNow();
+		auto resp = _sendAsync<ipc::Reply>(message, message.msg.ipc_Ping.messageId, [](const ipc::Reply& r) {
+			return r;
+		}).get();
+		auto receiveTime = ipc::timestampNow();
+		if (resp.status != ipc::ReplyStatus::Ok) {
+			std::stringstream ss;
+			ss << "Error while synchronizing clocks: Error code " << (int)resp.status;
+			throw vrinputemulator_exception(ss.str());
+		}
+		if (receiveTime - sendTime < bestRoundTrip) {
+			bestRoundTrip = receiveTime - sendTime;
+			bestLocalTime = sendTime + bestRoundTrip / 2;
+			bestOffset = resp.msg.ipc_Ping.receiveTimestamp - bestLocalTime;
+		}
+	}
+	if (samples == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(_clockSyncMutex);
+	_clockSamples.push_back({ bestLocalTime, bestOffset });
+	if (_clockSamples.size() > 16) {
+		_clockSamples.erase(_clockSamples.begin());
+	}
+	// Least squares fit of offset over local time, the slope is the drift between both clocks
+	double meanTime = 0.0, meanOffset = 0.0;
+	for (auto& c : _clockSamples) {
+		meanTime += (double)(c.first - _clockSamples[0].first);
+		meanOffset += (double)c.second;
+	}
+	meanTime /= _clockSamples.size();
+	meanOffset /= _clockSamples.size();
+	double covariance = 0.0, variance = 0.0;
+	for (auto& c : _clockSamples) {
+		double dt = (double)(c.first - _clockSamples[0].first) - meanTime;
+		covariance += dt * ((double)c.second - meanOffset);
+		variance += dt * dt;
+	}
+	_clockDrift = variance > 0.0 ? covariance / variance : 0.0;
+	_clockReference = _clockSamples[0].first + (int64_t)meanTime;
+	_clockOffset = meanOffset;
+}
+
+
 VRInputEmulator::VRInputEmulator(const std::string& serverQueue, const std::string& clientQueue) : _ipcServerQueueName(serverQueue), _ipcClientQueueName(clientQueue) {}
 
 VRInputEmulator::~VRInputEmulator() {
-	disconnect();
+	try {
+		disconnect();
+	} catch (std::exception& e) {
+		WRITELOG(ERROR, "Exception while disconnecting: " << e.what() << std::endl);
+	}
 }
 
 bool VRInputEmulator::isConnected() const {
@@ -70,6 +238,12 @@ void VRInputEmulator::connect() {
 			ss << "Could not open server-side message queue: " << e.what();
 			throw vrinputemulator_connectionerror(ss.str());
 		}
+		try {
+			_ipcDoorbell = new boost::interprocess::named_semaphore(boost::interprocess::open_only, (_ipcServerQueueName + ".doorbell").c_str());
+		} catch (std::exception& e) {
+			_ipcDoorbell = nullptr; // old driver, it finds requests by polling
+			WRITELOG(ERROR, "Could not open request doorbell: " << e.what() << std::endl);
+		}
 		// Append random number to client queue name (and hopefully no other client uses the same random number)
 		_ipcClientQueueName += std::to_string(_ipcRandomDist(_ipcRandomDevice));
 		// Open client-side message queue
@@ -84,6 +258,8 @@ void VRInputEmulator::connect() {
 		} catch (std::exception& e) {
 			delete _ipcServerQueue;
 			_ipcServerQueue = nullptr;
+			delete _ipcDoorbell;
+			_ipcDoorbell = nullptr;
 			_ipcClientQueue = nullptr;
 			std::stringstream ss;
 			ss << "Could not open client-side message queue: " << e.what();
@@ -92,32 +268,36 @@ void VRInputEmulator::connect() {
 		// Start ipc thread
 		_ipcThreadStop = false;
 		_ipcThread = std::thread(_ipcThreadFunc, this);
+		auto closeConnection = [this]() {
+			_ipcThreadStop = true;
+			_ipcThread.join();
+			delete _ipcServerQueue;
+			_ipcServerQueue = nullptr;
+			delete _ipcClientQueue;
+			_ipcClientQueue = nullptr;
+			delete _ipcRequestQueue;
+			_ipcRequestQueue = nullptr;
+			delete _ipcDoorbell;
+			_ipcDoorbell = nullptr;
+		};
 		// Send ClientConnect message to server
 		ipc::Request message(ipc::RequestType::IPC_ClientConnect);
-		auto messageId = _ipcRandomDist(_ipcRandomDevice);
-		message.msg.ipc_ClientConnect.messageId = messageId;
 		message.msg.ipc_ClientConnect.ipcProcotolVersion = IPC_PROTOCOL_VERSION;
 		strncpy_s(message.msg.ipc_ClientConnect.queueName, _ipcClientQueueName.c_str(), 127);
 		message.msg.ipc_ClientConnect.queueName[127] = '\0';
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
+		ipc::Reply resp;
+		try {
+			AsyncResult<ipc::Reply> result = _sendAsync<ipc::Reply>(message, message.msg.ipc_ClientConnect.messageId, [](const ipc::Reply& r) {
+				return r;
+			});
+			resp = result.get();
+		} catch (std::exception&) {
+			closeConnection();
+			throw;
 		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		// Wait for response
-		auto resp = respFuture.get();
 		m_clientId = resp.msg.ipc_ClientConnect.clientId;
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
-		}
 		if (resp.status != ipc::ReplyStatus::Ok) {
-			delete _ipcServerQueue;
-			_ipcServerQueue = nullptr;
-			delete _ipcClientQueue;
-			_ipcClientQueue = nullptr;
+			closeConnection();
 			std::stringstream ss;
 			ss << "Connection rejected by server: ";
 			if (resp.status == ipc::ReplyStatus::InvalidVersion) {
@@ -128,34 +308,86 @@ void VRInputEmulator::connect() {
 				throw vrinputemulator_connectionerror(ss.str());
 			}
 		}
+		if (resp.msg.ipc_ClientConnect.requestQueueName[0] != '\0') {
+			resp.msg.ipc_ClientConnect.requestQueueName[127] = '\0';
+			try {
+				_ipcRequestQueue = new boost::interprocess::message_queue(boost::interprocess::open_only, resp.msg.ipc_ClientConnect.requestQueueName);
+			} catch (std::exception& e) {
+				_ipcRequestQueue = nullptr;
+				WRITELOG(ERROR, "Could not open dedicated request queue, using the server queue: " << e.what() << std::endl);
+			}
+		}
+		try {
+			syncClock();
+		} catch (std::exception& e) {
+			WRITELOG(ERROR, "Could not synchronize clock with driver: " << e.what() << std::endl);
+		}
+		_openSharedState();
+	}
+}
+
+void VRInputEmulator::_openSharedState() {
+	try {
+		_sharedStateMemory = std::make_shared<boost::interprocess::shared_memory_object>(
+			boost::interprocess::open_only, IPC_SHAREDSTATE_NAME, boost::interprocess::read_only);
+		_sharedStateRegion = std::make_shared<boost::interprocess::mapped_region>(*_sharedStateMemory, boost::interprocess::read_only);
+		auto state = static_cast<const ipc::SharedState*>(_sharedStateRegion->get_address());
+		if (_sharedStateRegion->get_size() >= sizeof(ipc::SharedState) && state->protocolVersion == IPC_PROTOCOL_VERSION) {
+			_sharedState = state;
+			return;
+		}
+		WRITELOG(ERROR, "Shared state segment does not match the ipc protocol version" << std::endl);
+	} catch (std::exception& e) {
+		WRITELOG(ERROR, "Could not open shared state segment: " << e.what() << std::endl);
 	}
+	_sharedState = nullptr;
+	_sharedStateRegion.reset();
+	_sharedStateMemory.reset();
 }
 
 void VRInputEmulator::disconnect() {
 	if (_ipcServerQueue) {
+		try {
+			_flushEvents();
+		} catch (std::exception& e) {
+			WRITELOG(ERROR, "Error while sending buffered events: " << e.what() << std::endl);
+		}
 		// Send disconnect message (so the server can free resources)
 		ipc::Request message(ipc::RequestType::IPC_ClientDisconnect);
-		auto messageId = _ipcRandomDist(_ipcRandomDevice);
 		message.msg.ipc_ClientDisconnect.clientId = m_clientId;
-		message.msg.ipc_ClientDisconnect.messageId = messageId;
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		auto resp = respFuture.get();
-		m_clientId = resp.msg.ipc_ClientConnect.clientId;
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
+		try {
+			// The driver may already be gone, so don't wait forever even when request timeouts are disabled
+			auto result = _sendAsync<void>(message, message.msg.ipc_ClientDisconnect.messageId, [](const ipc::Reply&) {});
+			if (!result.wait(_requestTimeoutMs > 0 ? _requestTimeoutMs : 1000)) {
+				WRITELOG(ERROR, "Server did not acknowledge disconnect" << std::endl);
+			}
+		} catch (std::exception& e) {
+			WRITELOG(ERROR, "Error while disconnecting from server: " << e.what() << std::endl);
 		}
 		// Stop ipc thread
 		if (_ipcThreadRunning) {
 			_ipcThreadStop = true;
 			_ipcThread.join();
 		}
+		_sharedState = nullptr;
+		_sharedStateRegion.reset();
+		_sharedStateMemory.reset();
+		// Nobody is going to answer the remaining requests
+		std::map<uint32_t, std::shared_ptr<_AsyncRequest>> pending;
+		{
+			std::lock_guard<std::recursive_mutex> lock(_mutex);
+			pending.swap(_ipcPendingRequests);
+			_controllerShadowStates.clear();
+		}
+		{
+			std::lock_guard<std::mutex> lock(_clockSyncMutex);
+			_clockSamples.clear();
+			_clockOffset = 0.0;
+			_clockDrift = 0.0;
+		}
+		for (auto& r : pending) {
+			r.second->complete(_AsyncRequest::Result::Disconnected);
+		}
 		// delete message queues
 		if (_ipcServerQueue) {
 			delete _ipcServerQueue;
@@ -165,50 +397,65 @@ void VRInputEmulator::disconnect() {
 			delete _ipcClientQueue;
 			_ipcClientQueue = nullptr;
 		}
+		if (_ipcRequestQueue) {
+			delete _ipcRequestQueue;
+			_ipcRequestQueue = nullptr;
+		}
+		if (_ipcDoorbell) {
+			delete _ipcDoorbell;
+			_ipcDoorbell = nullptr;
+		}
 	}
 }
 
 void VRInputEmulator::ping(bool modal, bool enableReply) {
-	if (_ipcServerQueue) {
-		uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-		uint64_t nonce = _ipcRandomDist(_ipcRandomDevice);
+	if (modal) {
+		pingAsync().get();
+	} else if (_ipcServerQueue) {
 		ipc::Request message(ipc::RequestType::IPC_Ping);
 		message.msg.ipc_Ping.clientId = m_clientId;
-		message.msg.ipc_Ping.messageId = messageId;
-		message.msg.ipc_Ping.nonce = nonce;
-		if (modal) {
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			if (resp.status != ipc::ReplyStatus::Ok) {
-				std::stringstream ss;
-				ss << "Error while pinging server: Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			if (enableReply) {
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				message.msg.ipc_Ping.messageId = messageId;
-				_ipcPromiseMap.insert({ messageId, _ipcPromiseMapEntry() });
-			} else {
-				message.msg.ipc_Ping.messageId = 0;
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
+		// Replies without a pending request are dropped by the ipc thread
+		message.msg.ipc_Ping.messageId = enableReply ? _ipcRandomDist(_ipcRandomDevice) : 0;
+		message.msg.ipc_Ping.nonce = _ipcRandomDist(_ipcRandomDevice);
+		_send(message);
 	} else {
 		throw vrinputemulator_connectionerror("No active connection.");
 	}
 }
 
+AsyncResult<void> VRInputEmulator::pingAsync() {
+	ipc::Request message(ipc::RequestType::IPC_Ping);
+	message.msg.ipc_Ping.clientId = m_clientId;
+	message.msg.ipc_Ping.nonce = _ipcRandomDist(_ipcRandomDevice);
+	return _sendAsync<void>(message, message.msg.ipc_Ping.messageId, [](const ipc::Reply& resp) {
+		if (resp.status != ipc::ReplyStatus::Ok) {
+			std::stringstream ss;
+			ss << "Error while pinging server: Error code " << (int)resp.status;
+			throw vrinputemulator_exception(ss.str());
+		}
+	});
+}
+
+
+void VRInputEmulator::subscribe(uint32_t notificationClasses, NotificationHandler handler, bool modal) {
+	subscribeAsync(notificationClasses, std::move(handler), modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::subscribeAsync(uint32_t notificationClasses, NotificationHandler handler, bool wantReply) {
+	{
+		// Set before subscribing, notifications may arrive before the reply
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		_notificationHandler = notificationClasses ? std::move(handler) : nullptr;
+	}
+	ipc::Request message(ipc::RequestType::IPC_Subscribe);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.ipc_Subscribe.clientId = m_clientId;
+	message.msg.ipc_Subscribe.notificationClasses = notificationClasses;
+	return _sendAsync<void>(message, message.msg.ipc_Subscribe.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "subscribing to notifications");
+	}, wantReply);
+}
+
 
 void VRInputEmulator::openvrUpdatePose(uint32_t deviceId, const vr::DriverPose_t & pose) {
 	if (_ipcServerQueue) {
@@ -221,15 +468,76 @@ void VRInputEmulator::openvrUpdatePose(uint32_t deviceId, const vr::DriverPose_t
 }
 
 
+void VRInputEmulator::setEventBuffering(bool enable, uint32_t maxDelayMs) {
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	if (!enable && _ipcServerQueue) {
+		_flushEvents();
+	}
+	_eventBuffering = enable;
+	_eventBufferMaxDelayMs = maxDelayMs;
+}
+
+
+void VRInputEmulator::flush() {
+	if (_ipcServerQueue) {
+		_flushEvents();
+	} else {
+		throw vrinputemulator_connectionerror("No active connection.");
+	}
+}
+
+
+void VRInputEmulator::_flushEvents(bool onlyExpired) {
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	if (_eventBuffer.type == ipc::RequestType::None || !_ipcServerQueue) {
+		return;
+	}
+	if (onlyExpired && std::chrono::steady_clock::now() < _eventBufferDeadline) {
+		return;
+	}
+	_eventBuffer.refreshTimestamp();
+	_send(_eventBuffer);
+	_eventBuffer.type = ipc::RequestType::None;
+}
+
+
+void VRInputEmulator::_prepareEventBuffer(ipc::RequestType type) {
+	if (_eventBuffer.type != type) {
+		// Keep the order of events: a batch of the other type is sent first
+		_flushEvents();
+		_eventBuffer = ipc::Request(type);
+		if (type == ipc::RequestType::OpenVR_ButtonEvent) {
+			_eventBuffer.msg.ipc_ButtonEvent.eventCount = 0;
+		} else {
+			_eventBuffer.msg.ipc_AxisEvent.eventCount = 0;
+		}
+		_eventBufferDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_eventBufferMaxDelayMs);
+	}
+}
+
+
 void VRInputEmulator::openvrButtonEvent(ButtonEventType eventType, uint32_t deviceId, vr::EVRButtonId buttonId, double timeOffset) {
 	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::OpenVR_ButtonEvent);
-		message.msg.ipc_ButtonEvent.eventCount = 1;
-		message.msg.ipc_ButtonEvent.events[0].eventType = eventType;
-		message.msg.ipc_ButtonEvent.events[0].deviceId = deviceId;
-		message.msg.ipc_ButtonEvent.events[0].buttonId = buttonId;
-		message.msg.ipc_ButtonEvent.events[0].timeOffset = timeOffset;
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
+		if (_eventBuffering) {
+			std::lock_guard<std::recursive_mutex> lock(_mutex);
+			_prepareEventBuffer(ipc::RequestType::OpenVR_ButtonEvent);
+			auto& e = _eventBuffer.msg.ipc_ButtonEvent.events[_eventBuffer.msg.ipc_ButtonEvent.eventCount++];
+			e.eventType = eventType;
+			e.deviceId = deviceId;
+			e.buttonId = buttonId;
+			e.timeOffset = timeOffset;
+			if (_eventBuffer.msg.ipc_ButtonEvent.eventCount >= REQUEST_OPENVR_BUTTONEVENT_MAXCOUNT) {
+				_flushEvents();
+			}
+		} else {
+			ipc::Request message(ipc::RequestType::OpenVR_ButtonEvent);
+			message.msg.ipc_ButtonEvent.eventCount = 1;
+			message.msg.ipc_ButtonEvent.events[0].eventType = eventType;
+			message.msg.ipc_ButtonEvent.events[0].deviceId = deviceId;
+			message.msg.ipc_ButtonEvent.events[0].buttonId = buttonId;
+			message.msg.ipc_ButtonEvent.events[0].timeOffset = timeOffset;
+			_send(message);
+		}
 	} else {
 		throw vrinputemulator_connectionerror("No active connection.");
 	}
@@ -238,12 +546,24 @@ void VRInputEmulator::openvrButtonEvent(ButtonEventType eventType, uint32_t devi
 
 void VRInputEmulator::openvrAxisEvent(uint32_t deviceId, uint32_t axisId, const vr::VRControllerAxis_t & axisState) {
 	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::OpenVR_AxisEvent);
-		message.msg.ipc_AxisEvent.eventCount = 1;
-		message.msg.ipc_AxisEvent.events[0].deviceId = deviceId;
-		message.msg.ipc_AxisEvent.events[0].axisId = axisId;
-		message.msg.ipc_AxisEvent.events[0].axisState = axisState;
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
+		if (_eventBuffering) {
+			std::lock_guard<std::recursive_mutex> lock(_mutex);
+			_prepareEventBuffer(ipc::RequestType::OpenVR_AxisEvent);
+			auto& e = _eventBuffer.msg.ipc_AxisEvent.events[_eventBuffer.msg.ipc_AxisEvent.eventCount++];
+			e.deviceId = deviceId;
+			e.axisId = axisId;
+			e.axisState = axisState;
+			if (_eventBuffer.msg.ipc_AxisEvent.eventCount >= REQUEST_OPENVR_AXISEVENT_MAXCOUNT) {
+				_flushEvents();
+			}
+		} else {
+			ipc::Request message(ipc::RequestType::OpenVR_AxisEvent);
+			message.msg.ipc_AxisEvent.eventCount = 1;
+			message.msg.ipc_AxisEvent.events[0].deviceId = deviceId;
+			message.msg.ipc_AxisEvent.events[0].axisId = axisId;
+			message.msg.ipc_AxisEvent.events[0].axisState = axisState;
+			_send(message);
+		}
 	} else {
 		throw vrinputemulator_connectionerror("No active connection.");
 	}
@@ -255,7 +575,7 @@ void VRInputEmulator::openvrProximitySensorEvent(uint32_t deviceId, bool sensorT
 		ipc::Request message(ipc::RequestType::OpenVR_ProximitySensorEvent);
 		message.msg.ovr_ProximitySensorEvent.deviceId = deviceId;
 		message.msg.ovr_ProximitySensorEvent.sensorTriggered = sensorTriggered;
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
+		_send(message);
 	} else {
 		throw vrinputemulator_connectionerror("No active connection.");
 	}
@@ -269,186 +589,135 @@ void VRInputEmulator::openvrVendorSpecificEvent(uint32_t deviceId, vr::EVREventT
 		message.msg.ovr_VendorSpecificEvent.eventType = eventType;
 		message.msg.ovr_VendorSpecificEvent.eventData = eventData;
 		message.msg.ovr_VendorSpecificEvent.timeOffset = timeOffset;
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
+		_send(message);
 	} else {
 		throw vrinputemulator_connectionerror("No active connection.");
 	}
 }
 
 
-uint32_t VRInputEmulator::getVirtualDeviceCount() {
-	if (_ipcServerQueue) {
-		uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-		ipc::Request message(ipc::RequestType::VirtualDevices_GetDeviceCount);
-		message.msg.vd_GenericClientMessage.clientId = m_clientId;
-		message.msg.vd_GenericClientMessage.messageId = messageId;
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		auto resp = respFuture.get();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
-		}
+
+void VRInputEmulator::setAxisEventCoalescing(bool enable, uint32_t flushIntervalMs, bool modal) {
+	setAxisEventCoalescingAsync(enable, flushIntervalMs, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setAxisEventCoalescingAsync(bool enable, uint32_t flushIntervalMs, bool wantReply) {
+	ipc::Request message(ipc::RequestType::OpenVR_SetAxisEventCoalescing);
+	message.msg.ovr_SetAxisEventCoalescing.clientId = m_clientId;
+	message.msg.ovr_SetAxisEventCoalescing.enable = enable;
+	message.msg.ovr_SetAxisEventCoalescing.flushIntervalMs = flushIntervalMs;
+	return _sendAsync<void>(message, message.msg.ovr_SetAxisEventCoalescing.messageId, [](const ipc::Reply& resp) {
 		if (resp.status != ipc::ReplyStatus::Ok) {
 			std::stringstream ss;
-			ss << "Error while getting device count: Error code " << (int)resp.status;
+			ss << "Error while setting axis event coalescing: Error code " << (int)resp.status;
 			throw vrinputemulator_exception(ss.str());
 		}
+	}, wantReply);
+}
+
+
+uint32_t VRInputEmulator::getVirtualDeviceCount() {
+	return getVirtualDeviceCountAsync().get();
+}
+
+AsyncResult<uint32_t> VRInputEmulator::getVirtualDeviceCountAsync() {
+	ipc::Request message(ipc::RequestType::VirtualDevices_GetDeviceCount);
+	message.msg.vd_GenericClientMessage.clientId = m_clientId;
+	return _sendAsync<uint32_t>(message, message.msg.vd_GenericClientMessage.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "getting device count");
 		return resp.msg.vd_GetDeviceCount.deviceCount;
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	});
 }
 
 
 VirtualDeviceInfo VRInputEmulator::getVirtualDeviceInfo(uint32_t virtualDeviceId) {
-	if (_ipcServerQueue) {
-		uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-		ipc::Request message(ipc::RequestType::VirtualDevices_GetDeviceInfo);
-		message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
-		message.msg.vd_GenericDeviceIdMessage.messageId = messageId;
-		message.msg.vd_GenericDeviceIdMessage.deviceId = virtualDeviceId;
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		auto resp = respFuture.get();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
-		}
-		std::stringstream ss;
-		ss << "Error while getting device info: ";
-		if (resp.status == ipc::ReplyStatus::InvalidId) {
-			ss << "Invalid device id";
-			throw vrinputemulator_invalidid(ss.str());
-		} else if (resp.status == ipc::ReplyStatus::NotFound) {
-			ss << "Device not found";
-			throw vrinputemulator_notfound(ss.str());
-		} else if (resp.status != ipc::ReplyStatus::Ok) {
-			ss << "Error code " << (int)resp.status;
-			throw vrinputemulator_exception(ss.str());
-		}
+	ipc::SharedVirtualDeviceInfo info;
+	if (_sharedState && virtualDeviceId < vr::k_unMaxTrackedDeviceCount
+			&& _sharedState->virtualDevices[virtualDeviceId].info.tryLoad(info) && info.valid) {
+		VirtualDeviceInfo retval;
+		retval.virtualDeviceId = virtualDeviceId;
+		retval.openvrDeviceId = info.openvrDeviceId;
+		retval.deviceType = info.deviceType;
+		info.deviceSerial[127] = '\0';
+		retval.deviceSerial = info.deviceSerial;
+		return retval;
+	}
+	return getVirtualDeviceInfoAsync(virtualDeviceId).get();
+}
+
+AsyncResult<VirtualDeviceInfo> VRInputEmulator::getVirtualDeviceInfoAsync(uint32_t virtualDeviceId) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_GetDeviceInfo);
+	message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
+	message.msg.vd_GenericDeviceIdMessage.deviceId = virtualDeviceId;
+	return _sendAsync<VirtualDeviceInfo>(message, message.msg.vd_GenericDeviceIdMessage.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "getting device info");
 		VirtualDeviceInfo retval;
 		retval.openvrDeviceId = resp.msg.vd_GetDeviceInfo.openvrDeviceId;
 		retval.virtualDeviceId = resp.msg.vd_GetDeviceInfo.virtualDeviceId;
 		retval.deviceType = resp.msg.vd_GetDeviceInfo.deviceType;
 		retval.deviceSerial = resp.msg.vd_GetDeviceInfo.deviceSerial;
 		return retval;
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	});
 }
 
 
 vr::DriverPose_t VRInputEmulator::getVirtualDevicePose(uint32_t virtualDeviceId) {
-	if (_ipcServerQueue) {
-		uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-		ipc::Request message(ipc::RequestType::VirtualDevices_GetDevicePose);
-		message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
-		message.msg.vd_GenericDeviceIdMessage.messageId = messageId;
-		message.msg.vd_GenericDeviceIdMessage.deviceId = virtualDeviceId;
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		auto resp = respFuture.get();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
-		}
-		std::stringstream ss;
-		ss << "Error while getting device info: ";
-		if (resp.status == ipc::ReplyStatus::InvalidId) {
-			ss << "Invalid device id";
-			throw vrinputemulator_invalidid(ss.str());
-		} else if (resp.status == ipc::ReplyStatus::NotFound) {
-			ss << "Device not found";
-			throw vrinputemulator_notfound(ss.str());
-		} else if (resp.status != ipc::ReplyStatus::Ok) {
-			ss << "Error code " << (int)resp.status;
-			throw vrinputemulator_exception(ss.str());
+	if (_sharedState && virtualDeviceId < vr::k_unMaxTrackedDeviceCount) {
+		auto& entry = _sharedState->virtualDevices[virtualDeviceId];
+		ipc::SharedVirtualDeviceInfo info;
+		vr::DriverPose_t pose;
+		if (entry.info.tryLoad(info) && info.valid && entry.pose.tryLoad(pose)) {
+			return pose;
 		}
-		return resp.msg.vd_GetDevicePose.pose;
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
 	}
+	return getVirtualDevicePoseAsync(virtualDeviceId).get();
+}
+
+AsyncResult<vr::DriverPose_t> VRInputEmulator::getVirtualDevicePoseAsync(uint32_t virtualDeviceId) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_GetDevicePose);
+	message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
+	message.msg.vd_GenericDeviceIdMessage.deviceId = virtualDeviceId;
+	return _sendAsync<vr::DriverPose_t>(message, message.msg.vd_GenericDeviceIdMessage.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "getting device pose");
+		return resp.msg.vd_GetDevicePose.pose;
+	});
 }
 
 
 vr::VRControllerState_t VRInputEmulator::getVirtualControllerState(uint32_t virtualDeviceId) {
-	if (_ipcServerQueue) {
-		uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-		ipc::Request message(ipc::RequestType::VirtualDevices_GetControllerState);
-		message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
-		message.msg.vd_GenericDeviceIdMessage.messageId = messageId;
-		message.msg.vd_GenericDeviceIdMessage.deviceId = virtualDeviceId;
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		auto resp = respFuture.get();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
-		}
-		std::stringstream ss;
-		ss << "Error while getting device info: ";
-		if (resp.status == ipc::ReplyStatus::InvalidId) {
-			ss << "Invalid device id";
-			throw vrinputemulator_invalidid(ss.str());
-		} else if (resp.status == ipc::ReplyStatus::NotFound) {
-			ss << "Device not found";
-			throw vrinputemulator_notfound(ss.str());
-		} else if (resp.status == ipc::ReplyStatus::InvalidType) {
-			ss << "Device type does not support this";
-			throw vrinputemulator_invalidtype(ss.str());
-		} else if (resp.status != ipc::ReplyStatus::Ok) {
-			ss << "Error code " << (int)resp.status;
-			throw vrinputemulator_exception(ss.str());
+	if (_sharedState && virtualDeviceId < vr::k_unMaxTrackedDeviceCount) {
+		auto& entry = _sharedState->virtualDevices[virtualDeviceId];
+		ipc::SharedVirtualDeviceInfo info;
+		vr::VRControllerState_t state;
+		if (entry.info.tryLoad(info) && info.valid && info.deviceType == VirtualDeviceType::TrackedController && entry.controllerState.tryLoad(state)) {
+			return state;
 		}
-		return resp.msg.vd_GetControllerState.controllerState;
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
 	}
+	return getVirtualControllerStateAsync(virtualDeviceId).get();
+}
+
+AsyncResult<vr::VRControllerState_t> VRInputEmulator::getVirtualControllerStateAsync(uint32_t virtualDeviceId) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_GetControllerState);
+	message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
+	message.msg.vd_GenericDeviceIdMessage.deviceId = virtualDeviceId;
+	return _sendAsync<vr::VRControllerState_t>(message, message.msg.vd_GenericDeviceIdMessage.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "getting controller state", "Device type does not support this");
+		return resp.msg.vd_GetControllerState.controllerState;
+	});
 }
 
 
 uint32_t VRInputEmulator::addVirtualDevice(VirtualDeviceType deviceType, const std::string & deviceSerial, bool softfail) {
-	if (_ipcServerQueue) {
-		uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-		ipc::Request message(ipc::RequestType::VirtualDevices_AddDevice);
-		message.msg.vd_AddDevice.clientId = m_clientId;
-		message.msg.vd_AddDevice.messageId = messageId;
-		message.msg.vd_AddDevice.deviceType = deviceType;
-		strncpy_s(message.msg.vd_AddDevice.deviceSerial, deviceSerial.c_str(), 127);
-		message.msg.vd_AddDevice.deviceSerial[127] = '\0';
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		auto resp = respFuture.get();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
-		}
+	return addVirtualDeviceAsync(deviceType, deviceSerial, softfail).get();
+}
+
+AsyncResult<uint32_t> VRInputEmulator::addVirtualDeviceAsync(VirtualDeviceType deviceType, const std::string & deviceSerial, bool softfail) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_AddDevice);
+	message.msg.vd_AddDevice.clientId = m_clientId;
+	message.msg.vd_AddDevice.deviceType = deviceType;
+	strncpy_s(message.msg.vd_AddDevice.deviceSerial, deviceSerial.c_str(), 127);
+	message.msg.vd_AddDevice.deviceSerial[127] = '\0';
+	return _sendAsync<uint32_t>(message, message.msg.vd_AddDevice.messageId, [softfail](const ipc::Reply& resp) {
 		std::stringstream ss;
 		ss << "Error while adding device: ";
 		if (resp.status == ipc::ReplyStatus::TooManyDevices) {
@@ -467,1141 +736,816 @@ uint32_t VRInputEmulator::addVirtualDevice(VirtualDeviceType deviceType, const s
 			throw vrinputemulator_exception(ss.str());
 		}
 		return resp.msg.vd_AddDevice.virtualDeviceId;
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	});
 }
 
 
 void VRInputEmulator::publishVirtualDevice(uint32_t virtualDeviceId, bool modal) {
-	if (_ipcServerQueue) {
-		uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-		ipc::Request message(ipc::RequestType::VirtualDevices_PublishDevice);
-		message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
-		message.msg.vd_GenericDeviceIdMessage.messageId = messageId;
-		message.msg.vd_GenericDeviceIdMessage.deviceId = virtualDeviceId;
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		auto resp = respFuture.get();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
-		}
-		std::stringstream ss;
-		ss << "Error while publishing device: ";
-		if (resp.status == ipc::ReplyStatus::InvalidId) {
-			ss << "Invalid device id";
-			throw vrinputemulator_invalidid(ss.str());
-		} else if (resp.status == ipc::ReplyStatus::NotFound) {
-			ss << "Device not found";
-			throw vrinputemulator_notfound(ss.str());
-		} else if (resp.status != ipc::ReplyStatus::Ok) {
-			ss << "Error code " << (int)resp.status;
-			throw vrinputemulator_exception(ss.str());
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	publishVirtualDeviceAsync(virtualDeviceId, modal).get();
 }
 
-void VRInputEmulator::_setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, std::function<void(ipc::Request&)> dataHandler, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::VirtualDevices_SetDeviceProperty);
-		message.msg.vd_SetDeviceProperty.clientId = m_clientId;
-		message.msg.vd_SetDeviceProperty.virtualDeviceId = virtualDeviceId;
-		message.msg.vd_SetDeviceProperty.deviceProperty = deviceProperty;
-		dataHandler(message);
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.vd_SetDeviceProperty.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while setting device property: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::InvalidType) {
-				ss << "Invalid value type";
-				throw vrinputemulator_invalidtype(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			message.msg.vd_SetDeviceProperty.messageId = 0;
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+AsyncResult<void> VRInputEmulator::publishVirtualDeviceAsync(uint32_t virtualDeviceId, bool wantReply) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_PublishDevice);
+	message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
+	message.msg.vd_GenericDeviceIdMessage.deviceId = virtualDeviceId;
+	return _sendAsync<void>(message, message.msg.vd_GenericDeviceIdMessage.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "publishing device");
+	}, wantReply);
+}
+
+AsyncResult<void> VRInputEmulator::_setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, std::function<void(ipc::Request&)> dataHandler, bool wantReply) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_SetDeviceProperty);
+	message.msg.vd_SetDeviceProperty.clientId = m_clientId;
+	message.msg.vd_SetDeviceProperty.virtualDeviceId = virtualDeviceId;
+	message.msg.vd_SetDeviceProperty.deviceProperty = deviceProperty;
+	dataHandler(message);
+	return _sendAsync<void>(message, message.msg.vd_SetDeviceProperty.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting device property", "Invalid value type");
+	}, wantReply);
 }
 
 void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, int32_t value, bool modal) {
-	_setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
+	setVirtualDevicePropertyAsync(virtualDeviceId, deviceProperty, value, modal).get();
+}
+
+void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, uint64_t value, bool modal) {
+	setVirtualDevicePropertyAsync(virtualDeviceId, deviceProperty, value, modal).get();
+}
+
+void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, float value, bool modal) {
+	setVirtualDevicePropertyAsync(virtualDeviceId, deviceProperty, value, modal).get();
+}
+
+void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, bool value, bool modal) {
+	setVirtualDevicePropertyAsync(virtualDeviceId, deviceProperty, value, modal).get();
+}
+
+void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const vr::HmdMatrix34_t& value, bool modal) {
+	setVirtualDevicePropertyAsync(virtualDeviceId, deviceProperty, value, modal).get();
+}
+
+void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const char* value, bool modal) {
+	setVirtualDevicePropertyAsync(virtualDeviceId, deviceProperty, value, modal).get();
+}
+
+void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const std::string& value, bool modal) {
+	setVirtualDevicePropertyAsync(virtualDeviceId, deviceProperty, value, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, int32_t value, bool wantReply) {
+	return _setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
 		msg.msg.vd_SetDeviceProperty.valueType = DevicePropertyValueType::INT32;
 		msg.msg.vd_SetDeviceProperty.value.int32Value = value;
-	}, modal);
+	}, wantReply);
 }
 
-void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, uint64_t value, bool modal) {
-	_setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
+AsyncResult<void> VRInputEmulator::setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, uint64_t value, bool wantReply) {
+	return _setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
 		msg.msg.vd_SetDeviceProperty.valueType = DevicePropertyValueType::UINT64;
 		msg.msg.vd_SetDeviceProperty.value.uint64Value = value;
-	}, modal);
+	}, wantReply);
 }
 
-void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, float value, bool modal) {
-	_setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
+AsyncResult<void> VRInputEmulator::setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, float value, bool wantReply) {
+	return _setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
 		msg.msg.vd_SetDeviceProperty.valueType = DevicePropertyValueType::FLOAT;
 		msg.msg.vd_SetDeviceProperty.value.floatValue = value;
-	}, modal);
+	}, wantReply);
 }
 
-void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, bool value, bool modal) {
-	_setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
+AsyncResult<void> VRInputEmulator::setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, bool value, bool wantReply) {
+	return _setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
 		msg.msg.vd_SetDeviceProperty.valueType = DevicePropertyValueType::BOOL;
 		msg.msg.vd_SetDeviceProperty.value.boolValue = value;
-	}, modal);
+	}, wantReply);
 }
 
-void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const vr::HmdMatrix34_t& value, bool modal) {
-	_setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
+AsyncResult<void> VRInputEmulator::setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const vr::HmdMatrix34_t& value, bool wantReply) {
+	return _setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
 		msg.msg.vd_SetDeviceProperty.valueType = DevicePropertyValueType::MATRIX34;
 		msg.msg.vd_SetDeviceProperty.value.matrix34Value = value;
-	}, modal);
+	}, wantReply);
 }
 
-void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const char* value, bool modal) {
-	_setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
+AsyncResult<void> VRInputEmulator::setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const char* value, bool wantReply) {
+	return _setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
 		msg.msg.vd_SetDeviceProperty.valueType = DevicePropertyValueType::STRING;
 		strncpy_s(msg.msg.vd_SetDeviceProperty.value.stringValue, value, 255);
 		msg.msg.vd_SetDeviceProperty.value.stringValue[255] = '\0';
-	}, modal);
+	}, wantReply);
 }
 
-void VRInputEmulator::setVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const std::string& value, bool modal) {
-	_setVirtualDeviceProperty(virtualDeviceId, deviceProperty, [value](ipc::Request& msg) {
-		msg.msg.vd_SetDeviceProperty.valueType = DevicePropertyValueType::STRING;
-		strncpy_s(msg.msg.vd_SetDeviceProperty.value.stringValue, value.c_str(), 255);
-		msg.msg.vd_SetDeviceProperty.value.stringValue[255] = '\0';
-	}, modal);
+AsyncResult<void> VRInputEmulator::setVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, const std::string& value, bool wantReply) {
+	return setVirtualDevicePropertyAsync(virtualDeviceId, deviceProperty, value.c_str(), wantReply);
 }
 
 void VRInputEmulator::removeVirtualDeviceProperty(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::VirtualDevices_RemoveDeviceProperty);
-		message.msg.vd_RemoveDeviceProperty.clientId = m_clientId;
-		message.msg.vd_RemoveDeviceProperty.virtualDeviceId = virtualDeviceId;
-		message.msg.vd_RemoveDeviceProperty.deviceProperty = deviceProperty;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.vd_RemoveDeviceProperty.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while removing device property: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			message.msg.vd_RemoveDeviceProperty.messageId = 0;
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
+	removeVirtualDevicePropertyAsync(virtualDeviceId, deviceProperty, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::removeVirtualDevicePropertyAsync(uint32_t virtualDeviceId, vr::ETrackedDeviceProperty deviceProperty, bool wantReply) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_RemoveDeviceProperty);
+	message.msg.vd_RemoveDeviceProperty.clientId = m_clientId;
+	message.msg.vd_RemoveDeviceProperty.virtualDeviceId = virtualDeviceId;
+	message.msg.vd_RemoveDeviceProperty.deviceProperty = deviceProperty;
+	return _sendAsync<void>(message, message.msg.vd_RemoveDeviceProperty.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "removing device property");
+	}, wantReply);
+}
+
+void DevicePropertyList::_add(vr::ETrackedDeviceProperty deviceProperty, DevicePropertyValueType valueType, const void* value, uint32_t valueSize) {
+	ipc::Request_VirtualDevices_SetDeviceProperties_Entry header;
+	header.deviceProperty = deviceProperty;
+	header.valueType = valueType;
+	header.valueSize = valueSize;
+	std::vector<uint8_t> entry(sizeof(header) + valueSize);
+	memcpy(entry.data(), &header, sizeof(header));
+	if (valueSize > 0) {
+		memcpy(entry.data() + sizeof(header), value, valueSize);
 	}
+	_entries.push_back(std::move(entry));
 }
 
-void VRInputEmulator::setVirtualDevicePose(uint32_t virtualDeviceId, const vr::DriverPose_t & pose, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::VirtualDevices_SetDevicePose);
-		message.msg.vd_SetDevicePose.clientId = m_clientId;
-		message.msg.vd_SetDevicePose.virtualDeviceId = virtualDeviceId;
-		message.msg.vd_SetDevicePose.pose = pose;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.vd_SetDevicePose.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while setting device pose: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			message.msg.vd_SetDevicePose.messageId = 0;
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, int32_t value) {
+	_add(deviceProperty, DevicePropertyValueType::INT32, &value, sizeof(value));
+}
+
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, uint64_t value) {
+	_add(deviceProperty, DevicePropertyValueType::UINT64, &value, sizeof(value));
+}
+
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, float value) {
+	_add(deviceProperty, DevicePropertyValueType::FLOAT, &value, sizeof(value));
+}
+
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, bool value) {
+	_add(deviceProperty, DevicePropertyValueType::BOOL, &value, sizeof(value));
+}
+
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, const std::string& value) {
+	set(deviceProperty, value.c_str());
+}
+
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, const char* value) {
+	// A single entry needs to fit into one message
+	const size_t maxLength = REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_DATASIZE - sizeof(ipc::Request_VirtualDevices_SetDeviceProperties_Entry) - 1;
+	std::string str(value, strnlen(value, maxLength));
+	_add(deviceProperty, DevicePropertyValueType::STRING, str.c_str(), (uint32_t)str.size() + 1);
+}
+
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, const vr::HmdMatrix34_t& value) {
+	_add(deviceProperty, DevicePropertyValueType::MATRIX34, &value, sizeof(value));
+}
+
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, const vr::HmdMatrix44_t& value) {
+	_add(deviceProperty, DevicePropertyValueType::MATRIX44, &value, sizeof(value));
+}
+
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, const vr::HmdVector3_t& value) {
+	_add(deviceProperty, DevicePropertyValueType::VECTOR3, &value, sizeof(value));
+}
+
+void DevicePropertyList::set(vr::ETrackedDeviceProperty deviceProperty, const vr::HmdVector4_t& value) {
+	_add(deviceProperty, DevicePropertyValueType::VECTOR4, &value, sizeof(value));
+}
+
+void DevicePropertyList::remove(vr::ETrackedDeviceProperty deviceProperty) {
+	_add(deviceProperty, DevicePropertyValueType::INT32, nullptr, 0);
+}
+
+void VRInputEmulator::setVirtualDeviceProperties(uint32_t virtualDeviceId, const DevicePropertyList& properties, bool modal) {
+	setVirtualDevicePropertiesAsync(virtualDeviceId, properties, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setVirtualDevicePropertiesAsync(uint32_t virtualDeviceId, const DevicePropertyList& properties, bool wantReply) {
+	if (!_ipcServerQueue) {
 		throw vrinputemulator_connectionerror("No active connection.");
 	}
+	size_t batchSize = 0;
+	for (auto& e : properties._entries) {
+		batchSize += e.size();
+	}
+	if (properties._entries.size() > REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_MAXENTRIES || batchSize > REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_MAXBATCHSIZE) {
+		throw vrinputemulator_exception("Error while setting device properties: Too many properties for one batch");
+	}
+	ipc::Request message(ipc::RequestType::VirtualDevices_SetDeviceProperties);
+	message.msg.vd_SetDeviceProperties.clientId = m_clientId;
+	message.msg.vd_SetDeviceProperties.messageId = 0;
+	message.msg.vd_SetDeviceProperties.virtualDeviceId = virtualDeviceId;
+	message.msg.vd_SetDeviceProperties.commit = false;
+	message.msg.vd_SetDeviceProperties.entryCount = 0;
+	message.msg.vd_SetDeviceProperties.dataSize = 0;
+	// Another thread's chunks must not end up in our batch
+	std::lock_guard<std::mutex> lock(_propertyBatchMutex);
+	// Everything but the last message is only staged by the driver, so we don't need to wait for replies
+	for (auto& e : properties._entries) {
+		if (message.msg.vd_SetDeviceProperties.dataSize + e.size() > REQUEST_VIRTUALDEVICES_SETDEVICEPROPERTIES_DATASIZE) {
+			_send(message);
+			message.msg.vd_SetDeviceProperties.entryCount = 0;
+			message.msg.vd_SetDeviceProperties.dataSize = 0;
+		}
+		memcpy(message.msg.vd_SetDeviceProperties.data + message.msg.vd_SetDeviceProperties.dataSize, e.data(), e.size());
+		message.msg.vd_SetDeviceProperties.dataSize += (uint32_t)e.size();
+		message.msg.vd_SetDeviceProperties.entryCount++;
+	}
+	message.msg.vd_SetDeviceProperties.commit = true;
+	return _sendAsync<void>(message, message.msg.vd_SetDeviceProperties.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting device properties", "Invalid value type");
+	}, wantReply);
+}
+
+void VRInputEmulator::setVirtualDevicePose(uint32_t virtualDeviceId, const vr::DriverPose_t & pose, bool modal) {
+	setVirtualDevicePoseAsync(virtualDeviceId, pose, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setVirtualDevicePoseAsync(uint32_t virtualDeviceId, const vr::DriverPose_t & pose, bool wantReply) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_SetDevicePose);
+	message.msg.vd_SetDevicePose.clientId = m_clientId;
+	message.msg.vd_SetDevicePose.virtualDeviceId = virtualDeviceId;
+	message.msg.vd_SetDevicePose.pose = pose;
+	return _sendAsync<void>(message, message.msg.vd_SetDevicePose.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting device pose");
+	}, wantReply);
 }
 
 void VRInputEmulator::setVirtualControllerState(uint32_t virtualDeviceId, const vr::VRControllerState_t & state, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::VirtualDevices_SetControllerState);
+	setVirtualControllerStateAsync(virtualDeviceId, state, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setVirtualControllerStateAsync(uint32_t virtualDeviceId, const vr::VRControllerState_t & state, bool wantReply) {
+	if (!_ipcServerQueue) {
+		throw vrinputemulator_connectionerror("No active connection.");
+	}
+	bool hasShadowState = false;
+	vr::VRControllerState_t shadowState;
+	{
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		auto s = _controllerShadowStates.find(virtualDeviceId);
+		if (s != _controllerShadowStates.end()) {
+			hasShadowState = true;
+			shadowState = s->second;
+		}
+	}
+	ipc::Request message;
+	uint32_t* messageIdField;
+	size_t messageSize;
+	if (hasShadowState) {
+		message = ipc::Request(ipc::RequestType::VirtualDevices_SetControllerStateDelta);
+		message.msg.vd_SetControllerStateDelta.clientId = m_clientId;
+		message.msg.vd_SetControllerStateDelta.virtualDeviceId = virtualDeviceId;
+		message.msg.vd_SetControllerStateDelta.packetNum = state.unPacketNum;
+		message.msg.vd_SetControllerStateDelta.buttonPressed = state.ulButtonPressed;
+		message.msg.vd_SetControllerStateDelta.buttonTouched = state.ulButtonTouched;
+		message.msg.vd_SetControllerStateDelta.dirtyAxes = 0;
+		unsigned axisCount = 0;
+		for (unsigned i = 0; i < vr::k_unControllerStateAxisCount; ++i) {
+			if (state.rAxis[i].x != shadowState.rAxis[i].x || state.rAxis[i].y != shadowState.rAxis[i].y) {
+				message.msg.vd_SetControllerStateDelta.dirtyAxes |= 1 << i;
+				message.msg.vd_SetControllerStateDelta.axes[axisCount++] = state.rAxis[i];
+			}
+		}
+		if (!wantReply && axisCount == 0 && state.ulButtonPressed == shadowState.ulButtonPressed && state.ulButtonTouched == shadowState.ulButtonTouched) {
+			return AsyncResult<void>(); // Nothing the driver would act on
+		}
+		messageIdField = &message.msg.vd_SetControllerStateDelta.messageId;
+		messageSize = ipc::Request::controllerStateDeltaSize(axisCount);
+	} else {
+		message = ipc::Request(ipc::RequestType::VirtualDevices_SetControllerState);
 		message.msg.vd_SetControllerState.clientId = m_clientId;
 		message.msg.vd_SetControllerState.virtualDeviceId = virtualDeviceId;
 		message.msg.vd_SetControllerState.controllerState = state;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.vd_SetControllerState.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
+		messageIdField = &message.msg.vd_SetControllerState.messageId;
+		messageSize = sizeof(ipc::Request);
+	}
+	AsyncResult<void> result;
+	try {
+		result = _sendAsync<void>(message, *messageIdField, [this, virtualDeviceId](const ipc::Reply& resp) {
+			if (resp.status != ipc::ReplyStatus::Ok) {
 				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while setting controller state: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::InvalidType) {
-				ss << "Device type does not support this operation";
-				throw vrinputemulator_invalidtype(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			message.msg.vd_SetControllerState.messageId = 0;
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
+				_controllerShadowStates.erase(virtualDeviceId); // Next time send the full state
+			}
+			_checkReplyStatus(resp, "setting controller state", "Device type does not support this operation");
+		}, wantReply, messageSize);
+	} catch (...) {
+		// The driver may not have received this state, so the next delta would be computed against the wrong base
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		_controllerShadowStates.erase(virtualDeviceId);
+		throw;
 	}
+	// Only a state that made it into the queue may serve as base for the next delta
+	{
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		_controllerShadowStates[virtualDeviceId] = state;
+	}
+	return result;
+}
+
+void VRInputEmulator::setVirtualDevicePoseExtrapolation(uint32_t virtualDeviceId, double horizonSeconds, bool modal) {
+	setVirtualDevicePoseExtrapolationAsync(virtualDeviceId, horizonSeconds, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setVirtualDevicePoseExtrapolationAsync(uint32_t virtualDeviceId, double horizonSeconds, bool wantReply) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_SetPoseExtrapolation);
+	message.msg.vd_SetPoseExtrapolation.clientId = m_clientId;
+	message.msg.vd_SetPoseExtrapolation.virtualDeviceId = virtualDeviceId;
+	message.msg.vd_SetPoseExtrapolation.horizon = horizonSeconds;
+	return _sendAsync<void>(message, message.msg.vd_SetPoseExtrapolation.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting pose extrapolation");
+	}, wantReply);
+}
+
+void VRInputEmulator::setVirtualDevicePoseResampling(uint32_t virtualDeviceId, double delaySeconds, double outputRate, bool modal) {
+	setVirtualDevicePoseResamplingAsync(virtualDeviceId, delaySeconds, outputRate, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setVirtualDevicePoseResamplingAsync(uint32_t virtualDeviceId, double delaySeconds, double outputRate, bool wantReply) {
+	ipc::Request message(ipc::RequestType::VirtualDevices_SetPoseResampling);
+	message.msg.vd_SetPoseResampling.clientId = m_clientId;
+	message.msg.vd_SetPoseResampling.virtualDeviceId = virtualDeviceId;
+	message.msg.vd_SetPoseResampling.delay = delaySeconds;
+	message.msg.vd_SetPoseResampling.outputRate = outputRate;
+	return _sendAsync<void>(message, message.msg.vd_SetPoseResampling.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting pose resampling");
+	}, wantReply);
 }
 
 void VRInputEmulator::enableDeviceButtonMapping(uint32_t deviceId, bool enable, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_ButtonMapping);
-		message.msg.dm_ButtonMapping.clientId = m_clientId;
-		message.msg.dm_ButtonMapping.messageId = 0;
-		message.msg.dm_ButtonMapping.deviceId = deviceId;
-		message.msg.dm_ButtonMapping.enableMapping = enable ? 1 : 2;
-		message.msg.dm_ButtonMapping.mappingOperation = 0;
-		message.msg.dm_ButtonMapping.mappingCount = 0;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_ButtonMapping.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	enableDeviceButtonMappingAsync(deviceId, enable, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::enableDeviceButtonMappingAsync(uint32_t deviceId, bool enable, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_ButtonMapping);
+	message.msg.dm_ButtonMapping.clientId = m_clientId;
+	message.msg.dm_ButtonMapping.deviceId = deviceId;
+	message.msg.dm_ButtonMapping.enableMapping = enable ? 1 : 2;
+	message.msg.dm_ButtonMapping.mappingOperation = 0;
+	message.msg.dm_ButtonMapping.mappingCount = 0;
+	return _sendAsync<void>(message, message.msg.dm_ButtonMapping.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "enabling button mapping");
+	}, wantReply);
 }
 
 void VRInputEmulator::addDeviceButtonMapping(uint32_t deviceId, vr::EVRButtonId button, vr::EVRButtonId mapped, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_ButtonMapping);
-		message.msg.dm_ButtonMapping.clientId = m_clientId;
-		message.msg.dm_ButtonMapping.messageId = 0;
-		message.msg.dm_ButtonMapping.deviceId = deviceId;
-		message.msg.dm_ButtonMapping.enableMapping = 0;
-		message.msg.dm_ButtonMapping.mappingOperation = 1;
-		message.msg.dm_ButtonMapping.mappingCount = 1;
-		message.msg.dm_ButtonMapping.buttonMappings[0] = button;
-		message.msg.dm_ButtonMapping.buttonMappings[1] = mapped;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_ButtonMapping.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	addDeviceButtonMappingAsync(deviceId, button, mapped, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::addDeviceButtonMappingAsync(uint32_t deviceId, vr::EVRButtonId button, vr::EVRButtonId mapped, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_ButtonMapping);
+	message.msg.dm_ButtonMapping.clientId = m_clientId;
+	message.msg.dm_ButtonMapping.deviceId = deviceId;
+	message.msg.dm_ButtonMapping.enableMapping = 0;
+	message.msg.dm_ButtonMapping.mappingOperation = 1;
+	message.msg.dm_ButtonMapping.mappingCount = 1;
+	message.msg.dm_ButtonMapping.buttonMappings[0] = button;
+	message.msg.dm_ButtonMapping.buttonMappings[1] = mapped;
+	return _sendAsync<void>(message, message.msg.dm_ButtonMapping.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "adding button mapping");
+	}, wantReply);
 }
 
 void VRInputEmulator::removeDeviceButtonMapping(uint32_t deviceId, vr::EVRButtonId button, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_ButtonMapping);
-		message.msg.dm_ButtonMapping.clientId = m_clientId;
-		message.msg.dm_ButtonMapping.messageId = 0;
-		message.msg.dm_ButtonMapping.deviceId = deviceId;
-		message.msg.dm_ButtonMapping.enableMapping = 0;
-		message.msg.dm_ButtonMapping.mappingOperation = 2;
-		message.msg.dm_ButtonMapping.mappingCount = 1;
-		message.msg.dm_ButtonMapping.buttonMappings[0] = button;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_ButtonMapping.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	removeDeviceButtonMappingAsync(deviceId, button, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::removeDeviceButtonMappingAsync(uint32_t deviceId, vr::EVRButtonId button, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_ButtonMapping);
+	message.msg.dm_ButtonMapping.clientId = m_clientId;
+	message.msg.dm_ButtonMapping.deviceId = deviceId;
+	message.msg.dm_ButtonMapping.enableMapping = 0;
+	message.msg.dm_ButtonMapping.mappingOperation = 2;
+	message.msg.dm_ButtonMapping.mappingCount = 1;
+	message.msg.dm_ButtonMapping.buttonMappings[0] = button;
+	return _sendAsync<void>(message, message.msg.dm_ButtonMapping.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "removing button mapping");
+	}, wantReply);
 }
 
 void VRInputEmulator::removeAllDeviceButtonMappings(uint32_t deviceId, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_ButtonMapping);
-		message.msg.dm_ButtonMapping.clientId = m_clientId;
-		message.msg.dm_ButtonMapping.messageId = 0;
-		message.msg.dm_ButtonMapping.deviceId = deviceId;
-		message.msg.dm_ButtonMapping.enableMapping = 0;
-		message.msg.dm_ButtonMapping.mappingOperation = 3;
-		message.msg.dm_ButtonMapping.mappingCount = 0;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_ButtonMapping.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	removeAllDeviceButtonMappingsAsync(deviceId, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::removeAllDeviceButtonMappingsAsync(uint32_t deviceId, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_ButtonMapping);
+	message.msg.dm_ButtonMapping.clientId = m_clientId;
+	message.msg.dm_ButtonMapping.deviceId = deviceId;
+	message.msg.dm_ButtonMapping.enableMapping = 0;
+	message.msg.dm_ButtonMapping.mappingOperation = 3;
+	message.msg.dm_ButtonMapping.mappingCount = 0;
+	return _sendAsync<void>(message, message.msg.dm_ButtonMapping.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "removing button mappings");
+	}, wantReply);
+}
+
+void VRInputEmulator::setDeviceAxisTransform(uint32_t deviceId, const AxisTransform& transform, bool modal) {
+	setDeviceAxisTransformAsync(deviceId, transform, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDeviceAxisTransformAsync(uint32_t deviceId, const AxisTransform& transform, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_SetAxisTransform);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_SetAxisTransform.clientId = m_clientId;
+	message.msg.dm_SetAxisTransform.deviceId = deviceId;
+	message.msg.dm_SetAxisTransform.transform = transform;
+	return _sendAsync<void>(message, message.msg.dm_SetAxisTransform.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting axis transform");
+	}, wantReply);
 }
 
 void VRInputEmulator::getDeviceOffsets(uint32_t deviceId, DeviceOffsets & data) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_GetDeviceOffsets);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
-		message.msg.vd_GenericDeviceIdMessage.deviceId = deviceId;
-		uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-		message.msg.vd_GenericDeviceIdMessage.messageId = messageId;
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		auto resp = respFuture.get();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
-		}
-		std::stringstream ss;
-		ss << "Error while enabling device offsets: ";
-		if (resp.status == ipc::ReplyStatus::Ok) {
-			memcpy(&data, &resp.msg.dm_deviceOffsets, sizeof(DeviceOffsets));
-		} else if (resp.status == ipc::ReplyStatus::InvalidId) {
-			ss << "Invalid device id";
-			throw vrinputemulator_invalidid(ss.str());
-		} else if (resp.status == ipc::ReplyStatus::NotFound) {
-			ss << "Device not found";
-			throw vrinputemulator_notfound(ss.str());
-		} else if (resp.status != ipc::ReplyStatus::Ok) {
-			ss << "Error code " << (int)resp.status;
-			throw vrinputemulator_exception(ss.str());
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
+	ipc::SharedDeviceOffsets offsets;
+	if (_sharedState && deviceId < vr::k_unMaxTrackedDeviceCount && _sharedState->deviceOffsets[deviceId].tryLoad(offsets) && offsets.valid) {
+		data = offsets.offsets;
+		return;
 	}
+	data = getDeviceOffsetsAsync(deviceId).get();
 }
 
+AsyncResult<DeviceOffsets> VRInputEmulator::getDeviceOffsetsAsync(uint32_t deviceId) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_GetDeviceOffsets);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
+	message.msg.vd_GenericDeviceIdMessage.deviceId = deviceId;
+	return _sendAsync<DeviceOffsets>(message, message.msg.vd_GenericDeviceIdMessage.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "getting device offsets");
+		DeviceOffsets data;
+		memcpy(&data, &resp.msg.dm_deviceOffsets, sizeof(DeviceOffsets));
+		return data;
+	});
+}
 
-void VRInputEmulator::enableDeviceOffsets(uint32_t deviceId, bool enable, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_SetDeviceOffsets);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_DeviceOffsets.clientId = m_clientId;
-		message.msg.dm_DeviceOffsets.messageId = 0;
-		message.msg.dm_DeviceOffsets.deviceId = deviceId;
-		message.msg.dm_DeviceOffsets.enableOffsets = enable ? 1 : 2;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_DeviceOffsets.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			message.msg.dm_DeviceOffsets.messageId = 0;
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
+AsyncResult<void> VRInputEmulator::_setDeviceOffsets(uint32_t deviceId, uint32_t mask, std::function<void(DeviceOffsets&)> dataHandler, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_SetDeviceOffsets);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_DeviceOffsets.clientId = m_clientId;
+	message.msg.dm_DeviceOffsets.deviceId = deviceId;
+	message.msg.dm_DeviceOffsets.mask = mask;
+	dataHandler(message.msg.dm_DeviceOffsets.offsets);
+	return _sendAsync<void>(message, message.msg.dm_DeviceOffsets.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting device offsets");
+	}, wantReply);
+}
+
+void VRInputEmulator::setDeviceOffsets(const DeviceOffsets& offsets, uint32_t mask, bool modal) {
+	setDeviceOffsetsAsync(offsets, mask, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDeviceOffsetsAsync(const DeviceOffsets& offsets, uint32_t mask, bool wantReply) {
+	return _setDeviceOffsets(offsets.deviceId, mask, [&offsets](DeviceOffsets& data) {
+		data = offsets;
+	}, wantReply);
+}
+
+void VRInputEmulator::setDeviceOffsets(const std::vector<DeviceOffsets>& offsets, uint32_t mask) {
+	std::vector<AsyncResult<void>> results;
+	results.reserve(offsets.size());
+	for (auto& o : offsets) {
+		results.push_back(setDeviceOffsetsAsync(o, mask));
 	}
+	for (auto& r : results) {
+		r.get();
+	}
+}
+
+void VRInputEmulator::enableDeviceOffsets(uint32_t deviceId, bool enable, bool modal) {
+	enableDeviceOffsetsAsync(deviceId, enable, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::enableDeviceOffsetsAsync(uint32_t deviceId, bool enable, bool wantReply) {
+	return _setDeviceOffsets(deviceId, (uint32_t)DeviceOffsetsMask::Enabled, [enable](DeviceOffsets& data) {
+		data.offsetsEnabled = enable;
+	}, wantReply);
 }
 
 void VRInputEmulator::setWorldFromDriverRotationOffset(uint32_t deviceId, const vr::HmdQuaternion_t & value, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_SetDeviceOffsets);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_DeviceOffsets.clientId = m_clientId;
-		message.msg.dm_DeviceOffsets.messageId = 0;
-		message.msg.dm_DeviceOffsets.deviceId = deviceId;
-		message.msg.dm_DeviceOffsets.worldFromDriverRotationOffsetValid = true;
-		message.msg.dm_DeviceOffsets.worldFromDriverRotationOffset = value;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_DeviceOffsets.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setWorldFromDriverRotationOffsetAsync(deviceId, value, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setWorldFromDriverRotationOffsetAsync(uint32_t deviceId, const vr::HmdQuaternion_t & value, bool wantReply) {
+	return _setDeviceOffsets(deviceId, (uint32_t)DeviceOffsetsMask::WorldFromDriverRotation, [&value](DeviceOffsets& data) {
+		data.worldFromDriverRotationOffset = value;
+	}, wantReply);
 }
 
 void VRInputEmulator::setWorldFromDriverTranslationOffset(uint32_t deviceId, const vr::HmdVector3d_t & value, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_SetDeviceOffsets);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_DeviceOffsets.clientId = m_clientId;
-		message.msg.dm_DeviceOffsets.messageId = 0;
-		message.msg.dm_DeviceOffsets.deviceId = deviceId;
-		message.msg.dm_DeviceOffsets.worldFromDriverTranslationOffsetValid = true;
-		message.msg.dm_DeviceOffsets.worldFromDriverTranslationOffset = value;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_DeviceOffsets.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setWorldFromDriverTranslationOffsetAsync(deviceId, value, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setWorldFromDriverTranslationOffsetAsync(uint32_t deviceId, const vr::HmdVector3d_t & value, bool wantReply) {
+	return _setDeviceOffsets(deviceId, (uint32_t)DeviceOffsetsMask::WorldFromDriverTranslation, [&value](DeviceOffsets& data) {
+		data.worldFromDriverTranslationOffset = value;
+	}, wantReply);
 }
 
 void VRInputEmulator::setDriverFromHeadRotationOffset(uint32_t deviceId, const vr::HmdQuaternion_t & value, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_SetDeviceOffsets);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_DeviceOffsets.clientId = m_clientId;
-		message.msg.dm_DeviceOffsets.messageId = 0;
-		message.msg.dm_DeviceOffsets.deviceId = deviceId;
-		message.msg.dm_DeviceOffsets.driverFromHeadRotationOffsetValid = true;
-		message.msg.dm_DeviceOffsets.driverFromHeadRotationOffset = value;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_DeviceOffsets.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setDriverFromHeadRotationOffsetAsync(deviceId, value, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDriverFromHeadRotationOffsetAsync(uint32_t deviceId, const vr::HmdQuaternion_t & value, bool wantReply) {
+	return _setDeviceOffsets(deviceId, (uint32_t)DeviceOffsetsMask::DriverFromHeadRotation, [&value](DeviceOffsets& data) {
+		data.driverFromHeadRotationOffset = value;
+	}, wantReply);
 }
 
 void VRInputEmulator::setDriverFromHeadTranslationOffset(uint32_t deviceId, const vr::HmdVector3d_t & value, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_SetDeviceOffsets);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_DeviceOffsets.clientId = m_clientId;
-		message.msg.dm_DeviceOffsets.messageId = 0;
-		message.msg.dm_DeviceOffsets.deviceId = deviceId;
-		message.msg.dm_DeviceOffsets.driverFromHeadTranslationOffsetValid = true;
-		message.msg.dm_DeviceOffsets.driverFromHeadTranslationOffset = value;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_DeviceOffsets.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setDriverFromHeadTranslationOffsetAsync(deviceId, value, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDriverFromHeadTranslationOffsetAsync(uint32_t deviceId, const vr::HmdVector3d_t & value, bool wantReply) {
+	return _setDeviceOffsets(deviceId, (uint32_t)DeviceOffsetsMask::DriverFromHeadTranslation, [&value](DeviceOffsets& data) {
+		data.driverFromHeadTranslationOffset = value;
+	}, wantReply);
 }
 
 void VRInputEmulator::setDriverRotationOffset(uint32_t deviceId, const vr::HmdQuaternion_t & value, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_SetDeviceOffsets);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_DeviceOffsets.clientId = m_clientId;
-		message.msg.dm_DeviceOffsets.messageId = 0;
-		message.msg.dm_DeviceOffsets.deviceId = deviceId;
-		message.msg.dm_DeviceOffsets.deviceRotationOffsetValid = true;
-		message.msg.dm_DeviceOffsets.deviceRotationOffset = value;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_DeviceOffsets.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setDriverRotationOffsetAsync(deviceId, value, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDriverRotationOffsetAsync(uint32_t deviceId, const vr::HmdQuaternion_t & value, bool wantReply) {
+	return _setDeviceOffsets(deviceId, (uint32_t)DeviceOffsetsMask::DeviceRotation, [&value](DeviceOffsets& data) {
+		data.deviceRotationOffset = value;
+	}, wantReply);
 }
 
 void VRInputEmulator::setDriverTranslationOffset(uint32_t deviceId, const vr::HmdVector3d_t & value, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_SetDeviceOffsets);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_DeviceOffsets.clientId = m_clientId;
-		message.msg.dm_DeviceOffsets.messageId = 0;
-		message.msg.dm_DeviceOffsets.deviceId = deviceId;
-		message.msg.dm_DeviceOffsets.deviceTranslationOffsetValid = true;
-		message.msg.dm_DeviceOffsets.deviceTranslationOffset = value;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_DeviceOffsets.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setDriverTranslationOffsetAsync(deviceId, value, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDriverTranslationOffsetAsync(uint32_t deviceId, const vr::HmdVector3d_t & value, bool wantReply) {
+	return _setDeviceOffsets(deviceId, (uint32_t)DeviceOffsetsMask::DeviceTranslation, [&value](DeviceOffsets& data) {
+		data.deviceTranslationOffset = value;
+	}, wantReply);
 }
 
 void VRInputEmulator::getDeviceInfo(uint32_t deviceId, DeviceInfo & info) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_GetDeviceInfo);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
-		message.msg.vd_GenericDeviceIdMessage.deviceId = deviceId;
-		uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-		message.msg.vd_GenericDeviceIdMessage.messageId = messageId;
-		std::promise<ipc::Reply> respPromise;
-		auto respFuture = respPromise.get_future();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-		}
-		_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		auto resp = respFuture.get();
-		{
-			std::lock_guard<std::recursive_mutex> lock(_mutex);
-			_ipcPromiseMap.erase(messageId);
+	info = getDeviceInfoAsync(deviceId).get();
+}
+
+AsyncResult<DeviceInfo> VRInputEmulator::getDeviceInfoAsync(uint32_t deviceId) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_GetDeviceInfo);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
+	message.msg.vd_GenericDeviceIdMessage.deviceId = deviceId;
+	return _sendAsync<DeviceInfo>(message, message.msg.vd_GenericDeviceIdMessage.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "getting device info");
+		DeviceInfo info;
+		info.deviceId = resp.msg.dm_deviceInfo.deviceId;
+		info.deviceClass = resp.msg.dm_deviceInfo.deviceClass;
+		info.deviceMode = resp.msg.dm_deviceInfo.deviceMode;
+		info.offsetsEnabled = resp.msg.dm_deviceInfo.offsetsEnabled;
+		info.buttonMappingEnabled = resp.msg.dm_deviceInfo.buttonMappingEnabled;
+		info.redirectSuspended = resp.msg.dm_deviceInfo.redirectSuspended;
+		info.motionCompensationGroup = resp.msg.dm_deviceInfo.motionCompensationGroup;
+		info.refDeviceId = resp.msg.dm_deviceInfo.refDeviceId;
+		return info;
+	});
+}
+
+bool VRInputEmulator::getAllDeviceInfo(std::vector<DeviceInfo>& devices, uint32_t& sequence) {
+	auto result = getAllDeviceInfoAsync(sequence).get();
+	if (result.unchanged) {
+		return false;
+	}
+	devices = std::move(result.devices);
+	sequence = result.sequence;
+	return true;
+}
+
+AsyncResult<AllDeviceInfo> VRInputEmulator::getAllDeviceInfoAsync(uint32_t knownSequence) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_GetAllDeviceInfo);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_GetAllDeviceInfo.clientId = m_clientId;
+	message.msg.dm_GetAllDeviceInfo.knownSequence = knownSequence;
+	return _sendAsync<AllDeviceInfo>(message, message.msg.dm_GetAllDeviceInfo.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "getting all device infos");
+		AllDeviceInfo result;
+		result.sequence = resp.msg.dm_allDeviceInfo.sequence;
+		result.unchanged = resp.msg.dm_allDeviceInfo.unchanged;
+		auto count = resp.msg.dm_allDeviceInfo.deviceCount;
+		if (count > vr::k_unMaxTrackedDeviceCount) {
+			count = vr::k_unMaxTrackedDeviceCount;
 		}
-		std::stringstream ss;
-		ss << "Error while enabling device offsets: ";
-		if (resp.status == ipc::ReplyStatus::Ok) {
-			info.deviceId = resp.msg.dm_deviceInfo.deviceId;
-			info.deviceClass = resp.msg.dm_deviceInfo.deviceClass;
-			info.deviceMode = resp.msg.dm_deviceInfo.deviceMode;
-			info.offsetsEnabled = resp.msg.dm_deviceInfo.offsetsEnabled;
-			info.buttonMappingEnabled = resp.msg.dm_deviceInfo.buttonMappingEnabled;
-			info.redirectSuspended = resp.msg.dm_deviceInfo.redirectSuspended;
-		} else if (resp.status == ipc::ReplyStatus::InvalidId) {
-			ss << "Invalid device id";
-			throw vrinputemulator_invalidid(ss.str());
-		} else if (resp.status == ipc::ReplyStatus::NotFound) {
-			ss << "Device not found";
-			throw vrinputemulator_notfound(ss.str());
-		} else if (resp.status != ipc::ReplyStatus::Ok) {
-			ss << "Error code " << (int)resp.status;
-			throw vrinputemulator_exception(ss.str());
+		result.devices.reserve(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			auto& e = resp.msg.dm_allDeviceInfo.devices[i];
+			DeviceInfo info;
+			info.deviceId = e.deviceId;
+			info.deviceClass = (vr::ETrackedDeviceClass)e.deviceClass;
+			info.deviceMode = e.deviceMode;
+			info.offsetsEnabled = (e.flags & ipc::DeviceInfoEntry_OffsetsEnabled) != 0;
+			info.buttonMappingEnabled = (e.flags & ipc::DeviceInfoEntry_ButtonMappingEnabled) != 0;
+			info.redirectSuspended = (e.flags & ipc::DeviceInfoEntry_RedirectSuspended) != 0;
+			info.motionCompensationGroup = e.motionCompensationGroup != DEVICEINFOENTRY_NOGROUP ? e.motionCompensationGroup : MOTIONCOMPENSATION_NOGROUP;
+			info.refDeviceId = e.refDeviceId != DEVICEINFOENTRY_NOREFDEVICE ? e.refDeviceId : vr::k_unTrackedDeviceIndexInvalid;
+			result.devices.push_back(info);
 		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+		return result;
+	});
 }
 
 void VRInputEmulator::setDeviceNormalMode(uint32_t deviceId, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_DefaultMode);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
-		message.msg.vd_GenericDeviceIdMessage.messageId = 0;
-		message.msg.vd_GenericDeviceIdMessage.deviceId = deviceId;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_DeviceOffsets.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setDeviceNormalModeAsync(deviceId, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDeviceNormalModeAsync(uint32_t deviceId, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_DefaultMode);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
+	message.msg.vd_GenericDeviceIdMessage.deviceId = deviceId;
+	return _sendAsync<void>(message, message.msg.vd_GenericDeviceIdMessage.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting normal mode");
+	}, wantReply);
 }
 
 void VRInputEmulator::setDeviceFakeDisconnectedMode(uint32_t deviceId, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_FakeDisconnectedMode);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
-		message.msg.vd_GenericDeviceIdMessage.messageId = 0;
-		message.msg.vd_GenericDeviceIdMessage.deviceId = deviceId;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.vd_GenericDeviceIdMessage.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setDeviceFakeDisconnectedModeAsync(deviceId, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDeviceFakeDisconnectedModeAsync(uint32_t deviceId, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_FakeDisconnectedMode);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.vd_GenericDeviceIdMessage.clientId = m_clientId;
+	message.msg.vd_GenericDeviceIdMessage.deviceId = deviceId;
+	return _sendAsync<void>(message, message.msg.vd_GenericDeviceIdMessage.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting fake disconnected mode");
+	}, wantReply);
 }
 
 void VRInputEmulator::setDeviceRedictMode(uint32_t deviceId, uint32_t target, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_RedirectMode);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_RedirectMode.clientId = m_clientId;
-		message.msg.dm_RedirectMode.messageId = 0;
-		message.msg.dm_RedirectMode.deviceId = deviceId;
-		message.msg.dm_RedirectMode.targetId = target;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_RedirectMode.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setDeviceRedictModeAsync(deviceId, target, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDeviceRedictModeAsync(uint32_t deviceId, uint32_t target, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_RedirectMode);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_RedirectMode.clientId = m_clientId;
+	message.msg.dm_RedirectMode.deviceId = deviceId;
+	message.msg.dm_RedirectMode.targetId = target;
+	return _sendAsync<void>(message, message.msg.dm_RedirectMode.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting redirect mode");
+	}, wantReply);
 }
 
 void VRInputEmulator::setDeviceSwapMode(uint32_t deviceId, uint32_t target, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_SwapMode);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_SwapMode.clientId = m_clientId;
-		message.msg.dm_SwapMode.messageId = 0;
-		message.msg.dm_SwapMode.deviceId = deviceId;
-		message.msg.dm_SwapMode.targetId = target;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_SwapMode.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+	setDeviceSwapModeAsync(deviceId, target, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDeviceSwapModeAsync(uint32_t deviceId, uint32_t target, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_SwapMode);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_SwapMode.clientId = m_clientId;
+	message.msg.dm_SwapMode.deviceId = deviceId;
+	message.msg.dm_SwapMode.targetId = target;
+	return _sendAsync<void>(message, message.msg.dm_SwapMode.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting swap mode");
+	}, wantReply);
 }
 
 
 void VRInputEmulator::setDeviceMotionCompensationMode(uint32_t deviceId, const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_MotionCompensationMode);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_MotionCompensationMode.clientId = m_clientId;
-		message.msg.dm_MotionCompensationMode.messageId = 0;
-		message.msg.dm_MotionCompensationMode.deviceId = deviceId;
-		message.msg.dm_MotionCompensationMode.centerPos = centerPos;
-		message.msg.dm_MotionCompensationMode.centerRelativeToDevice = relativeToDevice;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_MotionCompensationMode.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
+	setDeviceMotionCompensationModeAsync(deviceId, centerPos, relativeToDevice, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDeviceMotionCompensationModeAsync(uint32_t deviceId, const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_MotionCompensationMode);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_MotionCompensationMode.clientId = m_clientId;
+	message.msg.dm_MotionCompensationMode.deviceId = deviceId;
+	message.msg.dm_MotionCompensationMode.centerPos = centerPos;
+	message.msg.dm_MotionCompensationMode.centerRelativeToDevice = relativeToDevice;
+	return _sendAsync<void>(message, message.msg.dm_MotionCompensationMode.messageId, [](const ipc::Reply& resp) {
+		if (resp.status == ipc::ReplyStatus::AlreadyInUse) {
+			throw vrinputemulator_alreadyinuse("Error while setting motion compensation mode: The device's group already has a reference device");
 		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+		_checkReplyStatus(resp, "setting motion compensation mode");
+	}, wantReply);
 }
 
 void VRInputEmulator::setMotionCompensationCenter(const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_SetMotionCompensationProperties);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_SetMotionCompensationProperties.clientId = m_clientId;
-		message.msg.dm_SetMotionCompensationProperties.messageId = 0;
-		message.msg.dm_SetMotionCompensationProperties.centerPos = centerPos;
-		message.msg.dm_SetMotionCompensationProperties.centerRelativeToDevice = relativeToDevice;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_SetMotionCompensationProperties.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
+	setMotionCompensationCenterAsync(centerPos, relativeToDevice, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setMotionCompensationCenterAsync(const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool wantReply) {
+	return setMotionCompensationGroupCenterAsync(0, centerPos, relativeToDevice, wantReply);
+}
+
+void VRInputEmulator::setMotionCompensationGroupCenter(uint32_t group, const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool modal) {
+	setMotionCompensationGroupCenterAsync(group, centerPos, relativeToDevice, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setMotionCompensationGroupCenterAsync(uint32_t group, const vr::HmdVector3d_t& centerPos, bool relativeToDevice, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_SetMotionCompensationProperties);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_SetMotionCompensationProperties.clientId = m_clientId;
+	message.msg.dm_SetMotionCompensationProperties.group = group;
+	message.msg.dm_SetMotionCompensationProperties.centerPos = centerPos;
+	message.msg.dm_SetMotionCompensationProperties.centerRelativeToDevice = relativeToDevice;
+	return _sendAsync<void>(message, message.msg.dm_SetMotionCompensationProperties.messageId, [](const ipc::Reply& resp) {
+		if (resp.status == ipc::ReplyStatus::InvalidId) {
+			throw vrinputemulator_invalidid("Error while setting motion compensation center: Invalid group");
+		} else if (resp.status != ipc::ReplyStatus::Ok) {
 			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
+			ss << "Error while setting motion compensation center: Error code " << (int)resp.status;
+			throw vrinputemulator_exception(ss.str());
 		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
+	}, wantReply);
+}
+
+void VRInputEmulator::setDeviceMotionCompensationGroup(uint32_t deviceId, uint32_t group, bool modal) {
+	setDeviceMotionCompensationGroupAsync(deviceId, group, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDeviceMotionCompensationGroupAsync(uint32_t deviceId, uint32_t group, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_SetMotionCompensationGroup);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_SetMotionCompensationGroup.clientId = m_clientId;
+	message.msg.dm_SetMotionCompensationGroup.deviceId = deviceId;
+	message.msg.dm_SetMotionCompensationGroup.group = group;
+	return _sendAsync<void>(message, message.msg.dm_SetMotionCompensationGroup.messageId, [](const ipc::Reply& resp) {
+		if (resp.status == ipc::ReplyStatus::InvalidOperation) {
+			throw vrinputemulator_exception("Error while setting motion compensation group: The reference device of a group cannot leave all groups");
+		} else if (resp.status == ipc::ReplyStatus::AlreadyInUse) {
+			throw vrinputemulator_alreadyinuse("Error while setting motion compensation group: The group already has a reference device");
+		}
+		_checkReplyStatus(resp, "setting motion compensation group");
+	}, wantReply);
+}
+
+void VRInputEmulator::setDevicePoseFilter(uint32_t deviceId, const PoseFilterStage* stages, uint32_t stageCount, bool modal) {
+	setDevicePoseFilterAsync(deviceId, stages, stageCount, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::setDevicePoseFilterAsync(uint32_t deviceId, const PoseFilterStage* stages, uint32_t stageCount, bool wantReply) {
+	if (stageCount > POSEFILTER_MAXSTAGES) {
+		std::stringstream ss;
+		ss << "Error while setting pose filter: Too many filter stages (max " << POSEFILTER_MAXSTAGES << ")";
+		throw vrinputemulator_exception(ss.str());
+	}
+	ipc::Request message(ipc::RequestType::DeviceManipulation_SetPoseFilter);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_SetPoseFilter.clientId = m_clientId;
+	message.msg.dm_SetPoseFilter.deviceId = deviceId;
+	message.msg.dm_SetPoseFilter.stageCount = stageCount;
+	for (uint32_t i = 0; i < stageCount; ++i) {
+		message.msg.dm_SetPoseFilter.stages[i] = stages[i];
 	}
+	return _sendAsync<void>(message, message.msg.dm_SetPoseFilter.messageId, [](const ipc::Reply& resp) {
+		_checkReplyStatus(resp, "setting pose filter");
+	}, wantReply);
+}
+
+void VRInputEmulator::enableDevicePoseFilter(uint32_t deviceId, bool enable, bool modal) {
+	enableDevicePoseFilterAsync(deviceId, enable, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::enableDevicePoseFilterAsync(uint32_t deviceId, bool enable, bool wantReply) {
+	// min cutoff 2 Hz, cutoff rises by 10 Hz per m/s (rad/s), derivative cutoff 1 Hz
+	PoseFilterStage oneEuro = { PoseFilterType::OneEuro, { 2.0, 10.0, 1.0 } };
+	return setDevicePoseFilterAsync(deviceId, &oneEuro, enable ? 1 : 0, wantReply);
+}
+
+void VRInputEmulator::setDeviceRoutes(const DeviceRoute* routes, uint32_t routeCount, bool modal) {
+	setDeviceRoutesAsync(routes, routeCount, modal).get();
+}
 
+AsyncResult<void> VRInputEmulator::setDeviceRoutesAsync(const DeviceRoute* routes, uint32_t routeCount, bool wantReply) {
+	if (routeCount > DEVICEROUTING_MAXROUTES) {
+		std::stringstream ss;
+		ss << "Error while setting device routes: Too many routes (max " << DEVICEROUTING_MAXROUTES << ")";
+		throw vrinputemulator_exception(ss.str());
+	}
+	ipc::Request message(ipc::RequestType::DeviceManipulation_SetRoutes);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_SetRoutes.clientId = m_clientId;
+	message.msg.dm_SetRoutes.routeCount = routeCount;
+	if (routeCount > 0) {
+		memcpy(message.msg.dm_SetRoutes.routes, routes, routeCount * sizeof(DeviceRoute));
+	}
+	return _sendAsync<void>(message, message.msg.dm_SetRoutes.messageId, [](const ipc::Reply& resp) {
+		if (resp.status == ipc::ReplyStatus::InvalidId) {
+			throw vrinputemulator_invalidid("Error while setting device routes: Invalid device id or channel");
+		}
+		_checkReplyStatus(resp, "setting device routes");
+	}, wantReply);
 }
 
 void VRInputEmulator::triggerHapticPulse(uint32_t deviceId, uint32_t axisId, uint16_t durationMicroseconds, bool directMode, bool modal) {
-	if (_ipcServerQueue) {
-		ipc::Request message(ipc::RequestType::DeviceManipulation_TriggerHapticPulse);
-		memset(&message.msg, 0, sizeof(message.msg));
-		message.msg.dm_triggerHapticPulse.clientId = m_clientId;
-		message.msg.dm_triggerHapticPulse.messageId = 0;
-		message.msg.dm_triggerHapticPulse.deviceId = deviceId;
-		message.msg.dm_triggerHapticPulse.axisId = axisId;
-		message.msg.dm_triggerHapticPulse.durationMicroseconds = durationMicroseconds;
-		message.msg.dm_triggerHapticPulse.directMode = directMode;
-		if (modal) {
-			uint32_t messageId = _ipcRandomDist(_ipcRandomDevice);
-			message.msg.dm_triggerHapticPulse.messageId = messageId;
-			std::promise<ipc::Reply> respPromise;
-			auto respFuture = respPromise.get_future();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.insert({ messageId, std::move(respPromise) });
-			}
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
-			auto resp = respFuture.get();
-			{
-				std::lock_guard<std::recursive_mutex> lock(_mutex);
-				_ipcPromiseMap.erase(messageId);
-			}
-			std::stringstream ss;
-			ss << "Error while enabling device offsets: ";
-			if (resp.status == ipc::ReplyStatus::InvalidId) {
-				ss << "Invalid device id";
-				throw vrinputemulator_invalidid(ss.str());
-			} else if (resp.status == ipc::ReplyStatus::NotFound) {
-				ss << "Device not found";
-				throw vrinputemulator_notfound(ss.str());
-			} else if (resp.status != ipc::ReplyStatus::Ok) {
-				ss << "Error code " << (int)resp.status;
-				throw vrinputemulator_exception(ss.str());
-			}
-		} else {
-			_ipcServerQueue->send(&message, sizeof(ipc::Request), 0);
+	triggerHapticPulseAsync(deviceId, axisId, durationMicroseconds, directMode, modal).get();
+}
+
+AsyncResult<void> VRInputEmulator::triggerHapticPulseAsync(uint32_t deviceId, uint32_t axisId, uint16_t durationMicroseconds, bool directMode, bool wantReply) {
+	ipc::Request message(ipc::RequestType::DeviceManipulation_TriggerHapticPulse);
+	memset(&message.msg, 0, sizeof(message.msg));
+	message.msg.dm_triggerHapticPulse.clientId = m_clientId;
+	message.msg.dm_triggerHapticPulse.deviceId = deviceId;
+	message.msg.dm_triggerHapticPulse.axisId = axisId;
+	message.msg.dm_triggerHapticPulse.durationMicroseconds = durationMicroseconds;
+	message.msg.dm_triggerHapticPulse.directMode = directMode;
+	return _sendAsync<void>(message, message.msg.dm_triggerHapticPulse.messageId, [](const ipc::Reply& resp) {
+		if (resp.status == ipc::ReplyStatus::InvalidOperation) {
+			throw vrinputemulator_exception("Error while triggering haptic pulse: The device has no haptics on that axis");
 		}
-	} else {
-		throw vrinputemulator_connectionerror("No active connection.");
-	}
+		_checkReplyStatus(resp, "triggering haptic pulse");
+	}, wantReply);
 }
 
 
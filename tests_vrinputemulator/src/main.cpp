@@ -0,0 +1,69 @@
+#include "tests.h"
+#include <atomic>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+
+
+static std::atomic<uint64_t> _allocationCount(0);
+
+void* operator new(std::size_t size) {
+	_allocationCount++;
+	if (auto p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+
+namespace vrinputemulator {
+namespace tests {
+
+uint64_t allocationCount() {
+	return _allocationCount.load();
+}
+
+void report(const char* format, ...) {
+	std::va_list args;
+	va_start(args, format);
+	std::printf("[ BENCH] ");
+	std::vprintf(format, args);
+	std::printf("\n");
+	va_end(args);
+}
+
+} // end namespace tests
+} // end namespace vrinputemulator
+
+
+// Usage: tests_vrinputemulator [name filter]
+int main(int argc, const char* argv[]) {
+	unsigned run = 0;
+	unsigned failed = 0;
+	for (auto& t : vrinputemulator::tests::testCases()) {
+		if (argc > 1 && !std::strstr(t.name, argv[1])) {
+			continue;
+		}
+		run++;
+		std::printf("[ RUN  ] %s\n", t.name);
+		try {
+			t.func();
+			std::printf("[  OK  ] %s\n", t.name);
+		} catch (std::exception& e) {
+			failed++;
+			std::printf("[ FAIL ] %s: %s\n", t.name, e.what());
+		}
+	}
+	std::printf("%u of %u tests passed\n", run - failed, run);
+	return failed > 0 ? 1 : 0;
+}
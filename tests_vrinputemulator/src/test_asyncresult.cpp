@@ -0,0 +1,127 @@
+#include "tests.h"
+#include <vrinputemulator_coro.h>
+#include <atomic>
+#include <thread>
+
+using namespace vrinputemulator;
+
+
+static AsyncResult<uint32_t> _pendingDeviceCount(std::shared_ptr<_AsyncRequest>& request) {
+	request = std::make_shared<_AsyncRequest>();
+	return AsyncResult<uint32_t>(request, [](const ipc::Reply& resp) {
+		if (resp.status != ipc::ReplyStatus::Ok) {
+			throw vrinputemulator_exception("Error while getting device count");
+		}
+		return resp.msg.vd_GetDeviceCount.deviceCount;
+	});
+}
+
+
+TEST_CASE(asyncResult_getAndThen) {
+	std::shared_ptr<_AsyncRequest> request;
+	auto result = _pendingDeviceCount(request);
+	CHECK(result.valid() && !result.isReady());
+	bool called = false;
+	result.then([&](const AsyncResult<uint32_t>& r) {
+		called = r.get() == 3;
+	});
+	ipc::Reply reply(ipc::ReplyType::GenericReply);
+	reply.status = ipc::ReplyStatus::Ok;
+	reply.msg.vd_GetDeviceCount.deviceCount = 3;
+	request->complete(_AsyncRequest::Result::Ok, &reply);
+	CHECK(called && result.isReady() && result.get() == 3);
+
+	auto timedOut = _pendingDeviceCount(request);
+	request->complete(_AsyncRequest::Result::TimedOut);
+	bool thrown = false;
+	try {
+		timedOut.get();
+	} catch (const vrinputemulator_timeout&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+
+#if defined(__cpp_impl_coroutine) || (defined(_MSVC_LANG) && _MSVC_LANG > 201703L)
+
+namespace {
+
+// Minimal eagerly started coroutine that cleans up after itself
+struct DetachedTask {
+	struct promise_type {
+		DetachedTask get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+DetachedTask _awaitDeviceCount(AsyncResult<uint32_t> result, uint32_t expected, std::atomic<unsigned>& resumed, std::atomic<unsigned>& mismatches,
+		std::thread::id& resumeThread) {
+	uint32_t count = co_await std::move(result);
+	if (count != expected) {
+		++mismatches;
+	}
+	resumeThread = std::this_thread::get_id();
+	++resumed;
+}
+
+}
+
+
+TEST_CASE(asyncResult_thousandConcurrentAwaits) {
+	const unsigned count = 1000;
+	std::vector<std::shared_ptr<_AsyncRequest>> requests(count);
+	std::vector<std::thread::id> resumeThreads(count);
+	std::atomic<unsigned> resumed(0);
+	std::atomic<unsigned> mismatches(0);
+
+	// All coroutines are started and suspended on this thread
+	for (unsigned i = 0; i < count; ++i) {
+		_awaitDeviceCount(_pendingDeviceCount(requests[i]), i, resumed, mismatches, resumeThreads[i]);
+	}
+	CHECK(resumed == 0);
+
+	// Stand-in for the ipc receive thread, answering in a different order than the requests were made
+	uint64_t resumeAllocations = 0;
+	std::thread::id ipcThread;
+	std::thread ipc([&]() {
+		ipcThread = std::this_thread::get_id();
+		ipc::Reply reply(ipc::ReplyType::GenericReply);
+		reply.status = ipc::ReplyStatus::Ok;
+		auto allocations = tests::allocationCount();
+		for (unsigned n = 0; n < count; ++n) {
+			unsigned i = (n * 7919) % count;
+			reply.msg.vd_GetDeviceCount.deviceCount = i;
+			requests[i]->complete(_AsyncRequest::Result::Ok, &reply);
+		}
+		resumeAllocations = tests::allocationCount() - allocations;
+	});
+	ipc.join();
+
+	CHECK(resumed == count);
+	CHECK(mismatches == 0);
+	// Completing and resuming must not allocate, other threads of this process are idle
+	CHECK(resumeAllocations == 0);
+	for (auto& id : resumeThreads) {
+		CHECK(id == ipcThread);
+	}
+
+	// Awaiting an already completed request continues without suspending
+	std::shared_ptr<_AsyncRequest> request;
+	auto result = _pendingDeviceCount(request);
+	ipc::Reply reply(ipc::ReplyType::GenericReply);
+	reply.status = ipc::ReplyStatus::Ok;
+	reply.msg.vd_GetDeviceCount.deviceCount = 5;
+	request->complete(_AsyncRequest::Result::Ok, &reply);
+	std::thread::id resumeThread;
+	_awaitDeviceCount(result, 5, resumed, mismatches, resumeThread);
+	CHECK(resumed == count + 1 && mismatches == 0 && resumeThread == std::this_thread::get_id());
+}
+
+#elif defined(_MSC_VER)
+	// The test project builds with /std:c++latest, the coroutine tests must not silently disappear
+	#error "tests_vrinputemulator needs C++20 coroutine support"
+#endif
@@ -0,0 +1,165 @@
+#include "tests.h"
+#include <utils/AxisTransform.h>
+#include <cmath>
+#include <cstring>
+
+using namespace vrinputemulator;
+using namespace vrinputemulator::driver;
+
+
+static AxisTransform _transform(uint32_t axisId) {
+	AxisTransform t;
+	std::memset(&t, 0, sizeof(t));
+	t.axisId = axisId;
+	t.enabled = true;
+	t.saturation = 1.0f;
+	t.curveType = AxisCurveType::Linear;
+	t.remapAxisId = AXISTRANSFORM_NOREMAP;
+	t.buttonId = AXISTRANSFORM_NOBUTTON;
+	return t;
+}
+
+static bool _near(float a, float b) {
+	return std::fabs(a - b) < 1.0e-4f;
+}
+
+static uint32_t _apply(AxisTransformer& transformer, float x, float y, vr::VRControllerAxis_t& state, int& buttonEvent) {
+	state.x = x;
+	state.y = y;
+	return transformer.apply(state, buttonEvent);
+}
+
+
+TEST_CASE(axisTransform_remap) {
+	AxisTransformer transformer;
+	CHECK(!transformer.enabled());
+	CHECK(transformer.config().remapAxisId == AXISTRANSFORM_NOREMAP);
+	vr::VRControllerAxis_t state;
+	int buttonEvent;
+	// No remap keeps the axis, a zero remapAxisId really means axis 0
+	transformer.configure(_transform(2));
+	CHECK(_apply(transformer, 0.5f, 0.0f, state, buttonEvent) == 2);
+	auto t = _transform(2);
+	t.remapAxisId = 0;
+	transformer.configure(t);
+	CHECK(_apply(transformer, 0.5f, 0.0f, state, buttonEvent) == 0);
+	t.remapAxisId = 4;
+	transformer.configure(t);
+	CHECK(_apply(transformer, 0.5f, 0.0f, state, buttonEvent) == 4);
+	CHECK(buttonEvent == 0);
+}
+
+
+TEST_CASE(axisTransform_swapAndInvert) {
+	AxisTransformer transformer;
+	auto t = _transform(0);
+	t.swapXY = true;
+	t.invertX = true;
+	transformer.configure(t);
+	vr::VRControllerAxis_t state;
+	int buttonEvent;
+	// Swap comes before invert, so the inverted x is the former y
+	_apply(transformer, 0.2f, 0.6f, state, buttonEvent);
+	CHECK(_near(state.x, -0.6f) && _near(state.y, 0.2f));
+	t.swapXY = false;
+	t.invertX = false;
+	t.invertY = true;
+	transformer.configure(t);
+	_apply(transformer, 0.2f, 0.6f, state, buttonEvent);
+	CHECK(_near(state.x, 0.2f) && _near(state.y, -0.6f));
+}
+
+
+TEST_CASE(axisTransform_deadzoneAndSaturation) {
+	AxisTransformer transformer;
+	auto t = _transform(0);
+	t.deadzone = 0.2f;
+	t.saturation = 0.8f;
+	transformer.configure(t);
+	vr::VRControllerAxis_t state;
+	int buttonEvent;
+	_apply(transformer, 0.1f, 0.1f, state, buttonEvent);
+	CHECK(state.x == 0.0f && state.y == 0.0f);
+	// Rescaled on the magnitude, the direction is kept
+	_apply(transformer, 0.3f, 0.4f, state, buttonEvent); // magnitude 0.5 -> 0.5
+	CHECK(_near(state.x, 0.3f) && _near(state.y, 0.4f));
+	_apply(transformer, 0.0f, -0.35f, state, buttonEvent); // 0.35 -> 0.25
+	CHECK(_near(state.x, 0.0f) && _near(state.y, -0.25f));
+	_apply(transformer, 0.0f, 0.95f, state, buttonEvent);
+	CHECK(_near(state.y, 1.0f));
+	// Invalid settings fall back to something usable
+	t.deadzone = -1.0f;
+	t.saturation = 2.0f;
+	transformer.configure(t);
+	CHECK(transformer.config().deadzone == 0.0f && transformer.config().saturation == 1.0f);
+	_apply(transformer, 0.5f, 0.0f, state, buttonEvent);
+	CHECK(_near(state.x, 0.5f));
+}
+
+
+TEST_CASE(axisTransform_curves) {
+	AxisTransformer transformer;
+	auto t = _transform(0);
+	t.curveType = AxisCurveType::Power;
+	t.curveParam = 2.0f;
+	transformer.configure(t);
+	vr::VRControllerAxis_t state;
+	int buttonEvent;
+	// Sampled into a lookup table, exact at the sample points
+	_apply(transformer, 0.5f, 0.0f, state, buttonEvent);
+	CHECK(_near(state.x, 0.25f));
+	_apply(transformer, -0.75f, 0.0f, state, buttonEvent);
+	CHECK(_near(state.x, -0.5625f));
+	_apply(transformer, 0.3f, 0.0f, state, buttonEvent);
+	CHECK(std::fabs(state.x - 0.09f) < 0.001f);
+
+	t.curveType = AxisCurveType::Points;
+	t.curvePointCount = 1;
+	t.curvePoints[0][0] = 0.5f;
+	t.curvePoints[0][1] = 0.1f;
+	transformer.configure(t);
+	_apply(transformer, 0.25f, 0.0f, state, buttonEvent); // (0, 0) .. (0.5, 0.1)
+	CHECK(_near(state.x, 0.05f));
+	_apply(transformer, 0.75f, 0.0f, state, buttonEvent); // (0.5, 0.1) .. (1, 1)
+	CHECK(_near(state.x, 0.55f));
+	_apply(transformer, 1.0f, 0.0f, state, buttonEvent);
+	CHECK(_near(state.x, 1.0f));
+	// More points than the struct holds are cut off
+	t.curvePointCount = AXISCURVE_MAXPOINTS + 5;
+	transformer.configure(t);
+	CHECK(transformer.config().curvePointCount == AXISCURVE_MAXPOINTS);
+}
+
+
+TEST_CASE(axisTransform_buttonHysteresis) {
+	AxisTransformer transformer;
+	auto t = _transform(1);
+	t.buttonId = 33;
+	t.buttonThreshold = 0.5f;
+	transformer.configure(t);
+	vr::VRControllerAxis_t state;
+	int buttonEvent;
+	_apply(transformer, 0.49f, 0.0f, state, buttonEvent);
+	CHECK(buttonEvent == 0 && !transformer.buttonPressed());
+	_apply(transformer, -0.5f, 0.0f, state, buttonEvent); // |x| counts
+	CHECK(buttonEvent == 1 && transformer.buttonPressed());
+	_apply(transformer, 0.6f, 0.0f, state, buttonEvent);
+	CHECK(buttonEvent == 0);
+	// Noise just below the threshold doesn't release it
+	_apply(transformer, 0.47f, 0.0f, state, buttonEvent);
+	CHECK(buttonEvent == 0 && transformer.buttonPressed());
+	_apply(transformer, 0.44f, 0.0f, state, buttonEvent);
+	CHECK(buttonEvent == 2 && !transformer.buttonPressed());
+	_apply(transformer, 0.47f, 0.0f, state, buttonEvent);
+	CHECK(buttonEvent == 0);
+	// The threshold is checked after deadzone and curve
+	t.deadzone = 0.2f;
+	transformer.configure(t);
+	_apply(transformer, 0.55f, 0.0f, state, buttonEvent); // -> 0.4375
+	CHECK(buttonEvent == 0);
+	_apply(transformer, 0.6f, 0.0f, state, buttonEvent); // -> 0.5
+	CHECK(buttonEvent == 1);
+	// Reconfiguring releases the button state
+	transformer.configure(t);
+	CHECK(!transformer.buttonPressed());
+}
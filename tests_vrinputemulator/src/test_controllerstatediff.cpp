@@ -0,0 +1,126 @@
+#include "tests.h"
+#include <utils/ControllerStateDiff.h>
+#include <cstring>
+
+using namespace vrinputemulator;
+using namespace vrinputemulator::driver;
+
+
+namespace {
+
+// Records events without allocating, so the benchmark only measures the diff
+struct EventLog {
+	uint32_t events[2 * 64 * 2 + vr::k_unControllerStateAxisCount];
+	unsigned count = 0;
+
+	void button(unsigned buttonId, ButtonEventType type) {
+		events[count++] = buttonId << 8 | (uint32_t)type;
+	}
+	void axis(unsigned axisId) {
+		events[count++] = 0x10000 | axisId;
+	}
+	bool operator==(const EventLog& other) const {
+		return count == other.count && std::memcmp(events, other.events, count * sizeof(uint32_t)) == 0;
+	}
+};
+
+}
+
+
+// What updateControllerState() did before: test every button id
+static void _fullScanDiff(const vr::VRControllerState_t& oldState, const vr::VRControllerState_t& newState, EventLog& log) {
+	for (unsigned i = 0; i < 64; ++i) {
+		uint64_t mask = 1ull << i;
+		if ((oldState.ulButtonTouched & mask) != (newState.ulButtonTouched & mask)) {
+			log.button(i, (newState.ulButtonTouched & mask) ? ButtonEventType::ButtonTouched : ButtonEventType::ButtonUntouched);
+		}
+		if ((oldState.ulButtonPressed & mask) != (newState.ulButtonPressed & mask)) {
+			log.button(i, (newState.ulButtonPressed & mask) ? ButtonEventType::ButtonPressed : ButtonEventType::ButtonUnpressed);
+		}
+	}
+	for (unsigned i = 0; i < vr::k_unControllerStateAxisCount; ++i) {
+		if (oldState.rAxis[i].x != newState.rAxis[i].x || oldState.rAxis[i].y != newState.rAxis[i].y) {
+			log.axis(i);
+		}
+	}
+}
+
+static void _bitmaskDiff(const vr::VRControllerState_t& oldState, const vr::VRControllerState_t& newState, EventLog& log) {
+	diffControllerState(oldState, newState, [&log](unsigned buttonId, ButtonEventType type) {
+		log.button(buttonId, type);
+	}, [&log](unsigned axisId) {
+		log.axis(axisId);
+	});
+}
+
+static vr::VRControllerState_t _state(uint64_t pressed, uint64_t touched, float axis) {
+	vr::VRControllerState_t state;
+	std::memset(&state, 0, sizeof(state));
+	state.ulButtonPressed = pressed;
+	state.ulButtonTouched = touched;
+	for (unsigned i = 0; i < vr::k_unControllerStateAxisCount; ++i) {
+		state.rAxis[i].x = i == 0 || axis == 0.0f ? axis : -axis;
+	}
+	return state;
+}
+
+
+TEST_CASE(controllerStateDiff_lowestSetBit) {
+	CHECK(lowestSetBit(1) == 0);
+	CHECK(lowestSetBit(0x80) == 7);
+	CHECK(lowestSetBit(1ull << 32) == 32);
+	CHECK(lowestSetBit(1ull << 63) == 63);
+	CHECK(lowestSetBit(0xF000000000000000ull | 1ull << 40) == 40);
+}
+
+
+TEST_CASE(controllerStateDiff_matchesFullScan) {
+	const vr::VRControllerState_t states[] = {
+		_state(0, 0, 0.0f),
+		_state(1ull << 33, 1ull << 33, 0.0f),
+		_state(1ull << 33 | 1ull << 1, 1ull << 32 | 1ull << 2, 0.5f),
+		_state(0xFFFFFFFFFFFFFFFFull, 0, 0.25f),
+		_state(0x8000000000000001ull, 0xFFFFFFFFFFFFFFFFull, 0.25f),
+		_state(0, 0, 1.0f)
+	};
+	for (auto& a : states) {
+		for (auto& b : states) {
+			EventLog expected, actual;
+			_fullScanDiff(a, b, expected);
+			_bitmaskDiff(a, b, actual);
+			CHECK(expected == actual);
+		}
+	}
+	// Identical states report nothing
+	bool called = false;
+	CHECK(!diffControllerState(states[2], states[2], [&](unsigned, ButtonEventType) { called = true; }, [&](unsigned) { called = true; }));
+	CHECK(!called);
+}
+
+
+TEST_CASE(controllerStateDiff_benchmark) {
+	const unsigned rounds = 200000;
+	// Sparse: one button press and one axis per update, what a client typically sends
+	const vr::VRControllerState_t sparse[2] = { _state(1ull << 33, 0, 0.0f), _state(0, 0, 0.1f) };
+	// Dense: every button and axis changes on every update
+	const vr::VRControllerState_t dense[2] = { _state(0, 0, 0.0f), _state(0xFFFFFFFFFFFFFFFFull, 0xFFFFFFFFFFFFFFFFull, 0.5f) };
+	volatile unsigned sink = 0;
+	auto run = [&](const vr::VRControllerState_t* states, void (*diff)(const vr::VRControllerState_t&, const vr::VRControllerState_t&, EventLog&)) {
+		unsigned i = 0;
+		return tests::benchmark(rounds, [&]() {
+			EventLog log;
+			diff(states[i & 1], states[(i + 1) & 1], log);
+			sink = sink + log.count;
+			++i;
+		});
+	};
+	auto sparseScan = run(sparse, &_fullScanDiff);
+	auto sparseBitmask = run(sparse, &_bitmaskDiff);
+	auto denseScan = run(dense, &_fullScanDiff);
+	auto denseBitmask = run(dense, &_bitmaskDiff);
+	tests::report("controller state diff, sparse: full scan %.1f ns, bitmask %.1f ns; dense: full scan %.1f ns, bitmask %.1f ns",
+		sparseScan, sparseBitmask, denseScan, denseBitmask);
+	if (tests::enforceTimingLimits) {
+		CHECK(sparseBitmask < sparseScan);
+	}
+}
@@ -0,0 +1,151 @@
+#include "tests.h"
+#include <utils/DevicePropertyStore.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+using namespace vrinputemulator;
+using namespace vrinputemulator::driver;
+
+
+static_assert(std::is_nothrow_move_constructible<DevicePropertyStore::Entry>::value, "std::vector would copy entries when growing");
+static_assert(std::is_nothrow_move_assignable<DevicePropertyValue>::value, "erase would copy entries");
+
+
+// Same mix of types and string lengths a typical tracker profile sets
+static const unsigned propertyCount = 128;
+
+static vr::ETrackedDeviceProperty _prop(unsigned i) {
+	return (vr::ETrackedDeviceProperty)(1000 + i * 3);
+}
+
+static void _fill(DevicePropertyStore& store, unsigned variant) {
+	static const std::string longStrings[] = { std::string(200, 'a'), std::string(200, 'b'), std::string(200, 'c') };
+	auto& longString = longStrings[variant % 3];
+	vr::HmdMatrix34_t matrix = {};
+	matrix.m[0][0] = matrix.m[1][1] = matrix.m[2][2] = 1.0f;
+	matrix.m[0][3] = (float)variant;
+	for (unsigned i = 0; i < propertyCount; ++i) {
+		switch (i % 6) {
+		case 0:
+			store.set(_prop(i), (int32_t)(i + variant));
+			break;
+		case 1:
+			store.set(_prop(i), (float)i * 0.5f + (float)variant);
+			break;
+		case 2:
+			store.set(_prop(i), (variant + i) % 2 == 0);
+			break;
+		case 3:
+			store.set(_prop(i), (uint64_t)i << 32 | variant);
+			break;
+		case 4:
+			store.set(_prop(i), i % 12 == 4 ? longString.c_str() : "lighthouse");
+			break;
+		case 5:
+			store.set(_prop(i), matrix);
+			break;
+		}
+	}
+}
+
+
+TEST_CASE(devicePropertyValue_stringWithoutTerminator) {
+	// Exactly sized buffers without a terminating '\0', as received in a property batch
+	std::unique_ptr<char[]> shortValue(new char[3]);
+	std::memcpy(shortValue.get(), "abc", 3);
+	DevicePropertyValue value;
+	value.set(shortValue.get(), 3);
+	std::string result;
+	CHECK(value.get(result) == vr::TrackedProp_Success);
+	CHECK(result == "abc");
+	CHECK(value.size() == 4);
+	CHECK(((const char*)value.data())[3] == '\0');
+
+	const size_t longLength = 100;
+	std::unique_ptr<char[]> longValue(new char[longLength]);
+	std::memset(longValue.get(), 'x', longLength);
+	value.set(longValue.get(), longLength);
+	CHECK(value.get(result) == vr::TrackedProp_Success);
+	CHECK(result == std::string(longLength, 'x'));
+	CHECK(((const char*)value.data())[longLength] == '\0');
+}
+
+
+TEST_CASE(devicePropertyValue_typedLookup) {
+	DevicePropertyStore store;
+	store.set(_prop(0), (int32_t)42);
+	int32_t i = 0;
+	float f = 0.0f;
+	CHECK(store.get(_prop(0), i) == vr::TrackedProp_Success && i == 42);
+	CHECK(store.get(_prop(0), f) == vr::TrackedProp_WrongDataType);
+	CHECK(store.get(_prop(1), i) == vr::TrackedProp_ValueNotProvidedByDevice);
+	CHECK(store.remove(_prop(0)) && store.empty());
+}
+
+
+TEST_CASE(devicePropertyStore_growWithoutCopies) {
+	DevicePropertyStore store;
+	_fill(store, 0);
+	CHECK(store.size() == propertyCount);
+	// Growing moves the entries, only the new vector buffer is allocated (and not the long strings again)
+	auto allocations = tests::allocationCount();
+	store.reserve(propertyCount * 2);
+	CHECK(tests::allocationCount() - allocations == 1);
+	std::string s;
+	CHECK(store.get(_prop(4), s) == vr::TrackedProp_Success && s == std::string(200, 'a'));
+}
+
+
+TEST_CASE(devicePropertyStore_benchmark) {
+	const unsigned rounds = 2000;
+	DevicePropertyStore store;
+	_fill(store, 0);
+
+	// Setting existing properties, including the long strings, must not allocate
+	auto allocations = tests::allocationCount();
+	unsigned variant = 1;
+	auto setNs = tests::benchmark(rounds, [&]() {
+		_fill(store, variant++);
+	}) / propertyCount;
+	CHECK(tests::allocationCount() == allocations);
+
+	int64_t checksum = 0;
+	allocations = tests::allocationCount();
+	auto getNs = tests::benchmark(rounds, [&]() {
+		for (unsigned i = 0; i < propertyCount; i += 6) {
+			int32_t v;
+			if (store.get(_prop(i), v) == vr::TrackedProp_Success) {
+				checksum += v;
+			}
+			float f;
+			if (store.get(_prop(i + 1), f) == vr::TrackedProp_Success) {
+				checksum += (int64_t)f;
+			}
+		}
+	}) / (propertyCount / 3);
+	CHECK(tests::allocationCount() == allocations);
+	CHECK(checksum != 0);
+
+	// What Activate() does: one vr::PropertyWrite_t per property for a single WritePropertyBatch() call
+	std::vector<vr::PropertyWrite_t> writes;
+	writes.reserve(propertyCount);
+	allocations = tests::allocationCount();
+	auto replayNs = tests::benchmark(rounds, [&]() {
+		writes.clear();
+		for (auto& e : store) {
+			vr::PropertyWrite_t write;
+			std::memset(&write, 0, sizeof(write));
+			write.prop = e.deviceProperty;
+			if (e.value.toPropertyWrite(write)) {
+				writes.push_back(write);
+			}
+		}
+	});
+	CHECK(tests::allocationCount() == allocations);
+	CHECK(writes.size() == propertyCount);
+
+	tests::report("%u properties: set %.1f ns, get %.1f ns per property, Activate() replay %.0f ns per device",
+		propertyCount, setNs, getNs, replayNs);
+}
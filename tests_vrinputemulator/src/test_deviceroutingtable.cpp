@@ -0,0 +1,98 @@
+#include "tests.h"
+#include <utils/DeviceRoutingTable.h>
+#include <algorithm>
+#include <memory>
+
+using namespace vrinputemulator;
+using namespace vrinputemulator::driver;
+
+
+static const uint32_t allChannels = (uint32_t)DeviceRouteChannel::All;
+
+static bool _preemptedBy(const DeviceRoutingTable::Target& target, uint32_t sourceId) {
+	return std::find(target.preemptedBy.begin(), target.preemptedBy.end(), sourceId) != target.preemptedBy.end();
+}
+
+static const DeviceRoutingTable::Target* _target(const DeviceRoutingTable::Dispatch* dispatch, uint32_t openvrId) {
+	if (dispatch) {
+		for (auto& t : dispatch->targets) {
+			if (t.openvrId == openvrId) {
+				return &t;
+			}
+		}
+	}
+	return nullptr;
+}
+
+
+TEST_CASE(deviceRoutingTable_rejectsInvalidRoutes) {
+	auto table = std::make_unique<DeviceRoutingTable>();
+	CHECK(!table->compile({ { vr::k_unMaxTrackedDeviceCount, 1, allChannels, 0 } }));
+	CHECK(!table->compile({ { 1, vr::k_unMaxTrackedDeviceCount, allChannels, 0 } }));
+	CHECK(!table->compile({ { 1, 2, 0, 0 } }));
+	CHECK(!table->compile({ { 1, 2, 8, 0 } }));
+	// One bad route rejects the whole set
+	CHECK(!table->compile({ { 1, 2, allChannels, 0 }, { 3, 100, allChannels, 0 } }));
+	CHECK(table->compile({ { 1, DEVICEROUTING_DROP, allChannels, 0 } }));
+}
+
+
+TEST_CASE(deviceRoutingTable_channelsAndSelf) {
+	auto table = std::make_unique<DeviceRoutingTable>();
+	CHECK(table->compile({
+		{ 1, 2, (uint32_t)DeviceRouteChannel::Buttons, 0 },
+		{ 3, 4, (uint32_t)DeviceRouteChannel::Pose, 0 },
+		{ 3, 3, (uint32_t)DeviceRouteChannel::Pose, 0 },
+		{ 5, DEVICEROUTING_DROP, (uint32_t)DeviceRouteChannel::Pose, 0 },
+		{ 6, 7, (uint32_t)DeviceRouteChannel::Pose, 0 },
+		{ 7, 6, (uint32_t)DeviceRouteChannel::Pose, 0 }
+	}));
+	// Unrouted channels and devices keep sending to themselves
+	CHECK(table->find(1, DeviceRouteChannel::Pose) == nullptr);
+	CHECK(table->find(1, DeviceRouteChannel::Axes) == nullptr);
+	CHECK(table->find(2, DeviceRouteChannel::Buttons) == nullptr);
+	auto buttons = table->find(1, DeviceRouteChannel::Buttons);
+	CHECK(buttons && buttons->targets.size() == 1 && _target(buttons, 2));
+	CHECK(!buttons->disconnectSelf); // only pose routes disconnect
+
+	// Still sending to itself as well
+	auto pose3 = table->find(3, DeviceRouteChannel::Pose);
+	CHECK(pose3 && pose3->targets.size() == 2 && !pose3->disconnectSelf);
+	// Dropped: used, no targets, shows as disconnected
+	auto pose5 = table->find(5, DeviceRouteChannel::Pose);
+	CHECK(pose5 && pose5->targets.empty() && pose5->disconnectSelf);
+	// Swapped devices are fed by each other, so they stay connected
+	auto pose6 = table->find(6, DeviceRouteChannel::Pose);
+	CHECK(pose6 && _target(pose6, 7) && !pose6->disconnectSelf);
+}
+
+
+TEST_CASE(deviceRoutingTable_preemption) {
+	auto table = std::make_unique<DeviceRoutingTable>();
+	CHECK(table->compile({
+		{ 1, 10, allChannels, 0 },
+		{ 2, 10, allChannels, 5 },
+		{ 3, 10, allChannels, 9 },
+		{ 3, 10, (uint32_t)DeviceRouteChannel::Pose, -1 }, // duplicate with a lower priority, ignored
+		{ 4, 10, (uint32_t)DeviceRouteChannel::Axes, 9 } // same priority as 3, neither preempts the other
+	}));
+	auto t1 = _target(table->find(1, DeviceRouteChannel::Pose), 10);
+	auto t2 = _target(table->find(2, DeviceRouteChannel::Pose), 10);
+	auto t3 = _target(table->find(3, DeviceRouteChannel::Pose), 10);
+	CHECK(t1 && t2 && t3);
+	CHECK(t1->preemptedBy.size() == 2 && _preemptedBy(*t1, 2) && _preemptedBy(*t1, 3));
+	CHECK(t2->preemptedBy.size() == 1 && _preemptedBy(*t2, 3));
+	CHECK(t3->preemptedBy.empty());
+	CHECK(table->find(3, DeviceRouteChannel::Pose)->targets.size() == 1);
+
+	auto a1 = _target(table->find(1, DeviceRouteChannel::Axes), 10);
+	auto a3 = _target(table->find(3, DeviceRouteChannel::Axes), 10);
+	auto a4 = _target(table->find(4, DeviceRouteChannel::Axes), 10);
+	CHECK(a1 && a3 && a4);
+	CHECK(a1->preemptedBy.size() == 3 && _preemptedBy(*a1, 4));
+	CHECK(a3->preemptedBy.empty() && a4->preemptedBy.empty());
+	CHECK(table->find(4, DeviceRouteChannel::Pose) == nullptr);
+
+	// Being a target doesn't give a device routes of its own
+	CHECK(table->find(10, DeviceRouteChannel::Pose) == nullptr);
+}
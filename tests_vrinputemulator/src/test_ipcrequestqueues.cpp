@@ -0,0 +1,207 @@
+#include "tests.h"
+#include <utils/IpcRequestQueues.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace vrinputemulator;
+using namespace vrinputemulator::driver;
+
+
+static const std::string serverQueueName = "tests_vrinputemulator.server_queue";
+static const std::string doorbellName = serverQueueName + ".doorbell";
+
+struct _Request {
+	uint32_t clientId;
+	uint32_t seq;
+};
+
+static const char* _removed(const std::string& name) {
+	boost::interprocess::message_queue::remove(name.c_str());
+	return name.c_str();
+}
+
+// The server side: server queue and request queues, like the driver's ipc thread creates them
+struct _Server {
+	boost::interprocess::message_queue serverQueue;
+	IpcRequestQueues queues;
+
+	_Server(bool withDoorbell = true)
+		: serverQueue(boost::interprocess::create_only, _removed(serverQueueName), 100, sizeof(_Request)),
+		queues(serverQueue, 100, sizeof(_Request)) {
+		if (withDoorbell) {
+			queues.open(doorbellName);
+		}
+	}
+	~_Server() {
+		queues.close();
+		boost::interprocess::message_queue::remove(serverQueueName.c_str());
+	}
+
+	bool receive(_Request& request, unsigned timeoutMs = 50) {
+		uint64_t recvSize;
+		return queues.receive(&request, sizeof(request), recvSize, timeoutMs) && recvSize == sizeof(request);
+	}
+};
+
+// The client side: sends to its own queue (or the server queue) and rings the doorbell, like VRInputEmulator::_send
+struct _Client {
+	uint32_t clientId;
+	std::unique_ptr<boost::interprocess::message_queue> queue;
+	std::unique_ptr<boost::interprocess::named_semaphore> doorbell;
+	uint32_t seq = 0;
+
+	_Client(_Server& server, uint32_t id, bool ownQueue = true) : clientId(id) {
+		auto name = serverQueueName + ".client" + std::to_string(id);
+		if (ownQueue && server.queues.add(id, name)) {
+			queue.reset(new boost::interprocess::message_queue(boost::interprocess::open_only, name.c_str()));
+		} else {
+			queue.reset(new boost::interprocess::message_queue(boost::interprocess::open_only, serverQueueName.c_str()));
+		}
+		if (server.queues.hasDoorbell()) {
+			doorbell.reset(new boost::interprocess::named_semaphore(boost::interprocess::open_only, doorbellName.c_str()));
+		}
+	}
+
+	bool send() {
+		_Request request = { clientId, seq };
+		if (!queue->try_send(&request, sizeof(request), 0)) {
+			return false;
+		}
+		seq++;
+		if (doorbell) {
+			doorbell->post();
+		}
+		return true;
+	}
+};
+
+
+TEST_CASE(ipcRequestQueues_floodingClient) {
+	_Server server;
+	_Client flooder(server, 1);
+	_Client quiet(server, 2);
+	CHECK(server.queues.clientCount() == 2);
+	while (flooder.send()) {}
+	CHECK(flooder.seq == 100); // its own queue is full, the server queue is not affected
+	CHECK(quiet.send());
+
+	// The quiet client's request is taken after at most one quota of the flooder's
+	std::vector<uint32_t> order;
+	_Request request;
+	while (server.receive(request, 0)) {
+		order.push_back(request.clientId);
+	}
+	CHECK(order.size() == 101);
+	unsigned quietIndex = 0;
+	while (quietIndex < order.size() && order[quietIndex] != 2) {
+		quietIndex++;
+	}
+	CHECK(quietIndex <= IpcRequestQueues::requestQuota);
+
+	// Both keep sending: never more than one quota in a row from one client while the other is waiting
+	for (unsigned i = 0; i < 50; ++i) {
+		flooder.send();
+	}
+	for (unsigned i = 0; i < 3; ++i) {
+		quiet.send();
+	}
+	order.clear();
+	while (server.receive(request, 0)) {
+		order.push_back(request.clientId);
+	}
+	CHECK(order.size() == 53);
+	unsigned run = 0;
+	unsigned maxRun = 0;
+	unsigned quietSeen = 0;
+	for (size_t i = 0; i < order.size(); ++i) {
+		run = i > 0 && order[i] == order[i - 1] ? run + 1 : 1;
+		if (quietSeen < 3) {
+			maxRun = run > maxRun ? run : maxRun;
+		}
+		quietSeen += order[i] == 2;
+	}
+	CHECK(quietSeen == 3);
+	CHECK(maxRun <= IpcRequestQueues::requestQuota);
+}
+
+
+TEST_CASE(ipcRequestQueues_doorbell) {
+	_Server server;
+	_Client client(server, 1);
+	// One post per request, every receive consumes one. Once all are taken, receive waits for the timeout.
+	for (unsigned i = 0; i < 5; ++i) {
+		CHECK(client.send());
+	}
+	_Request request;
+	for (uint32_t i = 0; i < 5; ++i) {
+		CHECK(server.receive(request) && request.seq == i);
+	}
+	CHECK(!client.doorbell->try_wait());
+	auto start = std::chrono::steady_clock::now();
+	CHECK(!server.receive(request, 20));
+	CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(15));
+
+	// A request without a doorbell post (older client on the server queue) is still found on timeout
+	_Client oldClient(server, 2, false);
+	oldClient.doorbell.reset();
+	CHECK(oldClient.send());
+	CHECK(server.receive(request, 20) && request.clientId == 2);
+}
+
+
+TEST_CASE(ipcRequestQueues_removeClient) {
+	_Server server;
+	_Client a(server, 1);
+	_Client b(server, 2);
+	_Client c(server, 3);
+	a.send();
+	for (unsigned i = 0; i < 3; ++i) {
+		b.send();
+		c.send();
+	}
+	_Request request;
+	CHECK(server.receive(request, 0) && request.clientId == 1);
+	CHECK(server.receive(request, 0) && request.clientId == 2);
+	// Removing a client before or after the current one keeps serving the current one
+	server.queues.remove(1);
+	CHECK(server.receive(request, 0) && request.clientId == 2);
+	server.queues.remove(3);
+	CHECK(server.receive(request, 0) && request.clientId == 2);
+	CHECK(server.queues.clientCount() == 1);
+	// The queues of removed clients are gone
+	CHECK(!server.receive(request, 0));
+	server.queues.remove(2);
+	CHECK(server.queues.clientCount() == 0);
+	// Unknown ids are ignored
+	server.queues.remove(7);
+}
+
+
+TEST_CASE(ipcRequestQueues_noDoorbell) {
+	_Server server(false);
+	_Client client(server, 1);
+	CHECK(server.queues.clientCount() == 0); // without a doorbell there are no client queues
+	CHECK(!client.doorbell);
+	CHECK(client.send());
+	_Request request;
+	CHECK(server.receive(request) && request.clientId == 1);
+	CHECK(!server.receive(request, 10));
+}
+
+
+// A reply queue nobody reads: sending gives up after the timeout instead of blocking the ipc thread
+TEST_CASE(ipcRequestQueues_replyTimeout) {
+	auto name = serverQueueName + ".reply";
+	boost::interprocess::message_queue::remove(name.c_str());
+	boost::interprocess::message_queue queue(boost::interprocess::create_only, name.c_str(), 2, sizeof(_Request));
+	_Request reply = { 1, 0 };
+	CHECK(ipcTimedSend(queue, &reply, sizeof(reply), 20));
+	CHECK(ipcTimedSend(queue, &reply, sizeof(reply), 20));
+	auto start = std::chrono::steady_clock::now();
+	CHECK(!ipcTimedSend(queue, &reply, sizeof(reply), 20));
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	CHECK(elapsed >= std::chrono::milliseconds(15) && elapsed < std::chrono::milliseconds(1000));
+	boost::interprocess::message_queue::remove(name.c_str());
+}
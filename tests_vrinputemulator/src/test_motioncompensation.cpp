@@ -0,0 +1,213 @@
+#include "tests.h"
+#include <utils/MotionCompensation.h>
+#include <cmath>
+#include <cstring>
+
+using namespace vrinputemulator;
+using namespace vrinputemulator::driver;
+
+
+// Deterministic platform: its center moves at constant velocity and it turns around the y axis at a constant rate.
+// Devices are given by their offset (and velocity) in the platform frame, the platform frame equals the world frame at t=0.
+static const double turnRate = 1.0; // rad/s
+static const vr::HmdVector3d_t platformCenter = { 0.2, 1.0, -0.3 };
+static const vr::HmdVector3d_t platformVelocity = { 0.1, 0.0, 0.05 };
+static const vr::HmdVector3d_t turnAxis = { 0.0, turnRate, 0.0 };
+static const double maxExtrapolation = 0.05;
+
+static vr::HmdQuaternion_t _platformRotation(double t) {
+	return { std::cos(turnRate * t / 2.0), 0.0, std::sin(turnRate * t / 2.0), 0.0 };
+}
+
+static vr::DriverPose_t _platformPose(int64_t time, const vr::HmdVector3d_t& offset, const vr::HmdVector3d_t& localVelocity = { 0.0, 0.0, 0.0 }) {
+	auto t = (double)time / 1.0e9;
+	auto rot = _platformRotation(t);
+	auto arm = vrmath::quaternionRotateVector(rot, offset + localVelocity * t);
+	auto vel = vrmath::quaternionRotateVector(rot, localVelocity);
+	auto pos = platformCenter + platformVelocity * t + arm;
+	auto velocity = platformVelocity + vrmath::crossProduct(turnAxis, arm) + vel;
+	auto acceleration = vrmath::crossProduct(turnAxis, vrmath::crossProduct(turnAxis, arm)) + vrmath::crossProduct(turnAxis, vel) * 2.0;
+	vr::DriverPose_t pose;
+	std::memset(&pose, 0, sizeof(pose));
+	pose.poseIsValid = true;
+	pose.deviceIsConnected = true;
+	pose.qWorldFromDriverRotation = { 1.0, 0.0, 0.0, 0.0 };
+	pose.qDriverFromHeadRotation = { 1.0, 0.0, 0.0, 0.0 };
+	pose.qRotation = rot * vrmath::quaternionFromRotationX(0.3);
+	for (unsigned i = 0; i < 3; ++i) {
+		pose.vecPosition[i] = pos.v[i];
+		pose.vecVelocity[i] = velocity.v[i];
+		pose.vecAcceleration[i] = acceleration.v[i];
+		pose.vecAngularVelocity[i] = turnAxis.v[i];
+	}
+	return pose;
+}
+
+static double _length(const double (&v)[3]) {
+	return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+static double _distance(const double (&a)[3], const vr::HmdVector3d_t& b) {
+	double d[3] = { a[0] - b.v[0], a[1] - b.v[1], a[2] - b.v[2] };
+	return _length(d);
+}
+
+// Angle between two rotations in radians
+static double _rotationError(const vr::HmdQuaternion_t& a, const vr::HmdQuaternion_t& b) {
+	auto d = std::fabs(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z);
+	return 2.0 * std::acos(d > 1.0 ? 1.0 : d);
+}
+
+
+static const vr::HmdVector3d_t referenceOffset = { 0.0, 0.1, 0.5 };
+static const vr::HmdVector3d_t deviceOffset = { -0.3, 0.6, 0.2 };
+
+static MotionCompensationState _zeroedState() {
+	MotionCompensationState state;
+	// Center away from the rotation axis, so the lever arm terms matter
+	state.setCenter({ 0.1, -0.2, 0.0 }, true);
+	state.setZeroPose(_platformPose(0, referenceOffset));
+	return state;
+}
+
+
+TEST_CASE(motionCompensation_needsZeroAndReferencePose) {
+	MotionCompensationState state;
+	auto pose = _platformPose(0, deviceOffset);
+	CHECK(!state.apply(pose, 0, maxExtrapolation));
+	state.setZeroPose(_platformPose(0, referenceOffset));
+	CHECK(!state.apply(pose, 0, maxExtrapolation));
+	state.updateReference(_platformPose(0, referenceOffset), 0);
+	CHECK(state.apply(pose, 0, maxExtrapolation));
+}
+
+
+TEST_CASE(motionCompensation_fixedDeviceOnRotatingPlatform) {
+	auto state = _zeroedState();
+	auto expected = _platformPose(0, deviceOffset);
+	double maxPositionError = 0.0;
+	double maxRotationError = 0.0;
+	double maxVelocity = 0.0;
+	double maxAcceleration = 0.0;
+	double maxAngularVelocity = 0.0;
+	// Reference at 250Hz, device at 1000Hz with a phase offset, so the reference always has to be extrapolated
+	const int64_t referenceInterval = 4000000;
+	const int64_t deviceInterval = 1000000;
+	int64_t nextReference = 0;
+	for (int64_t t = 300000; t < 2000000000; t += deviceInterval) {
+		while (nextReference <= t) {
+			state.updateReference(_platformPose(nextReference, referenceOffset), nextReference);
+			nextReference += referenceInterval;
+		}
+		auto pose = _platformPose(t, deviceOffset);
+		CHECK(state.apply(pose, t, maxExtrapolation));
+		maxPositionError = std::fmax(maxPositionError, _distance(pose.vecPosition, { expected.vecPosition[0], expected.vecPosition[1], expected.vecPosition[2] }));
+		maxRotationError = std::fmax(maxRotationError, _rotationError(pose.qRotation, expected.qRotation));
+		maxVelocity = std::fmax(maxVelocity, _length(pose.vecVelocity));
+		maxAcceleration = std::fmax(maxAcceleration, _length(pose.vecAcceleration));
+		maxAngularVelocity = std::fmax(maxAngularVelocity, _length(pose.vecAngularVelocity));
+	}
+	CHECK(maxPositionError < 0.0001);
+	CHECK(maxRotationError < 0.0001);
+	CHECK(maxVelocity < 0.0001);
+	// The reference's acceleration is held constant while extrapolating, which leaves about |w|^3 * |arm| * dt
+	CHECK(maxAcceleration < 0.005);
+	CHECK(maxAngularVelocity < 0.0001);
+}
+
+
+// A device moving across the platform keeps its platform-relative velocity, which needs the Coriolis term
+TEST_CASE(motionCompensation_movingDeviceOnRotatingPlatform) {
+	auto state = _zeroedState();
+	const vr::HmdVector3d_t localVelocity = { 0.4, 0.0, -0.2 };
+	for (int64_t t = 1000000000; t < 1500000000; t += 10000000) {
+		state.updateReference(_platformPose(t - 2000000, referenceOffset), t - 2000000);
+		auto pose = _platformPose(t, deviceOffset, localVelocity);
+		CHECK(state.apply(pose, t, maxExtrapolation));
+		auto expectedPos = platformCenter + deviceOffset + localVelocity * ((double)t / 1.0e9);
+		CHECK(_distance(pose.vecPosition, expectedPos) < 0.0001);
+		CHECK(_distance(pose.vecVelocity, localVelocity) < 0.0001);
+		CHECK(_length(pose.vecAcceleration) < 0.005);
+		CHECK(_length(pose.vecAngularVelocity) < 0.0001);
+	}
+}
+
+
+// The reference is extrapolated by at most maxExtrapolation, no matter how old it is
+TEST_CASE(motionCompensation_extrapolationClamp) {
+	auto state = _zeroedState();
+	const int64_t refTime = 1000000000;
+	state.updateReference(_platformPose(refTime, referenceOffset), refTime);
+	auto device = _platformPose(refTime + 200000000, deviceOffset);
+	auto late = device;
+	auto clamped = device;
+	CHECK(state.apply(late, refTime + 200000000, maxExtrapolation));
+	CHECK(state.apply(clamped, refTime + 50000000, maxExtrapolation));
+	CHECK(std::memcmp(late.vecPosition, clamped.vecPosition, sizeof(late.vecPosition)) == 0);
+	CHECK(std::memcmp(&late.qRotation, &clamped.qRotation, sizeof(late.qRotation)) == 0);
+	auto early = device;
+	auto clampedEarly = device;
+	CHECK(state.apply(early, refTime - 200000000, maxExtrapolation));
+	CHECK(state.apply(clampedEarly, refTime - 50000000, maxExtrapolation));
+	CHECK(std::memcmp(early.vecPosition, clampedEarly.vecPosition, sizeof(early.vecPosition)) == 0);
+
+	// Within the limit the same device pose is corrected exactly
+	auto inRange = _platformPose(refTime + 40000000, deviceOffset);
+	auto expected = _platformPose(0, deviceOffset);
+	CHECK(state.apply(inRange, refTime + 40000000, maxExtrapolation));
+	CHECK(_distance(inRange.vecPosition, { expected.vecPosition[0], expected.vecPosition[1], expected.vecPosition[2] }) < 0.0001);
+}
+
+
+// Reference at 369 Hz (controller), corrected device at 1120 Hz (HMD): error against the ideal result with and without
+// extrapolating the reference, and the cost of correcting one pose
+TEST_CASE(motionCompensation_benchmark) {
+	const int64_t referenceInterval = 1000000000 / 369;
+	const int64_t deviceInterval = 1000000000 / 1120;
+	const unsigned count = 1120 * 10;
+	std::vector<vr::DriverPose_t> poses(count);
+	std::vector<int64_t> times(count);
+	for (unsigned i = 0; i < count; ++i) {
+		times[i] = 100000 + i * deviceInterval;
+		poses[i] = _platformPose(times[i], deviceOffset);
+	}
+	auto expected = _platformPose(0, deviceOffset);
+	double sumError[2] = { 0.0, 0.0 };
+	double maxError[2] = { 0.0, 0.0 };
+	for (unsigned extrapolate = 0; extrapolate < 2; ++extrapolate) {
+		auto state = _zeroedState();
+		int64_t nextReference = 0;
+		for (unsigned i = 0; i < count; ++i) {
+			while (nextReference <= times[i]) {
+				state.updateReference(_platformPose(nextReference, referenceOffset), nextReference);
+				nextReference += referenceInterval;
+			}
+			auto pose = poses[i];
+			state.apply(pose, times[i], extrapolate ? maxExtrapolation : 0.0);
+			auto error = _distance(pose.vecPosition, { expected.vecPosition[0], expected.vecPosition[1], expected.vecPosition[2] });
+			sumError[extrapolate] += error;
+			maxError[extrapolate] = std::fmax(maxError[extrapolate], error);
+		}
+	}
+	tests::report("motion compensation, reference 369 Hz, device 1120 Hz: held reference %.3f mm avg (%.3f mm max), extrapolated %.6f mm avg (%.6f mm max)",
+		sumError[0] / count * 1000.0, maxError[0] * 1000.0, sumError[1] / count * 1000.0, maxError[1] * 1000.0);
+	CHECK(maxError[1] < 0.0001);
+	CHECK(maxError[1] * 100.0 < maxError[0]);
+
+	auto state = _zeroedState();
+	state.updateReference(_platformPose(times[0], referenceOffset), times[0]);
+	unsigned i = 0;
+	vr::DriverPose_t pose;
+	auto allocations = tests::allocationCount();
+	auto ns = tests::benchmark(count, [&]() {
+		pose = poses[i];
+		state.apply(pose, times[i], maxExtrapolation);
+		++i;
+	});
+	CHECK(tests::allocationCount() == allocations);
+	CHECK(std::isfinite(pose.vecPosition[0]));
+	tests::report("motion compensation: %.0f ns per pose (budget 1000 ns)", ns);
+	if (tests::enforceTimingLimits) {
+		CHECK(ns < 1000.0);
+	}
+}
@@ -0,0 +1,91 @@
+#include "tests.h"
+#include <utils/PointerHashMap.h>
+#include <map>
+#include <memory>
+
+using namespace vrinputemulator;
+using namespace vrinputemulator::driver;
+
+
+struct _Device {
+	uint64_t payload[6]; // about the spacing of real driver objects on the heap
+};
+
+
+TEST_CASE(pointerHashMap_insertAndAssign) {
+	PointerHashMap<_Device*, int, 4> map;
+	_Device a, b;
+	CHECK(map.find(&a) == 0);
+	CHECK(!map.insert(nullptr, 1));
+	CHECK(map.insert(&a, 1));
+	CHECK(!map.insert(&a, 2)); // insert keeps the old value
+	CHECK(map.find(&a) == 1);
+	CHECK(map.assign(&a, 3)); // assign replaces it, like std::map::operator[]
+	CHECK(map.find(&a) == 3);
+	CHECK(map.size() == 1);
+	CHECK(map.assign(&b, 4)); // and inserts new keys
+	CHECK(map.find(&b) == 4 && map.find(&a) == 3);
+	CHECK(map.size() == 2);
+	CHECK(!map.assign(nullptr, 5));
+}
+
+
+TEST_CASE(pointerHashMap_full) {
+	PointerHashMap<_Device*, _Device*, 3> map;
+	std::unique_ptr<_Device[]> devices(new _Device[map.capacity + 1]);
+	for (size_t i = 0; i < map.capacity; ++i) {
+		CHECK(map.insert(&devices[i], &devices[i]));
+	}
+	CHECK(map.size() == map.capacity);
+	CHECK(!map.insert(&devices[map.capacity], nullptr));
+	CHECK(!map.assign(&devices[map.capacity], nullptr));
+	CHECK(map.find(&devices[map.capacity]) == nullptr);
+	// Existing keys can still be reassigned
+	CHECK(map.assign(&devices[0], &devices[1]));
+	for (size_t i = 0; i < map.capacity; ++i) {
+		CHECK(map.find(&devices[i]) == &devices[i == 0 ? 1 : i]);
+	}
+}
+
+
+// The detour lookups: a few dozen devices, looked up on every haptic pulse and activation
+TEST_CASE(pointerHashMap_benchmark) {
+	const unsigned deviceCount = 32;
+	const unsigned lookups = 100000;
+	std::vector<std::unique_ptr<_Device>> devices;
+	PointerHashMap<_Device*, _Device*, 8> map;
+	std::map<_Device*, _Device*> stdMap;
+	for (unsigned i = 0; i < deviceCount; ++i) {
+		devices.emplace_back(new _Device());
+		map.insert(devices.back().get(), devices.back().get());
+		stdMap[devices.back().get()] = devices.back().get();
+	}
+	std::vector<_Device*> keys(lookups);
+	uint32_t seed = 3;
+	for (auto& k : keys) {
+		seed = seed * 1664525u + 1013904223u;
+		k = devices[(seed >> 8) % deviceCount].get();
+	}
+
+	unsigned i = 0;
+	uint64_t found = 0;
+	auto allocations = tests::allocationCount();
+	auto hashNs = tests::benchmark(lookups, [&]() {
+		auto key = keys[i++];
+		found += map.find(key) == key;
+	});
+	CHECK(tests::allocationCount() == allocations);
+	CHECK(found == lookups);
+	i = 0;
+	found = 0;
+	auto mapNs = tests::benchmark(lookups, [&]() {
+		auto key = keys[i++];
+		auto it = stdMap.find(key);
+		found += it != stdMap.end() && it->second == key;
+	});
+	CHECK(found == lookups);
+	tests::report("%u devices: PointerHashMap %.1f ns, std::map %.1f ns per lookup", deviceCount, hashNs, mapNs);
+	if (tests::enforceTimingLimits) {
+		CHECK(hashNs < 50.0);
+	}
+}
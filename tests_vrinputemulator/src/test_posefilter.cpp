@@ -0,0 +1,93 @@
+#include "tests.h"
+#include <utils/PoseFilter.h>
+#include <cmath>
+#include <cstring>
+
+using namespace vrinputemulator;
+using namespace vrinputemulator::driver;
+
+
+// Tracking rate of the fastest lighthouse devices
+static const int64_t sampleInterval = 1000000000 / 1120;
+
+// Deterministic noise in [-amplitude, amplitude]
+static double _noise(uint32_t& seed, double amplitude) {
+	seed = seed * 1664525u + 1013904223u;
+	return ((double)(seed >> 8) / (double)(1u << 24) * 2.0 - 1.0) * amplitude;
+}
+
+static void _noisyPose(vr::DriverPose_t& pose, uint32_t& seed) {
+	std::memset(&pose, 0, sizeof(pose));
+	pose.poseIsValid = true;
+	pose.deviceIsConnected = true;
+	pose.vecPosition[0] = 0.2 + _noise(seed, 0.001);
+	pose.vecPosition[1] = 1.5 + _noise(seed, 0.001);
+	pose.vecPosition[2] = -0.3 + _noise(seed, 0.001);
+	auto angle = _noise(seed, 0.002);
+	pose.qRotation = { std::cos(angle / 2.0), 0.0, std::sin(angle / 2.0), 0.0 };
+}
+
+static void _configureFullChain(PoseFilterChain& chain) {
+	PoseFilterStage stages[3];
+	std::memset(stages, 0, sizeof(stages));
+	stages[0].type = PoseFilterType::OneEuro;
+	stages[0].params[0] = 1.0;
+	stages[0].params[1] = 0.5;
+	stages[0].params[2] = 1.0;
+	stages[1].type = PoseFilterType::Exponential;
+	stages[1].params[0] = 0.5;
+	stages[2].type = PoseFilterType::Kalman;
+	stages[2].params[0] = 0.01;
+	stages[2].params[1] = 0.1;
+	chain.configure(stages, 3);
+}
+
+
+TEST_CASE(poseFilter_smoothsJitter) {
+	PoseFilterChain chain;
+	_configureFullChain(chain);
+	CHECK(chain.stageCount() == 3);
+	uint32_t seed = 7;
+	double rawJitter = 0.0;
+	double filteredJitter = 0.0;
+	int64_t timestamp = 1000000000;
+	for (unsigned i = 0; i < 2240; ++i) {
+		vr::DriverPose_t pose;
+		_noisyPose(pose, seed);
+		auto raw = pose.vecPosition[0] - 0.2;
+		chain.apply(pose, timestamp);
+		timestamp += sampleInterval;
+		CHECK(std::isfinite(pose.vecPosition[0]) && std::isfinite(pose.qRotation.w));
+		// Skip the first second while the filters settle
+		if (i >= 1120) {
+			rawJitter += raw * raw;
+			filteredJitter += (pose.vecPosition[0] - 0.2) * (pose.vecPosition[0] - 0.2);
+		}
+	}
+	CHECK(filteredJitter < rawJitter * 0.25);
+}
+
+
+TEST_CASE(poseFilter_benchmark) {
+	const unsigned count = 1120 * 10;
+	// Inputs are prepared up front, so only the filter chain is measured
+	std::vector<vr::DriverPose_t> poses(count);
+	uint32_t seed = 11;
+	for (auto& p : poses) {
+		_noisyPose(p, seed);
+	}
+	PoseFilterChain chain;
+	_configureFullChain(chain);
+	unsigned i = 0;
+	int64_t timestamp = 1000000000;
+	auto allocations = tests::allocationCount();
+	auto ns = tests::benchmark(count, [&]() {
+		chain.apply(poses[i++], timestamp);
+		timestamp += sampleInterval;
+	});
+	CHECK(tests::allocationCount() == allocations);
+	tests::report("OneEuro + Exponential + Kalman at 1120 Hz: %.0f ns per pose (budget 1000 ns)", ns);
+	if (tests::enforceTimingLimits) {
+		CHECK(ns < 1000.0);
+	}
+}
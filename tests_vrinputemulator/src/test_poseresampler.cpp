@@ -0,0 +1,128 @@
+#include "tests.h"
+#include <utils/PoseResampler.h>
+#include <cmath>
+#include <cstring>
+
+using namespace vrinputemulator;
+using namespace vrinputemulator::driver;
+
+
+// Deterministic trajectory: swinging on the x axis and turning around the y axis
+static const double pi = 3.14159265358979323846;
+static const double swingFrequency = 0.5; // Hz
+static const double turnRate = 0.5; // rad/s
+
+static vr::DriverPose_t _trajectory(int64_t time) {
+	auto t = (double)time / 1.0e9;
+	vr::DriverPose_t pose;
+	std::memset(&pose, 0, sizeof(pose));
+	pose.poseIsValid = true;
+	pose.deviceIsConnected = true;
+	pose.vecPosition[0] = std::sin(2.0 * pi * swingFrequency * t);
+	pose.vecPosition[1] = 1.5;
+	pose.vecVelocity[0] = 2.0 * pi * swingFrequency * std::cos(2.0 * pi * swingFrequency * t);
+	pose.vecAngularVelocity[1] = turnRate;
+	pose.qRotation = { std::cos(turnRate * t / 2.0), 0.0, std::sin(turnRate * t / 2.0), 0.0 };
+	return pose;
+}
+
+// Angle between two rotations in radians
+static double _rotationError(const vr::HmdQuaternion_t& a, const vr::HmdQuaternion_t& b) {
+	auto d = std::fabs(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z);
+	return 2.0 * std::acos(d > 1.0 ? 1.0 : d);
+}
+
+// Sample intervals between 16.7 and 33.3 ms (60 to 30 Hz), from a fixed linear congruential sequence
+static int64_t _nextSampleInterval(uint32_t& seed) {
+	seed = seed * 1664525u + 1013904223u;
+	return 16666667 + (int64_t)(seed >> 8) % 16666667;
+}
+
+
+TEST_CASE(poseResampler_trajectory) {
+	const int64_t delay = 40000000; // longer than latency plus the largest sample interval, so it always interpolates
+	const int64_t latency = 5000000; // samples arrive 5 ms after they were taken
+	PoseResampler resampler;
+	resampler.configure((double)delay / 1.0e9, 90.0);
+	CHECK(resampler.enabled() && resampler.interval() == 11111111);
+
+	vr::DriverPose_t current;
+	int64_t currentTime = 0;
+	uint32_t seed = 42;
+	int64_t nextSampleTime = 1000000000;
+	int64_t now = nextSampleTime + delay + latency + 100000000;
+	int64_t lastOutput = 0;
+	unsigned outputs = 0;
+	double maxPositionError = 0.0;
+	double maxRotationError = 0.0;
+	while (outputs < 900) {
+		while (nextSampleTime + latency <= now) {
+			resampler.sampleReplaced(current, currentTime, nextSampleTime);
+			current = _trajectory(nextSampleTime);
+			currentTime = nextSampleTime;
+			nextSampleTime += _nextSampleInterval(seed);
+		}
+		CHECK(resampler.due(now));
+		vr::DriverPose_t pose;
+		resampler.resample(pose, current, currentTime, now, 0.05);
+		auto expected = _trajectory(now - delay);
+		for (unsigned i = 0; i < 3; ++i) {
+			auto error = std::fabs(pose.vecPosition[i] - expected.vecPosition[i]);
+			if (error > maxPositionError) {
+				maxPositionError = error;
+			}
+		}
+		auto rotationError = _rotationError(pose.qRotation, expected.qRotation);
+		if (rotationError > maxRotationError) {
+			maxRotationError = rotationError;
+		}
+		CHECK(pose.poseTimeOffset == 0.0);
+
+		// Fixed output cadence
+		if (lastOutput != 0) {
+			CHECK(now - lastOutput == resampler.interval());
+		}
+		lastOutput = now;
+		++outputs;
+		now = resampler.advance(now);
+		CHECK(!resampler.due(now - 1));
+	}
+	// Linear interpolation error of sin(pi t) over at most 33.3 ms: h^2 / 8 * pi^2 = 1.4 mm
+	CHECK(maxPositionError < 0.0015);
+	// Constant rate rotation around a fixed axis, slerp reproduces it exactly
+	CHECK(maxRotationError < 1.0e-6);
+	tests::report("%u poses at 90 Hz from 30-60 Hz samples: max position error %.2f mm, max rotation error %.2g rad",
+		outputs, maxPositionError * 1000.0, maxRotationError);
+}
+
+
+TEST_CASE(poseResampler_stallAndExtrapolation) {
+	PoseResampler resampler;
+	resampler.configure(0.0, 100.0);
+	auto sample = _trajectory(0);
+	int64_t sampleTime = 1000000000;
+
+	// First pose is due immediately, then every 10 ms
+	int64_t now = sampleTime;
+	CHECK(resampler.due(now));
+	CHECK(resampler.advance(now) == now + 10000000);
+
+	// After a stall the cadence restarts from now instead of emitting the missed poses in a burst
+	now += 95000000;
+	CHECK(resampler.due(now));
+	CHECK(resampler.advance(now) == now + 10000000);
+
+	// Without a newer sample the pose is extrapolated from the velocities, for at most the horizon
+	vr::DriverPose_t pose;
+	resampler.resample(pose, sample, sampleTime, sampleTime + 20000000, 0.05);
+	CHECK(std::fabs(pose.vecPosition[0] - sample.vecVelocity[0] * 0.02) < 1.0e-9);
+	CHECK(pose.vecVelocity[0] == sample.vecVelocity[0]);
+	resampler.resample(pose, sample, sampleTime, sampleTime + 200000000, 0.05);
+	CHECK(std::fabs(pose.vecPosition[0] - sample.vecVelocity[0] * 0.05) < 1.0e-9);
+	CHECK(pose.vecVelocity[0] == 0.0 && pose.vecAngularVelocity[1] == 0.0);
+
+	// Disabling forgets the previous sample
+	resampler.sampleReplaced(sample, sampleTime, sampleTime + 10000000);
+	resampler.configure(0.0, 0.0);
+	CHECK(!resampler.enabled() && !resampler.due(now));
+}
@@ -0,0 +1,93 @@
+#include "tests.h"
+#include <utils/SeqLock.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using namespace vrinputemulator::driver;
+
+
+namespace {
+
+// Large enough that a torn copy is likely to be caught, every field holds the same value
+struct StressValue {
+	uint64_t fields[16];
+};
+
+}
+
+
+TEST_CASE(seqLock_concurrentWriters) {
+	const unsigned writerCount = 3;
+	const unsigned readerCount = 3;
+	const uint64_t writesPerWriter = 100000;
+	SeqLock<StressValue> lock;
+	// SeqLock is single-writer, concurrent writers have to be serialized by the caller
+	std::mutex writeMutex;
+	uint64_t lastWritten = 0;
+	std::atomic<bool> writersDone(false);
+	std::atomic<uint64_t> tornReads(0);
+	std::atomic<uint64_t> backwardReads(0);
+	std::atomic<uint64_t> reads(0);
+
+	std::vector<std::thread> readers;
+	for (unsigned r = 0; r < readerCount; ++r) {
+		readers.emplace_back([&]() {
+			uint64_t previous = 0;
+			uint64_t count = 0;
+			bool done;
+			do {
+				done = writersDone;
+				auto v = lock.load();
+				for (unsigned i = 1; i < 16; ++i) {
+					if (v.fields[i] != v.fields[0]) {
+						++tornReads;
+						break;
+					}
+				}
+				// Writes are ordered by the mutex, so a reader must never see an older value again
+				if (v.fields[0] < previous) {
+					++backwardReads;
+				}
+				previous = v.fields[0];
+				++count;
+			} while (!done);
+			reads += count;
+		});
+	}
+
+	std::vector<std::thread> writers;
+	for (unsigned w = 0; w < writerCount; ++w) {
+		writers.emplace_back([&, w]() {
+			for (uint64_t n = 0; n < writesPerWriter; ++n) {
+				std::lock_guard<std::mutex> guard(writeMutex);
+				auto value = ++lastWritten;
+				if ((n + w) % 2 == 0) {
+					StressValue v;
+					for (auto& f : v.fields) {
+						f = value;
+					}
+					lock.store(v);
+				} else {
+					lock.modify([value](StressValue& v) {
+						for (auto& f : v.fields) {
+							f = value;
+						}
+					});
+				}
+			}
+		});
+	}
+	for (auto& t : writers) {
+		t.join();
+	}
+	writersDone = true;
+	for (auto& t : readers) {
+		t.join();
+	}
+
+	CHECK(tornReads == 0);
+	CHECK(backwardReads == 0);
+	CHECK(reads >= readerCount);
+	CHECK(lock.load().fields[0] == writerCount * writesPerWriter);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+
+namespace vrinputemulator {
+namespace tests {
+
+
+class test_failure : public std::runtime_error {
+	using std::runtime_error::runtime_error;
+};
+
+
+struct TestCase {
+	const char* name;
+	void (*func)();
+};
+
+inline std::vector<TestCase>& testCases() {
+	static std::vector<TestCase> cases;
+	return cases;
+}
+
+struct TestRegistration {
+	TestRegistration(const char* name, void (*func)()) {
+		testCases().push_back({ name, func });
+	}
+};
+
+
+// Number of global operator new calls so far (see main.cpp)
+uint64_t allocationCount();
+
+
+// Prints a benchmark result below the running test (printf format, no trailing newline)
+void report(const char* format, ...);
+
+// Returns the average duration of f() in nanoseconds
+template<class F>
+double benchmark(unsigned iterations, F f) {
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned i = 0; i < iterations; ++i) {
+		f();
+	}
+	auto duration = std::chrono::steady_clock::now() - start;
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / (double)iterations;
+}
+
+// Timing limits only mean something in optimized builds
+#ifdef NDEBUG
+	static const bool enforceTimingLimits = true;
+#else
+	static const bool enforceTimingLimits = false;
+#endif
+
+
+} // end namespace tests
+} // end namespace vrinputemulator
+
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static ::vrinputemulator::tests::TestRegistration name##_registration(#name, &name); \
+	static void name()
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			std::stringstream _ss; \
+			_ss << __FILE__ << ":" << __LINE__ << ": CHECK( " << #cond << " ) failed"; \
+			throw ::vrinputemulator::tests::test_failure(_ss.str()); \
+		} \
+	} while (false)